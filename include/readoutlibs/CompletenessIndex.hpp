@@ -0,0 +1,116 @@
+/**
+ * @file CompletenessIndex.hpp Run-length index of the timestamp ranges
+ * missing from a latency buffer
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_COMPLETENESSINDEX_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_COMPLETENESSINDEX_HPP_
+
+#include <cstdint> // uint_t types
+#include <iterator>
+#include <map>
+#include <mutex>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Tracks the gaps in the sequence of elements written to a latency buffer. The writer reports each element
+ * with its timestamp span; any ticks between the end of the newest element and the start of the next one are
+ * recorded as a missing range. Late elements fill the ranges they cover. Readers can then check a window for
+ * holes with a single lookup, logarithmic in the number of (usually few) missing ranges.
+ */
+class CompletenessIndex
+{
+public:
+  CompletenessIndex() {}
+
+  // Record an element covering [begin, end) as present
+  void add_element(uint64_t begin, uint64_t end) // NOLINT(build/unsigned)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_started) {
+      m_started = true;
+      m_next_expected = end;
+      return;
+    }
+    if (begin > m_next_expected) {
+      m_missing.emplace(m_next_expected, begin);
+    } else if (begin < m_next_expected) {
+      fill(begin, end);
+    }
+    if (end > m_next_expected) {
+      m_next_expected = end;
+    }
+  }
+
+  // Whether any tick of [begin, end) is known to be missing
+  bool has_gap(uint64_t begin, uint64_t end) // NOLINT(build/unsigned)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto it = m_missing.lower_bound(end);
+    if (it == m_missing.begin()) {
+      return false;
+    }
+    // The last range starting before the end of the window overlaps it if it ends after its start
+    return std::prev(it)->second > begin;
+  }
+
+  // Forget the missing ranges that end before the given timestamp
+  void remove_until(uint64_t ts) // NOLINT(build/unsigned)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (auto it = m_missing.begin(); it != m_missing.end() && it->second <= ts;) {
+      it = m_missing.erase(it);
+    }
+  }
+
+  size_t num_missing_ranges()
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_missing.size();
+  }
+
+  void reset()
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_missing.clear();
+    m_started = false;
+    m_next_expected = 0;
+  }
+
+private:
+  // Remove [begin, end) from the missing ranges, splitting them where needed
+  void fill(uint64_t begin, uint64_t end) // NOLINT(build/unsigned)
+  {
+    auto it = m_missing.lower_bound(begin);
+    if (it != m_missing.begin() && std::prev(it)->second > begin) {
+      --it;
+    }
+    while (it != m_missing.end() && it->first < end) {
+      auto range_begin = it->first;
+      auto range_end = it->second;
+      it = m_missing.erase(it);
+      if (range_begin < begin) {
+        m_missing.emplace(range_begin, begin);
+      }
+      if (range_end > end) {
+        m_missing.emplace(end, range_end);
+        break;
+      }
+    }
+  }
+
+  std::map<uint64_t, uint64_t> m_missing; // NOLINT(build/unsigned) begin -> end of each missing range
+  uint64_t m_next_expected = 0;           // NOLINT(build/unsigned)
+  bool m_started = false;
+  std::mutex m_mutex;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_COMPLETENESSINDEX_HPP_
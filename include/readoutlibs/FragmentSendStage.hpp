@@ -0,0 +1,305 @@
+/**
+ * @file FragmentSendStage.hpp Asynchronous fragment sending with per-destination
+ * queues and dedicated sender threads
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_FRAGMENTSENDSTAGE_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_FRAGMENTSENDSTAGE_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/readoutinfo/InfoNljs.hpp"
+
+#include "daqdataformats/Fragment.hpp"
+#include "daqdataformats/SourceID.hpp"
+#include "iomanager/IOManager.hpp"
+#include "logging/Logging.hpp"
+#include "opmonlib/InfoCollector.hpp"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Decouples fragment sending from data extraction. Extractor threads hand over finished fragments with enqueue(),
+ * while one sender thread per destination drains the corresponding queue. Queues are bounded: when a destination
+ * falls behind, enqueue() blocks for up to the configured queue timeout (backpressure) before the fragment is dropped.
+ * A sender thread takes up to batch_size fragments from its queue per lock, but sends them one at a time: batching
+ * only amortizes the queue locking, the connection sees individual sends.
+ */
+class FragmentSendStage
+{
+public:
+  // Send one fragment with a timeout. Throws an ers::Issue if it could not be sent.
+  using sender_t = std::function<void(std::unique_ptr<daqdataformats::Fragment>&&, std::chrono::milliseconds)>;
+  // Look up the sender of a destination. Throws an ers::Issue if there is none.
+  using sender_factory_t = std::function<sender_t(const std::string&)>;
+
+  FragmentSendStage()
+    : m_sender_factory(&FragmentSendStage::get_iom_fragment_sender)
+  {}
+
+  ~FragmentSendStage() { stop(); }
+
+  FragmentSendStage(const FragmentSendStage&) = delete;            ///< FragmentSendStage is not copy-constructible
+  FragmentSendStage& operator=(const FragmentSendStage&) = delete; ///< FragmentSendStage is not copy-assginable
+  FragmentSendStage(FragmentSendStage&&) = delete;                 ///< FragmentSendStage is not move-constructible
+  FragmentSendStage& operator=(FragmentSendStage&&) = delete;      ///< FragmentSendStage is not move-assignable
+
+  // Set queue bounds, batching and timeouts. Takes effect for destinations created after the call.
+  void conf(const daqdataformats::SourceID& sourceid,
+            size_t queue_size,
+            size_t batch_size,
+            int queue_timeout_ms,
+            int send_timeout_ms)
+  {
+    m_sourceid = sourceid;
+    m_queue_size = std::max<size_t>(queue_size, 1);
+    m_batch_size = std::max<size_t>(batch_size, 1);
+    m_queue_timeout = std::chrono::milliseconds(queue_timeout_ms);
+    m_send_timeout = std::chrono::milliseconds(send_timeout_ms);
+  }
+
+  // Replace how senders are looked up, by default from the IOManager. Must be called before start().
+  void set_sender_factory(sender_factory_t factory) { m_sender_factory = std::move(factory); }
+
+  // Time before a failed sender lookup is tried again. Fragments for the destination are dropped in the meantime.
+  void set_lookup_retry_interval(std::chrono::milliseconds interval) { m_lookup_retry_interval = interval; }
+
+  // Allow fragments to be enqueued. Destinations (and their threads) are created lazily.
+  void start() { m_running.store(true); }
+
+  // Drain all queues, then join the sender threads and forget the destinations, including the failed lookups.
+  // Fragments enqueued concurrently are dropped once their destination is stopping.
+  void stop()
+  {
+    std::map<std::string, std::shared_ptr<Destination>> destinations;
+    {
+      std::lock_guard<std::mutex> lock(m_destinations_mutex);
+      m_running.store(false);
+      destinations.swap(m_destinations);
+      m_lookup_retry_times.clear();
+    }
+    // Draining may take up to queue_size send timeouts: joined without holding up enqueue() or get_info()
+    for (auto& [name, dest] : destinations) {
+      {
+        std::lock_guard<std::mutex> qlock(dest->mutex);
+        dest->quit = true;
+      }
+      dest->not_empty.notify_all();
+      dest->not_full.notify_all();
+      if (dest->thread.joinable()) {
+        dest->thread.join();
+      }
+    }
+  }
+
+  // Hand a fragment over to the sender of its destination. Returns false if it had to be dropped.
+  bool enqueue(const std::string& destination, std::unique_ptr<daqdataformats::Fragment>&& fragment)
+  {
+    auto dest = get_destination(destination);
+    if (dest == nullptr) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(dest->mutex);
+    if (dest->queue.size() >= m_queue_size && !dest->quit) {
+      ++dest->num_full_waits;
+      dest->not_full.wait_for(lock, m_queue_timeout, [&] { return dest->quit || dest->queue.size() < m_queue_size; });
+    }
+    if (dest->quit || dest->queue.size() >= m_queue_size) {
+      ++dest->num_dropped;
+      lock.unlock();
+      ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, destination));
+      return false;
+    }
+    dest->queue.push_back(std::move(fragment));
+    dest->max_depth = std::max(dest->max_depth, dest->queue.size());
+    lock.unlock();
+    dest->not_empty.notify_one();
+    return true;
+  }
+
+  // Total number of fragments waiting to be sent, over all destinations
+  size_t get_queue_depth()
+  {
+    size_t depth = 0;
+    std::lock_guard<std::mutex> lock(m_destinations_mutex);
+    for (auto& [name, dest] : m_destinations) {
+      std::lock_guard<std::mutex> qlock(dest->mutex);
+      depth += dest->queue.size();
+    }
+    return depth;
+  }
+
+  // Per-destination statistics, each destination as a child collector named after it
+  void get_info(opmonlib::InfoCollector& ci, int /*level*/)
+  {
+    std::lock_guard<std::mutex> lock(m_destinations_mutex);
+    for (auto& [name, dest] : m_destinations) {
+      readoutinfo::FragmentSendInfo info;
+      {
+        std::lock_guard<std::mutex> qlock(dest->mutex);
+        info.queue_depth = dest->queue.size();
+        info.max_queue_depth = dest->max_depth;
+        dest->max_depth = dest->queue.size();
+      }
+      info.num_fragments_sent = dest->num_sent.exchange(0);
+      info.num_send_failures = dest->num_failed.exchange(0);
+      info.num_fragments_dropped = dest->num_dropped.exchange(0);
+      info.num_queue_full_waits = dest->num_full_waits.exchange(0);
+      opmonlib::InfoCollector child;
+      child.add(info);
+      ci.add(name, child);
+    }
+  }
+
+private:
+  static sender_t get_iom_fragment_sender(const std::string& destination)
+  {
+    auto sender = get_iom_sender<std::unique_ptr<daqdataformats::Fragment>>(destination);
+    return [sender](std::unique_ptr<daqdataformats::Fragment>&& fragment, std::chrono::milliseconds timeout) {
+      sender->send(std::move(fragment), timeout);
+    };
+  }
+
+  struct Destination
+  {
+    std::string name;
+    sender_t sender;
+    std::deque<std::unique_ptr<daqdataformats::Fragment>> queue;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool quit = false;
+    size_t max_depth = 0;
+    std::atomic<int> num_sent{ 0 };
+    std::atomic<int> num_failed{ 0 };
+    std::atomic<int> num_dropped{ 0 };
+    std::atomic<int> num_full_waits{ 0 };
+    std::thread thread;
+  };
+
+  // Shared with stop(), which may take the destination out of the map while a fragment is being enqueued
+  std::shared_ptr<Destination> get_destination(const std::string& destination)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_destinations_mutex);
+      if (!m_running.load()) {
+        return nullptr;
+      }
+      auto it = m_destinations.find(destination);
+      if (it != m_destinations.end()) {
+        return it->second;
+      }
+      // Do not retry (and warn about) a failed lookup for every fragment, only once the back-off has passed
+      auto retry = m_lookup_retry_times.find(destination);
+      if (retry != m_lookup_retry_times.end() && std::chrono::steady_clock::now() < retry->second) {
+        return nullptr;
+      }
+    }
+
+    // The lookup may be slow: do it without blocking the extractors of other destinations
+    sender_t sender;
+    try {
+      sender = m_sender_factory(destination);
+    } catch (const ers::Issue& excpt) {
+      ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, destination, excpt));
+      std::lock_guard<std::mutex> lock(m_destinations_mutex);
+      m_lookup_retry_times[destination] = std::chrono::steady_clock::now() + m_lookup_retry_interval;
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(m_destinations_mutex);
+    if (!m_running.load()) {
+      return nullptr;
+    }
+    auto it = m_destinations.find(destination);
+    if (it != m_destinations.end()) {
+      // Created by another extractor in the meantime
+      return it->second;
+    }
+    m_lookup_retry_times.erase(destination);
+    auto dest = std::make_shared<Destination>();
+    dest->name = destination;
+    dest->sender = std::move(sender);
+    dest->thread = std::thread(&FragmentSendStage::run_sender, this, dest.get());
+    char tname[16];
+    snprintf(tname, 16, "%s-%d", "fragsend", static_cast<int>(m_sourceid.id)); // NOLINT
+    pthread_setname_np(dest->thread.native_handle(), tname);
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Created fragment sender thread for destination " << destination;
+    m_destinations.emplace(destination, dest);
+    return dest;
+  }
+
+  void run_sender(Destination* dest)
+  {
+    std::vector<std::unique_ptr<daqdataformats::Fragment>> batch;
+    batch.reserve(m_batch_size);
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(dest->mutex);
+        dest->not_empty.wait(lock, [&] { return dest->quit || !dest->queue.empty(); });
+        if (dest->queue.empty()) {
+          // Only reached when quitting with nothing left to drain
+          break;
+        }
+        while (!dest->queue.empty() && batch.size() < m_batch_size) {
+          batch.push_back(std::move(dest->queue.front()));
+          dest->queue.pop_front();
+        }
+      }
+      dest->not_full.notify_all();
+      for (auto& fragment : batch) {
+        try {
+          dest->sender(std::move(fragment), m_send_timeout);
+          ++dest->num_sent;
+        } catch (const ers::Issue& excpt) {
+          ++dest->num_failed;
+          ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, dest->name, excpt));
+        }
+      }
+      batch.clear();
+    }
+  }
+
+  // Configuration
+  daqdataformats::SourceID m_sourceid;
+  size_t m_queue_size = 1000;
+  size_t m_batch_size = 16;
+  std::chrono::milliseconds m_queue_timeout{ 100 };
+  std::chrono::milliseconds m_send_timeout{ 10 };
+  sender_factory_t m_sender_factory;
+  std::chrono::milliseconds m_lookup_retry_interval{ 1000 };
+
+  // Destinations
+  std::atomic<bool> m_running{ false };
+  std::mutex m_destinations_mutex;
+  std::map<std::string, std::shared_ptr<Destination>> m_destinations;
+  std::map<std::string, std::chrono::steady_clock::time_point> m_lookup_retry_times; // of the lookups that failed
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_FRAGMENTSENDSTAGE_HPP_
@@ -73,6 +73,11 @@ ERS_DECLARE_ISSUE_BASE(readoutlibs,
 
 ERS_DECLARE_ISSUE(readoutlibs, CannotWriteToFile, "Could not write to file: " << filename, ((std::string)filename))
 
+ERS_DECLARE_ISSUE(readoutlibs,
+                  CannotCompleteSegment,
+                  "Could not complete recording segment " << filename << ": " << reason,
+                  ((std::string)filename)((std::string)reason))
+
 ERS_DECLARE_ISSUE(readoutlibs,
                   PostprocessingNotKeepingUp,
                   "SourceID[" << sourceid << "] Postprocessing has too much backlog, thread: " << i,
@@ -8,6 +8,9 @@
 #ifndef READOUTLIBS_INCLUDE_READOUTLIBS_READOUTTYPES_HPP_
 #define READOUTLIBS_INCLUDE_READOUTLIBS_READOUTTYPES_HPP_
 
+#include "daqdataformats/FragmentHeader.hpp"
+#include "daqdataformats/SourceID.hpp"
+
 #include <cstdint> // uint_t types
 #include <memory>  // unique_ptr
 #include <tuple>   // std::tie
@@ -43,6 +46,16 @@ struct DUMMY_FRAME_STRUCT
     return timestamp;
   }
 
+  uint64_t get_first_timestamp() const // NOLINT(build/unsigned)
+  {
+    return timestamp;
+  }
+
+  void set_first_timestamp(uint64_t ts) // NOLINT(build/unsigned)
+  {
+    timestamp = ts;
+  }
+
   void set_another_key(uint64_t compkey)
   {
     another_key = compkey; 
@@ -62,9 +75,20 @@ struct DUMMY_FRAME_STRUCT
 
   FrameType* end() { return (this + 1); } // NOLINT
 
+  size_t get_payload_size() const { return sizeof(DUMMY_FRAME_STRUCT); }
+
+  size_t get_num_frames() const { return 1; }
+
+  size_t get_frame_size() const { return sizeof(DUMMY_FRAME_STRUCT); }
+
   static const constexpr size_t frame_size = DUMMY_FRAME_SIZE;
   static const constexpr uint8_t frames_per_element = 1; // NOLINT(build/unsigned)
   static const constexpr size_t element_size = DUMMY_FRAME_SIZE;
+  static const constexpr size_t fixed_payload_size = sizeof(uint64_t) * 2 + DUMMY_FRAME_SIZE; // NOLINT(build/unsigned)
+  static const constexpr uint64_t expected_tick_difference = 25; // NOLINT(build/unsigned)
+  static const constexpr daqdataformats::SourceID::Subsystem subsystem =
+    daqdataformats::SourceID::Subsystem::kDetectorReadout;
+  static const constexpr daqdataformats::FragmentType fragment_type = daqdataformats::FragmentType::kUnknown;
 };
 
 } // namespace types
@@ -0,0 +1,268 @@
+/**
+ * @file TriggeredRecorder.hpp Background recording of the data windows
+ * served to requests, with an index keyed by trigger number and timestamp
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_TRIGGEREDRECORDER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_TRIGGEREDRECORDER_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/BufferedFileWriter.hpp"
+
+#include "daqdataformats/FragmentHeader.hpp"
+#include "daqdataformats/SourceID.hpp"
+#include "logging/Logging.hpp"
+
+#include <pthread.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+// One entry of the index file, per recorded window
+struct TriggeredRecordIndexEntry
+{
+  uint64_t trigger_number;    // NOLINT(build/unsigned)
+  uint64_t trigger_timestamp; // NOLINT(build/unsigned)
+  uint64_t window_begin;      // NOLINT(build/unsigned) of the recorded (padded) window
+  uint64_t window_end;        // NOLINT(build/unsigned)
+  uint64_t offset;            // NOLINT(build/unsigned) of the record in the data file
+  uint64_t size;              // NOLINT(build/unsigned) of the record, header included
+  uint32_t run_number;        // NOLINT(build/unsigned)
+  uint16_t sequence_number;   // NOLINT(build/unsigned)
+  uint16_t reserved;          // NOLINT(build/unsigned)
+};
+static_assert(sizeof(TriggeredRecordIndexEntry) == 56, "TriggeredRecordIndexEntry must stay packed in 56 bytes");
+
+/**
+ * Appends the data windows served to requests to a local file. Each record is laid out as a fragment: a
+ * FragmentHeader followed by the window's data. For every record, an entry is appended to a sidecar index
+ * file (the data file name with ".index" appended). Request handling threads copy the window out of the latency
+ * buffer into the queue, so the buffer is never held while the writer thread waits for the disk. The queue is
+ * bounded by the bytes it holds: when the writer falls behind, windows are dropped rather than holding up requests.
+ * The files are flushed on stop().
+ */
+class TriggeredRecorder
+{
+public:
+  TriggeredRecorder() {}
+
+  ~TriggeredRecorder()
+  {
+    stop();
+    close();
+  }
+
+  TriggeredRecorder(const TriggeredRecorder&) = delete;            ///< TriggeredRecorder is not copy-constructible
+  TriggeredRecorder& operator=(const TriggeredRecorder&) = delete; ///< TriggeredRecorder is not copy-assginable
+  TriggeredRecorder(TriggeredRecorder&&) = delete;                 ///< TriggeredRecorder is not move-constructible
+  TriggeredRecorder& operator=(TriggeredRecorder&&) = delete;      ///< TriggeredRecorder is not move-assignable
+
+  // Open the data and index files. Existing files are overwritten.
+  void conf(const daqdataformats::SourceID& sourceid,
+            const std::string& filename,
+            size_t buffer_size,
+            bool use_o_direct,
+            size_t queue_bytes)
+  {
+    close();
+    m_sourceid = sourceid;
+    m_max_queued_bytes = queue_bytes;
+    std::string index_filename = filename + ".index";
+    remove(filename.c_str());
+    remove(index_filename.c_str());
+    m_data_writer.open(filename, buffer_size, "None", use_o_direct);
+    m_index_writer.open(index_filename, 65536, "None", false);
+    m_use_o_direct = use_o_direct;
+    m_offset = 0;
+    TLOG(TLVL_WORK_STEPS) << "Triggered recording to " << filename << " with index " << index_filename;
+  }
+
+  bool is_open() const { return m_data_writer.is_open(); }
+
+  void start()
+  {
+    if (!is_open() || m_thread.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = false;
+    }
+    m_thread = std::thread(&TriggeredRecorder::run_writer, this);
+    char tname[16];
+    snprintf(tname, 16, "%s-%d", "trigrec", static_cast<int>(m_sourceid.id)); // NOLINT
+    pthread_setname_np(m_thread.native_handle(), tname);
+  }
+
+  // Write out what is still queued, join the writer thread and flush the files, so that a run ends up on disk
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_not_empty.notify_all();
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+    flush();
+  }
+
+  void close()
+  {
+    if (m_data_writer.is_open()) {
+      m_data_writer.close();
+    }
+    if (m_index_writer.is_open()) {
+      m_index_writer.close();
+    }
+  }
+
+  /**
+   * Copy a window into the queue: the header, followed by the data pieces. The pieces only need to stay valid
+   * until this returns.
+   * @return false if the window was dropped, as it did not fit in the queue.
+   */
+  bool record(daqdataformats::FragmentHeader header, const std::vector<std::pair<void*, size_t>>& pieces)
+  {
+    size_t size = sizeof(header);
+    for (const auto& piece : pieces) {
+      size += piece.second;
+    }
+    {
+      // Reserve the room first, so that nothing is copied for a window that gets dropped
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_quit || m_queued_bytes + size > m_max_queued_bytes) {
+        ++m_num_dropped;
+        return false;
+      }
+      m_queued_bytes += size;
+      ++m_num_copying;
+    }
+    header.size = size;
+    std::vector<char> record(size);
+    std::memcpy(record.data(), &header, sizeof(header));
+    size_t pos = sizeof(header);
+    for (const auto& piece : pieces) {
+      std::memcpy(record.data() + pos, piece.first, piece.second);
+      pos += piece.second;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.push_back(std::move(record));
+      --m_num_copying;
+    }
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  // Statistics since the last call
+  int get_num_recorded() { return m_num_recorded.exchange(0); }
+  int get_num_dropped() { return m_num_dropped.exchange(0); }
+  uint64_t get_bytes_written() { return m_bytes_written.exchange(0); } // NOLINT(build/unsigned)
+
+private:
+  void run_writer()
+  {
+    while (true) {
+      std::vector<char> record;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // Windows being copied when quitting are still written
+        m_not_empty.wait(lock, [&] { return !m_pending.empty() || (m_quit && m_num_copying == 0); });
+        if (m_pending.empty()) {
+          return; // quit, and nothing left to write
+        }
+        record = std::move(m_pending.front());
+        m_pending.pop_front();
+      }
+      write_record(record);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queued_bytes -= record.size();
+    }
+  }
+
+  // Write out what the writers buffer. With O_DIRECT, the data file is first padded to the block size, so that it
+  // keeps being written at aligned offsets: readers find the records through the offsets in the index.
+  void flush()
+  {
+    if (!is_open()) {
+      return;
+    }
+    if (m_use_o_direct && m_offset % s_block_size != 0) {
+      std::vector<char> padding(s_block_size - m_offset % s_block_size, 0);
+      if (m_data_writer.write(padding.data(), padding.size())) {
+        m_offset += padding.size();
+      }
+    }
+    m_data_writer.flush();
+    m_index_writer.flush();
+  }
+
+  void write_record(const std::vector<char>& record)
+  {
+    const auto* header = reinterpret_cast<const daqdataformats::FragmentHeader*>(record.data()); // NOLINT
+    TriggeredRecordIndexEntry entry;
+    entry.trigger_number = header->trigger_number;
+    entry.trigger_timestamp = header->trigger_timestamp;
+    entry.window_begin = header->window_begin;
+    entry.window_end = header->window_end;
+    entry.offset = m_offset;
+    entry.size = record.size();
+    entry.run_number = header->run_number;
+    entry.sequence_number = header->sequence_number;
+    entry.reserved = 0;
+    if (!m_data_writer.write(record.data(), record.size()) ||
+        !m_index_writer.write(reinterpret_cast<const char*>(&entry), sizeof(entry))) { // NOLINT
+      ++m_num_dropped;
+      return;
+    }
+    m_offset += record.size();
+    m_bytes_written += record.size();
+    ++m_num_recorded;
+  }
+
+  static constexpr size_t s_block_size = 4096;
+
+  daqdataformats::SourceID m_sourceid;
+  size_t m_max_queued_bytes = 67108864;
+  bool m_use_o_direct = false;
+
+  BufferedFileWriter<> m_data_writer;
+  BufferedFileWriter<> m_index_writer;
+  uint64_t m_offset = 0; // NOLINT(build/unsigned)
+
+  std::deque<std::vector<char>> m_pending;
+  size_t m_queued_bytes = 0; // of the windows queued or being copied, until written
+  size_t m_num_copying = 0;  // windows being copied into the queue
+  std::mutex m_mutex;
+  std::condition_variable m_not_empty;
+  bool m_quit = true; // not accepting windows
+  std::thread m_thread;
+
+  std::atomic<int> m_num_recorded{ 0 };
+  std::atomic<int> m_num_dropped{ 0 };
+  std::atomic<uint64_t> m_bytes_written{ 0 }; // NOLINT(build/unsigned)
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_TRIGGEREDRECORDER_HPP_
@@ -9,10 +9,17 @@
 #ifndef READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_DEFAULTREQUESTHANDLERMODEL_HPP_
 #define READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_DEFAULTREQUESTHANDLERMODEL_HPP_
 
+#include "readoutlibs/CompletenessIndex.hpp"
+#include "readoutlibs/FragmentSendStage.hpp"
 #include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/TriggeredRecorder.hpp"
 #include "readoutlibs/concepts/RequestHandlerConcept.hpp"
-#include "readoutlibs/utils/BufferedFileWriter.hpp"
+#include "readoutlibs/utils/DeadlineScheduler.hpp"
+#include "readoutlibs/utils/LatencyHistogram.hpp"
+#include "readoutlibs/utils/RecordingFileWriter.hpp"
+#include "readoutlibs/utils/RequestTrace.hpp"
 #include "readoutlibs/utils/ReusableThread.hpp"
+#include "readoutlibs/utils/TokenBucket.hpp"
 
 #include "readoutlibs/readoutconfig/Nljs.hpp"
 #include "readoutlibs/readoutinfo/InfoNljs.hpp"
@@ -37,9 +44,11 @@
 #include <functional>
 #include <future>
 #include <iomanip>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <string>
 #include <thread>
@@ -70,6 +79,26 @@ get_frame_iterator_timestamp(T iter)
   return iter->get_timestamp();
 }
 
+// Binary search for the first frame in [begin, end) whose timestamp is not
+// earlier than the given one. The frames must be ordered in time.
+template<class T>
+T
+find_first_frame(T begin, T end, uint64_t timestamp) // NOLINT(build/unsigned)
+{
+  auto count = std::distance(begin, end);
+  while (count > 0) {
+    auto step = count / 2;
+    auto iter = std::next(begin, step);
+    if (get_frame_iterator_timestamp(iter) < timestamp) {
+      begin = std::next(iter);
+      count -= step + 1;
+    } else {
+      count = step;
+    }
+  }
+  return begin;
+}
+
 template<class ReadoutType, class LatencyBufferType>
 class DefaultRequestHandlerModel : public RequestHandlerConcept<ReadoutType, LatencyBufferType>
 {
@@ -111,15 +140,25 @@ public:
   {
     RequestElement(const dfmessages::DataRequest& data_request,
                    const std::chrono::time_point<std::chrono::high_resolution_clock>& tp_value,
-                   bool partial_fragment_flag = false)
+                   bool partial_fragment_flag = false,
+                   int request_class_index = -1,
+                   const std::chrono::time_point<std::chrono::high_resolution_clock>& arrival = {})
       : request(data_request)
       , start_time(tp_value)
+      , arrival_time(arrival == decltype(arrival_time)() ? tp_value : arrival)
       , send_partial_fragment_if_available(partial_fragment_flag)
+      , request_class(request_class_index)
     {}
 
     dfmessages::DataRequest request;
     std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
+    std::chrono::time_point<std::chrono::high_resolution_clock> arrival_time; // when the request was first issued
     bool send_partial_fragment_if_available;
+    int request_class; // -1: classify by window size and destination
+    // Set if request is sub-window subfragment_index of this long window, streamed as sub-fragments
+    std::optional<dfmessages::DataRequest> stream;
+    std::chrono::time_point<std::chrono::high_resolution_clock> stream_begin; // when streaming it started
+    size_t subfragment_index = 0;
   };
 
   // Default init mechanism (no-op impl)
@@ -132,7 +171,7 @@ public:
   void scrap(const nlohmann::json& /*args*/) override;
 
   // Default start mechanism
-  void start(const nlohmann::json& /*args*/);
+  void start(const nlohmann::json& args);
 
   // Default stop mechanism
   void stop(const nlohmann::json& /*args*/);
@@ -147,6 +186,11 @@ public:
   void issue_request(dfmessages::DataRequest datarequest,
                      bool send_partial_fragment_if_available) override;
 
+  // Issue a request in an explicitly chosen request class (falls back to classification if the name is unknown)
+  void issue_request(dfmessages::DataRequest datarequest,
+                     bool send_partial_fragment_if_available,
+                     const std::string& request_class);
+
   // Opmon get_info implementation
   void get_info(opmonlib::InfoCollector& ci, int /*level*/) override;
 
@@ -154,6 +198,16 @@ public:
   virtual bool supports_cutoff_timestamp() {return false;}
   virtual void report_tardy_packet(const RDT& /*packet*/, int64_t /*tardy_ticks*/) {}  // NOLINT
 
+  // Whether the writer should report the elements it writes to the latency buffer
+  bool tracks_completeness() const { return m_track_completeness; }
+
+  // Called by the writer with the first timestamp of each element the latency buffer accepted, to keep track of
+  // missing data
+  void report_written_element(uint64_t first_timestamp) // NOLINT(build/unsigned)
+  {
+    m_completeness_index.add_element(first_timestamp, first_timestamp + m_element_span_ticks);
+  }
+
 protected:
   // An inline helper function that creates a fragment header based on a data request
   inline 
@@ -176,6 +230,17 @@ protected:
   // Helper function that creates and empty fragment.
   std::unique_ptr<daqdataformats::Fragment> create_empty_fragment(const dfmessages::DataRequest& dr);
 
+  // Log the throughput and write stall time of a finished recording, and keep them for get_info
+  void report_recording(size_t bytes_written,
+                        std::chrono::nanoseconds duration,
+                        std::chrono::nanoseconds write_stall_time);
+
+  // Refill the recording's token bucket, to be called when a recording starts
+  void start_recording_throttle();
+
+  // Call before writing bytes of a recording: waits to keep the configured rate, and backs off while requests are slow
+  void throttle_recording(size_t bytes);
+
   // An inline helper function that merges a set of byte arrays into a destination array
   inline 
   void dump_to_buffer(const void* data, std::size_t size,
@@ -194,6 +259,55 @@ protected:
     }
   }
 
+  // Post a request to the thread pool, or to the scheduler in the given class (-1: classify).
+  // Its deadline is the class budget after t_arrived, the first time the request was issued (default: now).
+  void schedule_request(dfmessages::DataRequest datarequest,
+                        bool send_partial_fragment_if_available,
+                        int request_class,
+                        std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived = {});
+
+  // Work done by a request handling thread for a single request
+  void handle_request(const dfmessages::DataRequest& datarequest,
+                      bool send_partial_fragment_if_available,
+                      int request_class,
+                      std::chrono::time_point<std::chrono::high_resolution_clock> t_issued,
+                      std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived);
+
+  // Account a response time, in us, to the request handling statistics
+  void record_response_time(int took);
+
+  // Send a fragment to the request's destination, directly or through the send stage.
+  // Returns false if the send stage dropped it; a failed direct send throws.
+  bool send_fragment(const dfmessages::DataRequest& datarequest, std::unique_ptr<daqdataformats::Fragment>&& fragment);
+
+  // Serve a long window as a sequence of sub-fragments, each sent as soon as its data is there, starting
+  // from sub-window first_subfragment. The first sub-window is sent partial if send_partial_first is set.
+  // A sub-window whose data is not there yet is parked, with the rest of the window, in the waiting queue.
+  // The response time counts from t_begin, when a handling thread first took the request.
+  void stream_request(const dfmessages::DataRequest& datarequest,
+                      bool send_partial_fragment_if_available,
+                      int request_class,
+                      std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived,
+                      std::chrono::time_point<std::chrono::high_resolution_clock> t_begin,
+                      size_t first_subfragment = 0,
+                      bool send_partial_first = false);
+
+  // Sub-window index of a long window: the index-th slice of m_subfragment_window_ticks, as its own request
+  dfmessages::DataRequest make_subrequest(const dfmessages::DataRequest& datarequest, size_t index) const;
+
+  // Re-issue a waiting request, in its original class
+  void reissue_request(const RequestElement& element, bool send_partial_fragment_if_available);
+
+  // When a request of the class, first issued at t_arrived, is due
+  DeadlineScheduler::clock_t::time_point
+  request_deadline(int request_class, std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived) const;
+
+  // Index of the first configured request class matching the request's window size and destination
+  size_t select_request_class(const dfmessages::DataRequest& datarequest) const;
+
+  // Add the percentiles of a latency histogram as a child of the collector
+  void add_latency_info(opmonlib::InfoCollector& ci, const std::string& name, LatencyHistogram& histogram);
+
   // Cleanup thread's work function. Runs the cleanup() routine
   void periodic_cleanups();
 
@@ -203,6 +317,16 @@ protected:
   // Function that checks delayed requests that are waiting for not yet present data in LB
   void check_waiting_requests();
 
+  // Copy the request's window, padded at the given ends, to the triggered recording queue. Call with cleanups held
+  // off, as the window is read from LB.
+  void record_window(const dfmessages::DataRequest& datarequest, bool pad_begin, bool pad_end);
+
+  // Gather the pieces of the elements overlapping [start_win_ts, end_win_ts) from LB, without touching the
+  // request statistics. Returns false if the start of the window could not be located.
+  bool collect_fragment_pieces(uint64_t start_win_ts, // NOLINT(build/unsigned)
+                               uint64_t end_win_ts,   // NOLINT(build/unsigned)
+                               std::vector<std::pair<void*, size_t>>& frag_pieces);
+
   // Function that gathers fragment pieces from LB
   std::vector<std::pair<void*, size_t>> get_fragment_pieces(uint64_t start_win_ts,
                                                             uint64_t end_win_ts,
@@ -216,7 +340,7 @@ protected:
   std::unique_ptr<LatencyBufferType>& m_latency_buffer;
 
   // Data recording
-  BufferedFileWriter<> m_buffered_writer;
+  RecordingFileWriter m_recording_writer;
   ReusableThread m_recording_thread;
 
   ReusableThread m_cleanup_thread;
@@ -237,8 +361,32 @@ protected:
   std::unique_ptr<boost::asio::thread_pool> m_request_handler_thread_pool;
   size_t m_num_request_handling_threads = 0;
 
+  // Request classes with dedicated threads and deadline ordering, used instead of the pool when configured
+  readoutconfig::RequestClasses m_request_classes;
+  std::vector<std::chrono::milliseconds> m_request_class_budgets; // time from arrival to deadline, per class
+  DeadlineScheduler m_request_scheduler;
+
+  // Asynchronous fragment sending, decoupled from the extractor threads
+  FragmentSendStage m_fragment_send_stage;
+  bool m_async_fragment_send = false;
+
+  // Sub-fragment streaming of long windows (0: disabled)
+  uint64_t m_subfragment_window_ticks = 0; // NOLINT(build/unsigned)
+
   // Error registry
   std::unique_ptr<FrameErrorRegistry>& m_error_registry;
+
+  // Missing data in the latency buffer
+  CompletenessIndex m_completeness_index;
+  bool m_track_completeness = false;
+  uint64_t m_element_span_ticks = 0; // NOLINT(build/unsigned) ticks covered by one latency buffer element
+
+  // Trace of incoming requests, for offline replay
+  RequestTraceWriter m_request_trace;
+
+  // Local copy of the served windows
+  TriggeredRecorder m_triggered_recorder;
+  uint64_t m_triggered_recording_padding = 0; // NOLINT(build/unsigned)
   std::chrono::time_point<std::chrono::high_resolution_clock> m_t0;
 
   // The run marker
@@ -274,11 +422,35 @@ protected:
   std::atomic<int> m_num_requests_delayed{ 0 };
   std::atomic<int> m_num_requests_uncategorized{ 0 };
   std::atomic<int> m_num_requests_timed_out{ 0 };
+  std::atomic<int> m_num_requests_with_gaps{ 0 };
   std::atomic<int> m_handled_requests{ 0 };
   std::atomic<int> m_response_time_acc{ 0 };
   std::atomic<int> m_response_time_min{ std::numeric_limits<int>::max() };
   std::atomic<int> m_response_time_max{ 0 };
   std::atomic<int> m_payloads_written{ 0 };
+  // Of the last finished recording
+  std::atomic<uint64_t> m_last_recording_bytes{ 0 };       // NOLINT(build/unsigned)
+  std::atomic<double> m_last_recording_throughput{ 0 };    // MB/s
+  std::atomic<uint64_t> m_last_recording_stall_time{ 0 };  // NOLINT(build/unsigned) us
+  // Recording throttling
+  TokenBucket m_recording_bucket;
+  double m_recording_max_rate = 0; // bytes/s
+  double m_recording_burst_size = 0;
+  int m_recording_backoff_response_time = 0; // us
+  std::chrono::milliseconds m_recording_backoff_time{ 0 };
+  std::chrono::steady_clock::time_point m_last_backoff_check;
+  std::atomic<int> m_recent_response_time_max{ 0 }; // since the last back-off check
+  std::atomic<uint64_t> m_num_recording_throttles{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_num_recording_backoffs{ 0 };  // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_recording_throttle_time{ 0 }; // NOLINT(build/unsigned) us
+  std::atomic<int> m_num_subfragments_sent{ 0 };
+  std::atomic<int> m_num_fragments_send_dropped{ 0 };
+  // Latency distributions (in us) of the request handling stages
+  LatencyHistogram m_queue_wait_latency;
+  LatencyHistogram m_lookup_latency;
+  LatencyHistogram m_copy_latency;
+  LatencyHistogram m_send_latency;
+  LatencyHistogram m_response_latency;
   // std::atomic<int> m_avg_req_count{ 0 }; // for opmon, later
   // std::atomic<int> m_avg_resp_time{ 0 };
   // Request response time log (kept for debugging if needed)
@@ -0,0 +1,216 @@
+/**
+ * @file MultiLinkRequestHandlerModel.hpp Request handling shared by a group
+ * of links, answering each request with one fragment for the whole group
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_MULTILINKREQUESTHANDLERMODEL_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_MULTILINKREQUESTHANDLERMODEL_HPP_
+
+#include "readoutlibs/FragmentSendStage.hpp"
+#include "readoutlibs/models/DefaultRequestHandlerModel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Request handler for links whose requests are served together. Every link keeps its own ReadoutModel, latency
+ * buffer and instance of this model; the instances configured with the same link_group join one group per process.
+ * The group has a single request handling thread pool, cleanup thread, waiting-request thread and fragment send
+ * stage, so their number does not grow with the links per host.
+ *
+ * A request issued to any link of the group is looked up in all latency buffers in parallel, and answered with one
+ * fragment carrying the requested source id. Its payload is a section per link, in the order of their source ids:
+ * the fragment of the link, header included, so each section tells its source id, error bits and size. Requests
+ * are thus meant to be addressed to one link of the group only. When some links do not have the data yet, only
+ * those are looked up again once it arrived, or partially after request_timeout_ms.
+ *
+ * Without link_group, the model behaves as the DefaultRequestHandlerModel. In a group, streaming of long windows,
+ * request classes and triggered recording are not available; raw recording stays per link.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class MultiLinkRequestHandlerModel : public DefaultRequestHandlerModel<ReadoutType, LatencyBufferType>
+{
+public:
+  // Using inherited typename
+  using inherited = DefaultRequestHandlerModel<ReadoutType, LatencyBufferType>;
+
+  // Explicit constructor for binding LB and error registry
+  explicit MultiLinkRequestHandlerModel(std::unique_ptr<LatencyBufferType>& latency_buffer,
+                                        std::unique_ptr<FrameErrorRegistry>& error_registry)
+    : DefaultRequestHandlerModel<ReadoutType, LatencyBufferType>(latency_buffer, error_registry)
+  {
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "MultiLinkRequestHandlerModel created...";
+  }
+
+  ~MultiLinkRequestHandlerModel() { leave_group(); }
+
+  // Joins the link group, if one is configured
+  void conf(const nlohmann::json& args) override;
+
+  // Leaves the link group
+  void scrap(const nlohmann::json& args) override;
+
+  // In a group, the group's threads start with its first link
+  void start(const nlohmann::json& args) override;
+
+  // In a group, the group's threads stop with its last link
+  void stop(const nlohmann::json& args) override;
+
+  // In a group, the request is served for all links of the group
+  void issue_request(dfmessages::DataRequest datarequest, bool send_partial_fragment_if_available) override;
+
+  // Per-link statistics. The first link of a group also reports the group's, as a child named link_group.
+  void get_info(opmonlib::InfoCollector& ci, int level) override;
+
+  // Replace how the group looks up fragment senders, by default from the IOManager. Call after conf(), before start().
+  void set_sender_factory(FragmentSendStage::sender_factory_t factory);
+
+private:
+  class LinkGroup;
+
+  // Extract the request's data from the latency buffer of the link, holding off its cleanups meanwhile. Returns
+  // nothing, and sets not_yet, if the data is not there yet.
+  std::unique_ptr<daqdataformats::Fragment> extract(const dfmessages::DataRequest& datarequest,
+                                                    bool send_partial_fragment_if_available,
+                                                    bool& not_yet);
+
+  // Timestamp of the newest element in the latency buffer (0 if empty)
+  uint64_t newest_timestamp(); // NOLINT(build/unsigned)
+
+  void leave_group();
+
+  std::shared_ptr<LinkGroup> m_group;
+};
+
+/**
+ * The state shared by the links of a group. Links join when configured and leave when scrapped, outside of runs:
+ * the links of the group are fixed from the start of its first link to the stop of its last one.
+ */
+template<class ReadoutType, class LatencyBufferType>
+class MultiLinkRequestHandlerModel<ReadoutType, LatencyBufferType>::LinkGroup
+{
+public:
+  using link_t = MultiLinkRequestHandlerModel<ReadoutType, LatencyBufferType>;
+
+  // The group of that name in this process, created when its first link joins
+  static std::shared_ptr<LinkGroup> get(const std::string& name);
+
+  explicit LinkGroup(const std::string& name)
+    : m_name(name)
+    , m_cleanup_thread(0)
+  {}
+
+  LinkGroup(const LinkGroup&) = delete;            ///< LinkGroup is not copy-constructible
+  LinkGroup& operator=(const LinkGroup&) = delete; ///< LinkGroup is not copy-assginable
+  LinkGroup(LinkGroup&&) = delete;                 ///< LinkGroup is not move-constructible
+  LinkGroup& operator=(LinkGroup&&) = delete;      ///< LinkGroup is not move-assignable
+
+  // The first link to join configures the group's threads and sending
+  void add_link(link_t* link, const readoutconfig::RequestHandlerConf& conf);
+  void remove_link(link_t* link);
+
+  bool is_first_link(const link_t* link);
+
+  void start();
+  void stop();
+
+  void issue_request(const dfmessages::DataRequest& datarequest, bool send_partial_fragment_if_available);
+
+  void set_sender_factory(FragmentSendStage::sender_factory_t factory)
+  {
+    m_fragment_send_stage.set_sender_factory(std::move(factory));
+  }
+
+  void get_info(opmonlib::InfoCollector& ci, int level);
+
+private:
+  // A request being served: a section slot per link, filled in parallel
+  struct PendingRequest
+  {
+    PendingRequest(const dfmessages::DataRequest& dr, bool partial, size_t num_links)
+      : request(dr)
+      , send_partial_fragment_if_available(partial)
+      , sections(num_links)
+      , not_yet(num_links, 1)
+    {}
+
+    dfmessages::DataRequest request;
+    bool send_partial_fragment_if_available;
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_begin = std::chrono::high_resolution_clock::now();
+    std::chrono::time_point<std::chrono::high_resolution_clock> t_waiting; // since when it waits for data
+    std::vector<std::unique_ptr<daqdataformats::Fragment>> sections;
+    std::vector<char> not_yet; // per link: the data is not there yet, the link is to be looked up (again)
+    std::atomic<size_t> links_remaining{ 0 };
+  };
+
+  // Look up the request in the links that do not have its data yet, in parallel
+  void extract_missing(std::shared_ptr<PendingRequest> pending, bool send_partial_fragment_if_available);
+
+  // Called by the thread that filled the last section slot
+  void complete_request(std::shared_ptr<PendingRequest> pending);
+
+  void periodic_cleanups();
+
+  void check_waiting_requests();
+
+  std::string m_name;
+
+  // Links, in the order of their source ids
+  std::vector<link_t*> m_links;
+  std::mutex m_links_mutex;
+  std::vector<link_t*> m_run_links; // as of the start of the group
+  size_t m_num_running_links = 0;
+  std::mutex m_run_mutex;
+
+  // Shared threads and sending
+  std::unique_ptr<boost::asio::thread_pool> m_request_handler_thread_pool;
+  ReusableThread m_cleanup_thread;
+  std::thread m_waiting_queue_thread;
+  FragmentSendStage m_fragment_send_stage;
+  std::atomic<bool> m_run_marker = false;
+
+  // Requests waiting for data in at least one link
+  std::vector<std::shared_ptr<PendingRequest>> m_waiting_requests;
+  std::mutex m_waiting_requests_lock;
+  std::atomic<int> m_num_requests_in_flight{ 0 }; // issued, and not sent yet
+
+  // Configuration
+  daqdataformats::SourceID m_sourceid;
+  size_t m_num_request_handling_threads = 0;
+  int m_request_timeout_ms = 1000;
+  bool m_warn_on_timeout = true;
+
+  // Stats
+  std::atomic<int> m_handled_requests{ 0 };
+  std::atomic<int> m_num_requests_delayed{ 0 };
+  std::atomic<int> m_num_requests_timed_out{ 0 };
+  std::atomic<int> m_num_fragments_send_dropped{ 0 };
+  std::atomic<int> m_response_time_acc{ 0 };
+  std::atomic<int> m_response_time_max{ 0 };
+  std::atomic<int> m_response_time_min{ std::numeric_limits<int>::max() };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+// Declarations
+#include "detail/MultiLinkRequestHandlerModel.hxx"
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_MULTILINKREQUESTHANDLERMODEL_HPP_
@@ -172,7 +172,13 @@ private:
 
   // REQUEST RECEIVERS
   using request_receiver_ct = iomanager::ReceiverConcept<dfmessages::DataRequest>;
-  std::shared_ptr<request_receiver_ct> m_data_request_receiver;
+  struct RequestReceiver
+  {
+    std::string name;
+    std::shared_ptr<request_receiver_ct> receiver;
+    std::atomic<int> num_requests{ 0 };
+  };
+  std::vector<std::unique_ptr<RequestReceiver>> m_data_request_receivers;
 
   // FRAGMENT SENDER
   //std::chrono::milliseconds m_fragment_sender_timeout_ms;
@@ -195,6 +201,7 @@ private:
   // REQUEST HANDLER
   std::unique_ptr<RequestHandlerType> m_request_handler_impl;
   bool m_request_handler_supports_cutoff_timestamp;
+  bool m_request_handler_tracks_completeness = false;
 
   // ERROR REGISTRY
   std::unique_ptr<FrameErrorRegistry> m_error_registry;
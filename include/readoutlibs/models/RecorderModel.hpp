@@ -17,14 +17,18 @@
 #include "readoutlibs/recorderconfig/Nljs.hpp"
 #include "readoutlibs/recorderconfig/Structs.hpp"
 #include "readoutlibs/recorderinfo/InfoStructs.hpp"
-#include "readoutlibs/utils/BufferedFileWriter.hpp"
+#include "readoutlibs/utils/RecordingFileWriter.hpp"
 #include "readoutlibs/utils/ReusableThread.hpp"
 
+#include <boost/align/aligned_allocator.hpp>
+
 #include <atomic>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <string>
+#include <vector>
 
 namespace dunedaq {
 namespace readoutlibs {
@@ -41,21 +45,32 @@ public:
   void init(const nlohmann::json& args) override;
   void get_info(opmonlib::InfoCollector& ci, int /* level */) override;
   void do_conf(const nlohmann::json& args) override;
-  void do_scrap(const nlohmann::json& /*args*/) override { m_buffered_writer.close(); }
-  void do_start(const nlohmann::json& /* args */) override;
+  void do_scrap(const nlohmann::json& /*args*/) override { m_recording_writer.close(); }
+  void do_start(const nlohmann::json& args) override;
   void do_stop(const nlohmann::json& /* args */) override;
 
 private:
   // The work that the worker thread does
   void do_work();
 
+  // Write the staged elements at once
+  bool write_batch();
+
+  // Size of the blocks the staging buffer is made of
+  static constexpr size_t s_block_size = 4096;
+
   // Queue
   using source_t = dunedaq::iomanager::ReceiverConcept<ReadoutType>;
   std::shared_ptr<source_t> m_data_receiver;
 
   // Internal
   recorderconfig::Conf m_conf;
-  BufferedFileWriter<> m_buffered_writer;
+  RecordingFileWriter m_recording_writer;
+  // Staging buffer of whole aligned blocks, elements are written from it at once. With the direct backend, full
+  // batches are written to the file straight from it.
+  std::vector<ReadoutType, boost::alignment::aligned_allocator<ReadoutType, s_block_size>> m_batch;
+  size_t m_batch_fill = 0;
+  std::chrono::milliseconds m_receive_timeout{ 100 };
 
   // Threading
   ReusableThread m_work_thread;
@@ -64,6 +79,8 @@ private:
   // Stats
   std::atomic<int> m_packets_processed_total{ 0 };
   std::atomic<int> m_packets_processed_since_last_info{ 0 };
+  std::atomic<uint64_t> m_bytes_recorded_since_last_info{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<int> m_batches_since_last_info{ 0 };
   std::chrono::steady_clock::time_point m_time_point_last_info;
 
   std::string m_name;
@@ -11,7 +11,17 @@
 #define READOUTLIBS_INCLUDE_READOUTLIBS_MODELS_ZEROCOPYRECORDINGREQUESTHANDLERMODEL_HPP_
 
 #include "readoutlibs/models/DefaultRequestHandlerModel.hpp"
+#include "readoutlibs/utils/FileWriteQueue.hpp"
+#include "readoutlibs/utils/RecordingFormat.hpp"
+#include "readoutlibs/utils/StripeManifest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace dunedaq {
 namespace readoutlibs {
@@ -38,8 +48,58 @@ public:
   void record(const nlohmann::json& args) override;
 
 private:
+  // Size of the blocks that O_DIRECT writes are made of
+  static constexpr size_t s_block_size = 4096;
+
+  // Write a piece of the latency buffer to the file. In the indexed format, it goes in a data record with an aligned
+  // header block and is padded to the alignment.
+  bool write_chunk(const char* chunk, size_t size);
+
+  // Complete the index of an indexed recording
+  bool finish_index();
+
+  bool write_out(const char* data, size_t size);
+
+  // Write whole blocks to the stripes, round-robin in units of the stripe size, from one thread per stripe
+  bool write_stripes(const char* data, size_t size);
+
+  // Wait for the queued stripe writes
+  bool wait_stripes();
+
+  // Start of the oldest piece of the latency buffer that a queued stripe write may still read, or write_pointer if
+  // there is none. The recording lease must not move past it.
+  const char* oldest_unwritten(const char* write_pointer);
+
   int m_fd;
   int m_oflag;
+
+  // Indexed recording format
+  bool m_indexed = false;
+  size_t m_index_interval = 64;
+  uint64_t m_clock_frequency_hz = 0; // NOLINT(build/unsigned)
+  recording::IndexBuilder m_index{ s_block_size };
+
+  // Aligned staging for record headers and the partial block at the end of a recording
+  recording::aligned_buffer_t m_bounce_buffer;
+  uint64_t m_file_offset = 0; // NOLINT(build/unsigned)
+  std::chrono::nanoseconds m_write_stall_time{ 0 };
+
+  // Striped recording, if stripe directories are configured
+  std::vector<int> m_stripe_fds;
+  std::vector<std::unique_ptr<FileWriteQueue>> m_stripe_queues;
+  std::vector<uint64_t> m_stripe_bytes; // NOLINT(build/unsigned)
+  size_t m_stripe_size = 0;
+  size_t m_current_stripe = 0;
+  size_t m_current_stripe_fill = 0;
+
+  // Stripe writes in submission order, until they are done
+  struct QueuedWrite
+  {
+    size_t stripe;
+    uint64_t sequence; // NOLINT(build/unsigned)
+    const char* data;
+  };
+  std::deque<QueuedWrite> m_queued_writes;
 };
 
 } // namespace readoutlibs
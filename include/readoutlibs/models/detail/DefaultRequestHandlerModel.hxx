@@ -21,6 +21,32 @@ DefaultRequestHandlerModel<RDT, LBT>::conf(const nlohmann::json& args)
   m_stream_buffer_size = conf.stream_buffer_size;
   m_warn_on_timeout = conf.warn_on_timeout;
   m_warn_about_empty_buffer = conf.warn_about_empty_buffer;
+  m_async_fragment_send = conf.async_fragment_send;
+  m_track_completeness = conf.track_completeness;
+  {
+    RDT element;
+    m_element_span_ticks = element.get_num_frames() * RDT::expected_tick_difference;
+  }
+  m_fragment_send_stage.conf(m_sourceid,
+                             conf.fragment_send_queue_size,
+                             conf.fragment_send_batch_size,
+                             conf.fragment_queue_timeout_ms,
+                             m_fragment_send_timeout_ms);
+  m_subfragment_window_ticks = 0;
+  if (conf.max_fragment_size > 0) {
+    // Sub-windows hold a whole number of elements fitting in the size bound (at least one)
+    RDT element;
+    uint64_t elements = std::max<uint64_t>(conf.max_fragment_size / element.get_payload_size(), 1); // NOLINT(build/unsigned)
+    m_subfragment_window_ticks = elements * element.get_num_frames() * RDT::expected_tick_difference;
+  }
+  m_request_classes = conf.request_classes;
+  std::vector<DeadlineScheduler::ClassConfig> scheduler_classes;
+  m_request_class_budgets.clear();
+  for (const auto& rc : m_request_classes) {
+    scheduler_classes.push_back({ rc.name, static_cast<size_t>(std::max(rc.num_threads, 1)) });
+    m_request_class_budgets.emplace_back(rc.deadline_ms > 0 ? rc.deadline_ms : conf.request_timeout_ms);
+  }
+  m_request_scheduler.conf(scheduler_classes, "reqsched", conf.source_id);
   // if (m_configured) {
   //  ers::error(ConfigurationError(ERS_HERE, "This object is already configured!"));
   if (m_pop_limit_pct < 0.0f || m_pop_limit_pct > 1.0f || m_pop_size_pct < 0.0f || m_pop_size_pct > 1.0f) {
@@ -36,10 +62,48 @@ DefaultRequestHandlerModel<RDT, LBT>::conf(const nlohmann::json& args)
       TLOG(TLVL_WORK_STEPS) << "Removed existing output file from previous run: " << conf.output_file << std::endl;
     }
 
-    m_buffered_writer.open(conf.output_file, conf.stream_buffer_size, conf.compression_algorithm, conf.use_o_direct);
+    BufferedFileWriterOptions writer_options;
+    writer_options.buffer_size = conf.stream_buffer_size;
+    writer_options.compression_algorithm = conf.compression_algorithm;
+    writer_options.use_o_direct = conf.use_o_direct;
+    writer_options.io_backend = conf.io_backend;
+    writer_options.io_queue_depth = conf.io_queue_depth;
+    writer_options.compression_threads = conf.compression_threads;
+    writer_options.compression_level = conf.compression_level;
+    writer_options.compression_dictionary = conf.compression_dictionary;
+    RecordingFileOptions recording_options;
+    recording_options.format = conf.recording_format;
+    recording_options.subsystem = static_cast<uint32_t>(m_sourceid.subsystem); // NOLINT(build/unsigned)
+    recording_options.source_id = m_sourceid.id;
+    recording_options.element_size = RDT().get_payload_size();
+    recording_options.clock_frequency_hz = conf.recording_clock_frequency;
+    recording_options.index_interval = conf.recording_index_interval;
+    recording_options.stripe_directories = conf.stripe_directories;
+    recording_options.stripe_size = conf.stripe_size;
+    recording_options.segment_size = conf.segment_size;
+    m_recording_writer.open(conf.output_file, writer_options, recording_options);
     m_recording_configured = true;
   }
 
+  m_recording_max_rate = conf.recording_max_rate * 1e6;
+  m_recording_burst_size = conf.recording_burst_size;
+  m_recording_backoff_response_time = conf.recording_backoff_response_time;
+  m_recording_backoff_time = std::chrono::milliseconds(conf.recording_backoff_time);
+
+  m_triggered_recording_padding = conf.triggered_recording_padding;
+  if (!conf.triggered_recording_file.empty()) {
+    m_triggered_recorder.conf(m_sourceid,
+                              conf.triggered_recording_file,
+                              conf.stream_buffer_size,
+                              conf.use_o_direct,
+                              conf.triggered_recording_queue_bytes);
+  }
+
+  if (!conf.request_trace_file.empty()) {
+    m_request_trace.open(conf.request_trace_file);
+    TLOG(TLVL_WORK_STEPS) << "Tracing data requests to " << conf.request_trace_file;
+  }
+
   m_recording_thread.set_name("recording", conf.source_id);
   m_cleanup_thread.set_name("cleanup", conf.source_id);
 
@@ -55,14 +119,16 @@ template<class RDT, class LBT>
 void 
 DefaultRequestHandlerModel<RDT, LBT>::scrap(const nlohmann::json& /*args*/)
 {
-  if (m_buffered_writer.is_open()) {
-    m_buffered_writer.close();
+  if (m_recording_writer.is_open()) {
+    m_recording_writer.close();
   }
+  m_request_trace.close();
+  m_triggered_recorder.close();
 }
 
 template<class RDT, class LBT>
 void 
-DefaultRequestHandlerModel<RDT, LBT>::start(const nlohmann::json& /*args*/)
+DefaultRequestHandlerModel<RDT, LBT>::start(const nlohmann::json& args)
 {
   // Reset opmon variables
   m_num_requests_found = 0;
@@ -72,15 +138,28 @@ DefaultRequestHandlerModel<RDT, LBT>::start(const nlohmann::json& /*args*/)
   m_num_requests_uncategorized = 0;
   m_num_buffer_cleanups = 0;
   m_num_requests_timed_out = 0;
+  m_num_requests_with_gaps = 0;
   m_handled_requests = 0;
   m_response_time_acc = 0;
   m_pop_reqs = 0;
   m_pops_count = 0;
   m_payloads_written = 0;
+  m_num_subfragments_sent = 0;
+  m_num_fragments_send_dropped = 0;
 
   m_t0 = std::chrono::high_resolution_clock::now();
+  m_completeness_index.reset();
 
-  m_request_handler_thread_pool = std::make_unique<boost::asio::thread_pool>(m_num_request_handling_threads);
+  if (m_request_classes.empty()) {
+    m_request_handler_thread_pool = std::make_unique<boost::asio::thread_pool>(m_num_request_handling_threads);
+  } else {
+    m_request_scheduler.start();
+  }
+  if (m_async_fragment_send) {
+    m_fragment_send_stage.start();
+  }
+  m_triggered_recorder.start();
+  m_recording_writer.set_run_number(args.value<dunedaq::daqdataformats::run_number_t>("run", 1));
 
   m_run_marker.store(true);
   m_cleanup_thread.set_work(&DefaultRequestHandlerModel<RDT, LBT>::periodic_cleanups, this);
@@ -101,7 +180,14 @@ DefaultRequestHandlerModel<RDT, LBT>::stop(const nlohmann::json& /*args*/)
     std::this_thread::sleep_for(std::chrono::milliseconds(10));
   }
   m_waiting_queue_thread.join();
-  m_request_handler_thread_pool->join();
+  if (m_request_classes.empty()) {
+    m_request_handler_thread_pool->join();
+  } else {
+    m_request_scheduler.stop();
+  }
+  // Extractors are done: drain what is still queued for sending
+  m_fragment_send_stage.stop();
+  m_triggered_recorder.stop();
 }
 
 template<class RDT, class LBT>
@@ -112,22 +198,44 @@ DefaultRequestHandlerModel<RDT, LBT>::record(const nlohmann::json& args)
   if (m_recording.load()) {
     ers::error(CommandError(ERS_HERE, m_sourceid, "A recording is still running, no new recording was started!"));
     return;
-  } else if (!m_buffered_writer.is_open()) {
+  } else if (!m_recording_writer.is_open()) {
     ers::error(CommandError(ERS_HERE, m_sourceid, "DLH is not configured for recording"));
     return;
+  } else if (conf.end_timestamp != 0 && conf.end_timestamp <= conf.start_timestamp) {
+    ers::error(CommandError(ERS_HERE, m_sourceid, "Empty timestamp range, no recording was started!"));
+    return;
   }
+  // From here on, cleanups keep the elements from the start of the recording in the latency buffer (0 keeps all)
+  m_next_timestamp_to_record = conf.start_timestamp;
   m_recording_thread.set_work(
-    [&](int duration) {
-      TLOG() << "Start recording for " << duration << " second(s)" << std::endl;
+    [&](readoutconfig::RecordingParams params) {
+      if (params.end_timestamp != 0) {
+        TLOG() << "Start recording timestamps " << params.start_timestamp << " to " << params.end_timestamp;
+      } else {
+        TLOG() << "Start recording for " << params.duration << " second(s)" << std::endl;
+      }
       m_recording.exchange(true);
+      start_recording_throttle();
       auto start_of_recording = std::chrono::high_resolution_clock::now();
       auto current_time = start_of_recording;
-      m_next_timestamp_to_record = 0;
-      RDT element_to_search;
-      while (std::chrono::duration_cast<std::chrono::seconds>(current_time - start_of_recording).count() < duration) {
+      auto front = m_latency_buffer->front();
+      if (front != nullptr && front->get_first_timestamp() > params.start_timestamp && params.start_timestamp != 0) {
+        TLOG() << "Data before timestamp " << front->get_first_timestamp() << " is no longer buffered";
+      }
+      size_t bytes_written = 0;
+      std::chrono::nanoseconds write_stall_time(0);
+      RDT element_to_search = RDT();
+      auto recording_done = [&] {
+        if (params.end_timestamp != 0) {
+          return m_next_timestamp_to_record >= params.end_timestamp || !m_run_marker;
+        }
+        return std::chrono::duration_cast<std::chrono::seconds>(current_time - start_of_recording).count() >=
+               params.duration;
+      };
+      while (!recording_done()) {
         if (!m_cleanup_requested || (m_next_timestamp_to_record == 0)) {
           if (m_next_timestamp_to_record == 0) {
-            auto front = m_latency_buffer->front();
+            front = m_latency_buffer->front();
             m_next_timestamp_to_record = front == nullptr ? 0 : front->get_first_timestamp();
           }
           element_to_search.set_first_timestamp(m_next_timestamp_to_record);
@@ -148,11 +256,22 @@ DefaultRequestHandlerModel<RDT, LBT>::record(const nlohmann::json& args)
           m_cv.notify_all();
 
           for (; chunk_iter != end && chunk_iter.good() && processed_chunks_in_loop < 1000;) {
+            if (params.end_timestamp != 0 && (*chunk_iter).get_first_timestamp() >= params.end_timestamp) {
+              m_next_timestamp_to_record = params.end_timestamp;
+              break;
+            }
             if ((*chunk_iter).get_first_timestamp() >= m_next_timestamp_to_record) {
-              if (!m_buffered_writer.write(reinterpret_cast<char*>(chunk_iter->begin()), // NOLINT
-                                           chunk_iter->get_payload_size())) {
+              throttle_recording(chunk_iter->get_payload_size());
+              auto write_start = std::chrono::steady_clock::now();
+              if (!m_recording_writer.write(reinterpret_cast<char*>(chunk_iter->begin()), // NOLINT
+                                            chunk_iter->get_payload_size(),
+                                            chunk_iter->get_first_timestamp(),
+                                            chunk_iter->get_first_timestamp())) {
                 ers::warning(CannotWriteToFile(ERS_HERE, m_output_file));
+              } else {
+                bytes_written += chunk_iter->get_payload_size();
               }
+              write_stall_time += std::chrono::steady_clock::now() - write_start;
               m_payloads_written++;
               processed_chunks_in_loop++;
               m_next_timestamp_to_record = (*chunk_iter).get_first_timestamp() +
@@ -160,16 +279,71 @@ DefaultRequestHandlerModel<RDT, LBT>::record(const nlohmann::json& args)
             }
             ++chunk_iter;
           }
+          if (processed_chunks_in_loop == 0) {
+            // Caught up with the incoming data
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
         }
         current_time = std::chrono::high_resolution_clock::now();
       }
       m_next_timestamp_to_record = std::numeric_limits<uint64_t>::max(); // NOLINT (build/unsigned)
 
-      TLOG() << "Stop recording" << std::endl;
+      auto flush_start = std::chrono::steady_clock::now();
+      m_recording_writer.flush();
+      write_stall_time += std::chrono::steady_clock::now() - flush_start;
+      report_recording(bytes_written, std::chrono::high_resolution_clock::now() - start_of_recording, write_stall_time);
       m_recording.exchange(false);
-      m_buffered_writer.flush();
     },
-    conf.duration);
+    conf);
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::report_recording(size_t bytes_written,
+                                                       std::chrono::nanoseconds duration,
+                                                       std::chrono::nanoseconds write_stall_time)
+{
+  double seconds = std::chrono::duration<double>(duration).count();
+  double throughput = seconds > 0 ? bytes_written / seconds / 1e6 : 0;
+  auto stall_us = std::chrono::duration_cast<std::chrono::microseconds>(write_stall_time).count();
+  TLOG() << "Stopped recording, wrote " << bytes_written << " bytes in " << seconds << " s (" << throughput
+         << " MB/s), " << stall_us << " us of it blocked in writes";
+  m_last_recording_bytes = bytes_written;
+  m_last_recording_throughput = throughput;
+  m_last_recording_stall_time = stall_us;
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::start_recording_throttle()
+{
+  m_recording_bucket.configure(m_recording_max_rate, m_recording_burst_size);
+  m_last_backoff_check = std::chrono::steady_clock::now();
+  m_recent_response_time_max = 0;
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::throttle_recording(size_t bytes)
+{
+  auto throttled = m_recording_bucket.acquire(bytes);
+  if (throttled.count() > 0) {
+    m_num_recording_throttles++;
+  }
+  // Buffer occupancy is not used as a signal: the recording holds back cleanups, so slowing it down would only
+  // fill the buffer further
+  if (m_recording_backoff_response_time > 0) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_backoff_check >= std::chrono::milliseconds(10)) {
+      m_last_backoff_check = now;
+      if (m_recent_response_time_max.exchange(0) > m_recording_backoff_response_time) {
+        m_num_recording_backoffs++;
+        std::this_thread::sleep_for(m_recording_backoff_time);
+        throttled += m_recording_backoff_time;
+      }
+    }
+  }
+  m_recording_throttle_time += std::chrono::duration_cast<std::chrono::microseconds>(throttled).count();
 }
 
 template<class RDT, class LBT>
@@ -190,63 +364,291 @@ void
 DefaultRequestHandlerModel<RDT, LBT>::issue_request(dfmessages::DataRequest datarequest,
                                                     bool send_partial_fragment_if_available)
 {
-  boost::asio::post(*m_request_handler_thread_pool, [&, send_partial_fragment_if_available, datarequest]() { // start a thread from pool
-    auto t_req_begin = std::chrono::high_resolution_clock::now();
+  schedule_request(datarequest, send_partial_fragment_if_available, -1);
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::issue_request(dfmessages::DataRequest datarequest,
+                                                    bool send_partial_fragment_if_available,
+                                                    const std::string& request_class)
+{
+  int class_index = -1;
+  for (size_t i = 0; i < m_request_classes.size(); ++i) {
+    if (m_request_classes[i].name == request_class) {
+      class_index = i;
+      break;
+    }
+  }
+  schedule_request(datarequest, send_partial_fragment_if_available, class_index);
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::schedule_request(dfmessages::DataRequest datarequest,
+                                                       bool send_partial_fragment_if_available,
+                                                       int request_class,
+                                                       std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived)
+{
+  auto t_issued = std::chrono::high_resolution_clock::now();
+  if (t_arrived == decltype(t_arrived)()) {
+    t_arrived = t_issued;
+  }
+  // Only trace requests as they arrive, not their re-issues from the waiting queue
+  if (m_request_trace.is_open() && std::this_thread::get_id() != m_waiting_queue_thread.get_id()) {
+    m_request_trace.trace(datarequest, send_partial_fragment_if_available);
+  }
+  if (m_request_classes.empty()) {
+    boost::asio::post(*m_request_handler_thread_pool, [&, send_partial_fragment_if_available, datarequest, t_issued, t_arrived]() { // start a thread from pool
+      handle_request(datarequest, send_partial_fragment_if_available, -1, t_issued, t_arrived);
+    });
+    return;
+  }
+  if (request_class < 0) {
+    request_class = select_request_class(datarequest);
+  }
+  m_request_scheduler.post(request_class, request_deadline(request_class, t_arrived), [&, send_partial_fragment_if_available, datarequest, request_class, t_issued, t_arrived]() {
+    handle_request(datarequest, send_partial_fragment_if_available, request_class, t_issued, t_arrived);
+  });
+}
+
+template<class RDT, class LBT>
+DeadlineScheduler::clock_t::time_point
+DefaultRequestHandlerModel<RDT, LBT>::request_deadline(
+  int request_class,
+  std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived) const
+{
+  // Requests are due one class budget after they first arrived, also when re-issued from the waiting queue
+  return DeadlineScheduler::clock_t::now() -
+         std::chrono::duration_cast<DeadlineScheduler::clock_t::duration>(std::chrono::high_resolution_clock::now() -
+                                                                           t_arrived) +
+         m_request_class_budgets[request_class];
+}
+
+template<class RDT, class LBT>
+bool
+DefaultRequestHandlerModel<RDT, LBT>::send_fragment(const dfmessages::DataRequest& datarequest,
+                                                    std::unique_ptr<daqdataformats::Fragment>&& fragment)
+{
+  // Send fragment, or hand it over to the sender thread of its destination
+  auto t_send_begin = std::chrono::high_resolution_clock::now();
+  if (m_async_fragment_send) {
+    if (!m_fragment_send_stage.enqueue(datarequest.data_destination, std::move(fragment))) {
+      // The stage already warned: the request failed all the same
+      m_num_fragments_send_dropped++;
+      m_num_requests_bad++;
+      return false;
+    }
+  } else {
+    get_iom_sender<std::unique_ptr<daqdataformats::Fragment>>(datarequest.data_destination)
+      ->send(std::move(fragment), std::chrono::milliseconds(m_fragment_send_timeout_ms));
+  }
+  m_send_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::high_resolution_clock::now() - t_send_begin).count());
+  return true;
+}
+
+template<class RDT, class LBT>
+dfmessages::DataRequest
+DefaultRequestHandlerModel<RDT, LBT>::make_subrequest(const dfmessages::DataRequest& datarequest, size_t index) const
+{
+  dfmessages::DataRequest subrequest = datarequest;
+  subrequest.request_information.window_begin =
+    datarequest.request_information.window_begin + index * m_subfragment_window_ticks;
+  subrequest.request_information.window_end = std::min<uint64_t>( // NOLINT(build/unsigned)
+    subrequest.request_information.window_begin + m_subfragment_window_ticks,
+    datarequest.request_information.window_end);
+  return subrequest;
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::stream_request(const dfmessages::DataRequest& datarequest,
+                                                     bool send_partial_fragment_if_available,
+                                                     int request_class,
+                                                     std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived,
+                                                     std::chrono::time_point<std::chrono::high_resolution_clock> t_begin,
+                                                     size_t first_subfragment,
+                                                     bool send_partial_first)
+{
+  // Every sub-fragment carries the trigger and sequence numbers of the request, and its sub-window as its
+  // window_begin/window_end: together, the sub-windows cover the requested window in order.
+  // Only one sub-window is pinned against cleanup at a time.
+  auto window_end = datarequest.request_information.window_end;
+  for (size_t index = first_subfragment;
+       datarequest.request_information.window_begin + index * m_subfragment_window_ticks < window_end;
+       ++index) {
+    auto subrequest = make_subrequest(datarequest, index);
+    bool send_partial = send_partial_fragment_if_available || (send_partial_first && index == first_subfragment);
     {
       std::unique_lock<std::mutex> lock(m_cv_mutex);
       m_cv.wait(lock, [&] { return !m_cleanup_requested; });
       m_requests_running++;
     }
     m_cv.notify_all();
-    auto result = data_request(datarequest, send_partial_fragment_if_available);
+    auto result = data_request(subrequest, send_partial);
+    if (result.result_code == ResultCode::kFound && m_triggered_recorder.is_open()) {
+      // Only the outer edges of the whole window are padded
+      record_window(subrequest, index == 0, subrequest.request_information.window_end == window_end);
+    }
     {
       std::lock_guard<std::mutex> lock(m_cv_mutex);
       m_requests_running--;
     }
     m_cv.notify_all();
-    if (result.result_code == ResultCode::kFound || result.result_code == ResultCode::kNotFound) {
-      try { // Send to fragment connection
-        TLOG_DEBUG(TLVL_WORK_STEPS) << "Sending fragment with trigger/sequence_number "
-          << result.fragment->get_trigger_number() << "."
-          << result.fragment->get_sequence_number() << ", run number "
-          << result.fragment->get_run_number() << ", and SourceID "
-          << result.fragment->get_element_id() << ", and size "
-          << result.fragment->get_size() << ", and result code "
-	  << result.result_code;
-        // Send fragment
-        get_iom_sender<std::unique_ptr<daqdataformats::Fragment>>(datarequest.data_destination)
-          ->send(std::move(result.fragment), std::chrono::milliseconds(m_fragment_send_timeout_ms));
-
-      } catch (const ers::Issue& excpt) {
-        ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, datarequest.data_destination, excpt));
-      }
-    } else if (result.result_code == ResultCode::kNotYet) {
-      TLOG_DEBUG(TLVL_WORK_STEPS) << "Re-queue request. "
-                                  << "With timestamp=" << result.data_request.trigger_timestamp;
+    if (result.result_code == ResultCode::kNotYet) {
+      // Rather than holding on to this thread, let check_waiting_requests resume the stream when the data is there
+      RequestElement element(subrequest, std::chrono::high_resolution_clock::now(),
+                             send_partial_fragment_if_available, request_class, t_arrived);
+      element.stream = datarequest;
+      element.stream_begin = t_begin;
+      element.subfragment_index = index;
       std::lock_guard<std::mutex> wait_lock_guard(m_waiting_requests_lock);
-      m_waiting_requests.push_back(RequestElement(datarequest, std::chrono::high_resolution_clock::now(),
-                                                  send_partial_fragment_if_available));
+      m_waiting_requests.push_back(element);
+      return;
     }
-    auto t_req_end = std::chrono::high_resolution_clock::now();
-    auto us_req_took = std::chrono::duration_cast<std::chrono::microseconds>(t_req_end - t_req_begin);
-    TLOG_DEBUG(TLVL_WORK_STEPS) << "Responding to data request took: " << us_req_took.count() << "[us]";
-    // if (result.result_code == ResultCode::kFound) {
-    //   std::lock_guard<std::mutex> time_lock_guard(m_response_time_log_lock);
-    //   m_response_time_log.push_back( std::make_pair<int, int>(result.data_request.trigger_number,
-    //   us_req_took.count()) );
-    // }
-    m_response_time_acc.fetch_add(us_req_took.count());
-    if ( us_req_took.count() > m_response_time_max.load() )
-      m_response_time_max.store(us_req_took.count());
-    if ( us_req_took.count() < m_response_time_min.load() )
-      m_response_time_min.store(us_req_took.count());
-    m_handled_requests++;
-  });
+    try {
+      if (send_fragment(subrequest, std::move(result.fragment))) {
+        m_num_subfragments_sent++;
+      }
+    } catch (const ers::Issue& excpt) {
+      ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, subrequest.data_destination, excpt));
+    }
+  }
+
+  // The whole window is served
+  auto us_stream_took = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::high_resolution_clock::now() - t_begin);
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Streaming data request took: " << us_stream_took.count() << "[us]";
+  record_response_time(us_stream_took.count());
 }
 
 template<class RDT, class LBT>
 void 
-DefaultRequestHandlerModel<RDT, LBT>::get_info(opmonlib::InfoCollector& ci, int /*level*/)
+DefaultRequestHandlerModel<RDT, LBT>::reissue_request(const RequestElement& element,
+                                                      bool send_partial_fragment_if_available)
+{
+  if (element.stream) {
+    // Resume streaming a long window, the timed out sub-window partially
+    auto resume = [&, element, send_partial_fragment_if_available]() {
+      stream_request(*element.stream, element.send_partial_fragment_if_available, element.request_class,
+                     element.arrival_time, element.stream_begin, element.subfragment_index,
+                     send_partial_fragment_if_available);
+    };
+    if (m_request_classes.empty()) {
+      boost::asio::post(*m_request_handler_thread_pool, resume);
+    } else {
+      m_request_scheduler.post(element.request_class, request_deadline(element.request_class, element.arrival_time), resume);
+    }
+    return;
+  }
+  // Keep an explicitly chosen class, otherwise go through the (overridable) default entry point
+  if (element.request_class < 0) {
+    issue_request(element.request, send_partial_fragment_if_available);
+  } else {
+    schedule_request(element.request, send_partial_fragment_if_available, element.request_class, element.arrival_time);
+  }
+}
+
+template<class RDT, class LBT>
+size_t
+DefaultRequestHandlerModel<RDT, LBT>::select_request_class(const dfmessages::DataRequest& datarequest) const
+{
+  auto window_ticks = datarequest.request_information.window_end - datarequest.request_information.window_begin;
+  for (size_t i = 0; i < m_request_classes.size(); ++i) {
+    const auto& rc = m_request_classes[i];
+    if ((rc.max_window_ticks == 0 || window_ticks <= rc.max_window_ticks) &&
+        (rc.destination.empty() || rc.destination == datarequest.data_destination)) {
+      return i;
+    }
+  }
+  // Nothing matches: the lowest priority class takes it
+  return m_request_classes.size() - 1;
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::handle_request(const dfmessages::DataRequest& datarequest,
+                                                     bool send_partial_fragment_if_available,
+                                                     int request_class,
+                                                     std::chrono::time_point<std::chrono::high_resolution_clock> t_issued,
+                                                     std::chrono::time_point<std::chrono::high_resolution_clock> t_arrived)
+{
+  auto t_req_begin = std::chrono::high_resolution_clock::now();
+  m_queue_wait_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(t_req_begin - t_issued).count());
+  if (m_subfragment_window_ticks > 0 &&
+      datarequest.request_information.window_end - datarequest.request_information.window_begin >
+        m_subfragment_window_ticks) {
+    stream_request(datarequest, send_partial_fragment_if_available, request_class, t_arrived, t_req_begin);
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(m_cv_mutex);
+    m_cv.wait(lock, [&] { return !m_cleanup_requested; });
+    m_requests_running++;
+  }
+  m_cv.notify_all();
+  auto result = data_request(datarequest, send_partial_fragment_if_available);
+  if (result.result_code == ResultCode::kFound && m_triggered_recorder.is_open()) {
+    record_window(datarequest, true, true);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_cv_mutex);
+    m_requests_running--;
+  }
+  m_cv.notify_all();
+  if (result.result_code == ResultCode::kFound || result.result_code == ResultCode::kNotFound) {
+    try { // Send to fragment connection
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Sending fragment with trigger/sequence_number "
+        << result.fragment->get_trigger_number() << "."
+        << result.fragment->get_sequence_number() << ", run number "
+        << result.fragment->get_run_number() << ", and SourceID "
+        << result.fragment->get_element_id() << ", and size "
+        << result.fragment->get_size() << ", and result code "
+	  << result.result_code;
+      send_fragment(datarequest, std::move(result.fragment));
+    } catch (const ers::Issue& excpt) {
+      ers::warning(CannotWriteToQueue(ERS_HERE, m_sourceid, datarequest.data_destination, excpt));
+    }
+  } else if (result.result_code == ResultCode::kNotYet) {
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Re-queue request. "
+                                << "With timestamp=" << result.data_request.trigger_timestamp;
+    std::lock_guard<std::mutex> wait_lock_guard(m_waiting_requests_lock);
+    m_waiting_requests.push_back(RequestElement(datarequest, std::chrono::high_resolution_clock::now(),
+                                                send_partial_fragment_if_available, request_class, t_arrived));
+  }
+  auto t_req_end = std::chrono::high_resolution_clock::now();
+  auto us_req_took = std::chrono::duration_cast<std::chrono::microseconds>(t_req_end - t_req_begin);
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Responding to data request took: " << us_req_took.count() << "[us]";
+  // if (result.result_code == ResultCode::kFound) {
+  //   std::lock_guard<std::mutex> time_lock_guard(m_response_time_log_lock);
+  //   m_response_time_log.push_back( std::make_pair<int, int>(result.data_request.trigger_number,
+  //   us_req_took.count()) );
+  // }
+  record_response_time(us_req_took.count());
+}
+
+template<class RDT, class LBT>
+void
+DefaultRequestHandlerModel<RDT, LBT>::record_response_time(int took)
+{
+  m_response_time_acc.fetch_add(took);
+  m_response_latency.record(took);
+  int current = m_response_time_max.load();
+  while (took > current && !m_response_time_max.compare_exchange_weak(current, took)) {
+  }
+  current = m_recent_response_time_max.load();
+  while (took > current && !m_recent_response_time_max.compare_exchange_weak(current, took)) {
+  }
+  current = m_response_time_min.load();
+  while (took < current && !m_response_time_min.compare_exchange_weak(current, took)) {
+  }
+  m_handled_requests++;
+}
+
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::get_info(opmonlib::InfoCollector& ci, int level)
 {
   readoutinfo::RequestHandlerInfo info;
   info.num_requests_found = m_num_requests_found.exchange(0);
@@ -257,9 +659,28 @@ DefaultRequestHandlerModel<RDT, LBT>::get_info(opmonlib::InfoCollector& ci, int
   info.num_buffer_cleanups = m_num_buffer_cleanups.exchange(0);
   info.num_requests_waiting = m_waiting_requests.size();
   info.num_requests_timed_out = m_num_requests_timed_out.exchange(0);
+  info.num_requests_with_gaps = m_num_requests_with_gaps.exchange(0);
+  info.num_missing_ranges = m_completeness_index.num_missing_ranges();
   info.is_recording = m_recording;
   info.num_payloads_written = m_payloads_written.exchange(0);
+  info.num_recording_buffer_waits = m_recording_writer.get_block_stats().num_buffer_waits.exchange(0);
+  info.recording_buffer_wait_time = m_recording_writer.get_block_stats().buffer_wait_time.exchange(0);
+  info.last_recording_bytes = m_last_recording_bytes.load();
+  info.last_recording_throughput = m_last_recording_throughput.load();
+  info.last_recording_stall_time = m_last_recording_stall_time.load();
+  info.num_recording_throttles = m_num_recording_throttles.exchange(0);
+  info.num_recording_backoffs = m_num_recording_backoffs.exchange(0);
+  info.recording_throttle_time = m_recording_throttle_time.exchange(0);
+  info.num_subfragments_sent = m_num_subfragments_sent.exchange(0);
+  info.num_windows_recorded = m_triggered_recorder.get_num_recorded();
+  info.num_windows_recording_dropped = m_triggered_recorder.get_num_dropped();
+  info.recorded_window_bytes = m_triggered_recorder.get_bytes_written();
   info.recording_status = m_recording ? "Y" : "N";
+  if (m_async_fragment_send) {
+    info.num_fragments_send_queued = m_fragment_send_stage.get_queue_depth();
+  }
+  info.num_fragments_send_dropped = m_num_fragments_send_dropped.exchange(0);
+  info.num_requests_trace_dropped = m_request_trace.get_num_dropped();
 
 
   int new_pop_reqs = 0;
@@ -306,9 +727,56 @@ DefaultRequestHandlerModel<RDT, LBT>::get_info(opmonlib::InfoCollector& ci, int
   m_t0 = now;
 
   ci.add(info);
+
+  if (m_async_fragment_send) {
+    m_fragment_send_stage.get_info(ci, level);
+  }
+
+  add_latency_info(ci, "latency_queue_wait", m_queue_wait_latency);
+  add_latency_info(ci, "latency_lookup", m_lookup_latency);
+  add_latency_info(ci, "latency_copy", m_copy_latency);
+  add_latency_info(ci, "latency_send", m_send_latency);
+  add_latency_info(ci, "latency_response", m_response_latency);
+  add_latency_info(ci, "latency_recording_write", m_recording_writer.get_block_stats().write_latency);
+
+  for (const auto& stats : m_request_scheduler.get_stats()) {
+    readoutinfo::RequestClassInfo class_info;
+    class_info.num_requests_handled = stats.num_tasks;
+    class_info.num_requests_queued = stats.num_queued;
+    class_info.max_requests_queued = stats.max_queued;
+    class_info.max_queue_time = stats.max_queue_time_us;
+    class_info.max_response_time = stats.max_run_time_us;
+    class_info.num_deadline_misses = stats.num_deadline_misses;
+    if (stats.num_tasks > 0) {
+      class_info.avg_queue_time = stats.tot_queue_time_us / stats.num_tasks;
+      class_info.avg_response_time = stats.tot_run_time_us / stats.num_tasks;
+    }
+    opmonlib::InfoCollector child;
+    child.add(class_info);
+    ci.add("request_class_" + stats.name, child);
+  }
 }
 
 
+template<class RDT, class LBT>
+void 
+DefaultRequestHandlerModel<RDT, LBT>::add_latency_info(opmonlib::InfoCollector& ci,
+                                                       const std::string& name,
+                                                       LatencyHistogram& histogram)
+{
+  auto snapshot = histogram.snapshot_and_reset();
+  readoutinfo::LatencyInfo info;
+  info.count = snapshot.count();
+  info.p50 = snapshot.percentile(0.5);
+  info.p90 = snapshot.percentile(0.9);
+  info.p99 = snapshot.percentile(0.99);
+  info.p999 = snapshot.percentile(0.999);
+  info.max = snapshot.max();
+  opmonlib::InfoCollector child;
+  child.add(info);
+  ci.add(name, child);
+}
+
 template<class RDT, class LBT>
 std::unique_ptr<daqdataformats::Fragment> 
 DefaultRequestHandlerModel<RDT, LBT>::create_empty_fragment(const dfmessages::DataRequest& dr)
@@ -353,6 +821,7 @@ DefaultRequestHandlerModel<RDT, LBT>::cleanup()
     m_occupancy = m_latency_buffer->occupancy();
     m_pops_count += popped;
     m_error_registry->remove_errors_until(m_latency_buffer->front()->get_first_timestamp());
+    m_completeness_index.remove_until(m_latency_buffer->front()->get_first_timestamp());
   }
   m_num_buffer_cleanups++;
 }
@@ -377,12 +846,12 @@ DefaultRequestHandlerModel<RDT, LBT>::check_waiting_requests()
 
       for (size_t i = 0; i < size;) {
         if (m_waiting_requests[i].request.request_information.window_end < newest_ts) {
-          issue_request(m_waiting_requests[i].request, m_waiting_requests[i].send_partial_fragment_if_available);
+          reissue_request(m_waiting_requests[i], m_waiting_requests[i].send_partial_fragment_if_available);
           std::swap(m_waiting_requests[i], m_waiting_requests.back());
           m_waiting_requests.pop_back();
           size--;
         } else if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - m_waiting_requests[i].start_time).count() >= m_request_timeout_ms) {
-          issue_request(m_waiting_requests[i].request, true);
+          reissue_request(m_waiting_requests[i], true);
 
           if (m_warn_on_timeout) {
             ers::warning(dunedaq::readoutlibs::VerboseRequestTimedOut(ERS_HERE, m_sourceid,
@@ -409,30 +878,77 @@ DefaultRequestHandlerModel<RDT, LBT>::check_waiting_requests()
   }
 }
 
+template<class RDT, class LBT>
+void
+DefaultRequestHandlerModel<RDT, LBT>::record_window(const dfmessages::DataRequest& datarequest,
+                                                    bool pad_begin,
+                                                    bool pad_end)
+{
+  uint64_t begin = datarequest.request_information.window_begin; // NOLINT(build/unsigned)
+  uint64_t end = datarequest.request_information.window_end;     // NOLINT(build/unsigned)
+  if (pad_begin) {
+    begin = begin > m_triggered_recording_padding ? begin - m_triggered_recording_padding : 0;
+  }
+  if (pad_end) {
+    end += m_triggered_recording_padding;
+  }
+  // The padding may reach past the oldest data. The lookup starts one element before the window, so the
+  // window has to start at least one element after the oldest one.
+  auto front = m_latency_buffer->front();
+  if (front == nullptr) {
+    return;
+  }
+  begin = std::max<uint64_t>(begin, front->get_first_timestamp() + m_element_span_ticks); // NOLINT(build/unsigned)
+  if (begin >= end) {
+    return;
+  }
+
+  std::vector<std::pair<void*, size_t>> frag_pieces;
+  if (!collect_fragment_pieces(begin, end, frag_pieces)) {
+    return;
+  }
+  auto frag_header = create_fragment_header(datarequest);
+  frag_header.window_begin = begin;
+  frag_header.window_end = end;
+  m_triggered_recorder.record(frag_header, frag_pieces);
+}
+
 template<class RDT, class LBT>
 std::vector<std::pair<void*, size_t>> 
 DefaultRequestHandlerModel<RDT, LBT>::get_fragment_pieces(uint64_t start_win_ts,
                                                           uint64_t end_win_ts,
                                                           RequestResult& rres)
 {
+  std::vector<std::pair<void*, size_t>> frag_pieces;
+  if (!collect_fragment_pieces(start_win_ts, end_win_ts, frag_pieces)) {
+    // Due to some concurrent access, the start_iter could not be retrieved successfully, try again
+    ++m_num_requests_delayed;
+    rres.result_code = ResultCode::kNotYet; // give it another chance
+    //TLOG() << "Timestamp in future";
+  } else {
+    rres.result_code = ResultCode::kFound;
+    ++m_num_requests_found;
+  }
+  //TLOG() << "*** Number of frames retrieved: " << frag_pieces.size();
+  return frag_pieces;
+}
 
+template<class RDT, class LBT>
+bool
+DefaultRequestHandlerModel<RDT, LBT>::collect_fragment_pieces(uint64_t start_win_ts,
+                                                              uint64_t end_win_ts,
+                                                              std::vector<std::pair<void*, size_t>>& frag_pieces)
+{
   //TLOG() << "Looking for frags between " << start_win_ts << " and " << end_win_ts;
-  std::vector<std::pair<void*, size_t>> frag_pieces;
   RDT request_element = RDT();
   request_element.set_first_timestamp(start_win_ts-(request_element.get_num_frames() * RDT::expected_tick_difference));
   auto start_iter = m_error_registry->has_error("MISSING_FRAMES")
                       ? m_latency_buffer->lower_bound(request_element, true)
                       : m_latency_buffer->lower_bound(request_element, false);
   if (start_iter == m_latency_buffer->end()) {
-    // Due to some concurrent access, the start_iter could not be retrieved successfully, try again
-    ++m_num_requests_delayed;
-    rres.result_code = ResultCode::kNotYet; // give it another chance
-    //TLOG() << "Timestamp in future";
+    return false;
   } else {
     //TLOG() << "Lower bound found " << start_iter->get_first_timestamp() << ", --> distance from window: " << int64_t(start_win_ts) - int64_t(start_iter->get_first_timestamp()) ;  
-    rres.result_code = ResultCode::kFound;
-    ++m_num_requests_found;
-
     auto elements_handled = 0;
 
     RDT* element = &(*start_iter);
@@ -450,12 +966,15 @@ DefaultRequestHandlerModel<RDT, LBT>::get_fragment_pieces(uint64_t start_win_ts,
           element->get_first_timestamp() + element->get_num_frames() * RDT::expected_tick_difference >
             end_win_ts)) {
         //TLOG() << "We don't need the whole aggregated object (e.g.: superchunk)" ;
-        for (auto frame_iter = element->begin(); frame_iter != element->end(); frame_iter++) {
-          if (get_frame_iterator_timestamp(frame_iter) > (start_win_ts - RDT::expected_tick_difference)&&
-              get_frame_iterator_timestamp(frame_iter) < end_win_ts ) {
-            frag_pieces.emplace_back(
-              std::make_pair<void*, size_t>(static_cast<void*>(&(*frame_iter)), element->get_frame_size()));
-          }
+        // Frames are stored contiguously and ordered in time: find the in-window range by binary search
+        // and copy it as a single piece
+        auto first_frame = find_first_frame(element->begin(), element->end(),
+                                            start_win_ts - RDT::expected_tick_difference + 1);
+        auto last_frame = find_first_frame(first_frame, element->end(), end_win_ts);
+        auto num_frames = std::distance(first_frame, last_frame);
+        if (num_frames > 0) {
+          frag_pieces.emplace_back(
+            std::make_pair<void*, size_t>(static_cast<void*>(&(*first_frame)), num_frames * element->get_frame_size()));
         }
       }
       else {
@@ -471,8 +990,7 @@ DefaultRequestHandlerModel<RDT, LBT>::get_fragment_pieces(uint64_t start_win_ts,
     }
     
   }
-  //TLOG() << "*** Number of frames retrieved: " << frag_pieces.size();
-  return frag_pieces;
+  return true;
 }
 
 template<class RDT, class LBT>
@@ -481,6 +999,7 @@ DefaultRequestHandlerModel<RDT, LBT>::data_request(dfmessages::DataRequest dr,
                                                    bool send_partial_fragment_if_available)
 {
   // Prepare response
+  auto t_lookup_begin = std::chrono::high_resolution_clock::now();
   RequestResult rres(ResultCode::kUnknown, dr);
 
   // Prepare FragmentHeader and empty Fragment pieces list
@@ -585,6 +1104,13 @@ DefaultRequestHandlerModel<RDT, LBT>::data_request(dfmessages::DataRequest dr,
       }
     }
 
+    // Holes inside the window are not visible from its edges
+    if (m_track_completeness && rres.result_code == ResultCode::kFound &&
+        m_completeness_index.has_gap(start_win_ts, end_win_ts)) {
+      frag_header.error_bits |= (0x1 << static_cast<size_t>(daqdataformats::FragmentErrorBits::kIncomplete));
+      ++m_num_requests_with_gaps;
+    }
+
     // Build fragment
     oss << "TS match result for SourceID[" << m_sourceid << "]: "
         << " Trigger/sequence number=" << dr.trigger_number << "." << dr.sequence_number
@@ -615,10 +1141,14 @@ DefaultRequestHandlerModel<RDT, LBT>::data_request(dfmessages::DataRequest dr,
   }
 
   // Create fragment from pieces
+  auto t_copy_begin = std::chrono::high_resolution_clock::now();
   rres.fragment = std::make_unique<daqdataformats::Fragment>(frag_pieces);
 
   // Set header
   rres.fragment->set_header_fields(frag_header);
+  m_lookup_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(t_copy_begin - t_lookup_begin).count());
+  m_copy_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::high_resolution_clock::now() - t_copy_begin).count());
 
   return rres;
 }
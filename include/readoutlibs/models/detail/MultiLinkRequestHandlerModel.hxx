@@ -0,0 +1,431 @@
+// Declarations for MultiLinkRequestHandlerModel
+
+namespace dunedaq {
+namespace readoutlibs {
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::conf(const nlohmann::json& args)
+{
+  auto conf = args["requesthandlerconf"].get<readoutconfig::RequestHandlerConf>();
+  leave_group();
+  if (conf.link_group.empty()) {
+    inherited::conf(args);
+    return;
+  }
+
+  // The group's threads only look up data: what holds on to a request handling thread stays out
+  bool disabled = conf.max_fragment_size > 0 || !conf.request_classes.empty() ||
+                  !conf.triggered_recording_file.empty();
+  conf.max_fragment_size = 0;
+  conf.request_classes.clear();
+  conf.triggered_recording_file.clear();
+  conf.async_fragment_send = false;
+  nlohmann::json link_args;
+  link_args["requesthandlerconf"] = conf;
+  inherited::conf(link_args);
+  if (disabled) {
+    ers::warning(ConfigurationError(ERS_HERE,
+                                    inherited::m_sourceid,
+                                    "Streaming, request classes and triggered recording are not available in link "
+                                    "group " + conf.link_group + ", they are disabled"));
+  }
+
+  m_group = LinkGroup::get(conf.link_group);
+  m_group->add_link(this, conf);
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Link " << inherited::m_sourceid << " joined link group " << conf.link_group;
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::scrap(const nlohmann::json& args)
+{
+  leave_group();
+  inherited::scrap(args);
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::start(const nlohmann::json& args)
+{
+  if (!m_group) {
+    inherited::start(args);
+    return;
+  }
+  // The group's threads serve the link: only its own state is set up here
+  inherited::m_t0 = std::chrono::high_resolution_clock::now();
+  inherited::m_completeness_index.reset();
+  inherited::m_recording_writer.set_run_number(args.value<dunedaq::daqdataformats::run_number_t>("run", 1));
+  inherited::m_run_marker.store(true);
+  m_group->start();
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::stop(const nlohmann::json& args)
+{
+  if (!m_group) {
+    inherited::stop(args);
+    return;
+  }
+  // From now on, data missing from this link is reported as not found instead of being waited for
+  inherited::m_run_marker.store(false);
+  while (!inherited::m_recording_thread.get_readiness()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  m_group->stop();
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::issue_request(dfmessages::DataRequest datarequest,
+                                                      bool send_partial_fragment_if_available)
+{
+  if (!m_group) {
+    inherited::issue_request(datarequest, send_partial_fragment_if_available);
+    return;
+  }
+  if (inherited::m_request_trace.is_open()) {
+    inherited::m_request_trace.trace(datarequest, send_partial_fragment_if_available);
+  }
+  m_group->issue_request(datarequest, send_partial_fragment_if_available);
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::get_info(opmonlib::InfoCollector& ci, int level)
+{
+  inherited::get_info(ci, level);
+  if (m_group && m_group->is_first_link(this)) {
+    opmonlib::InfoCollector group_ci;
+    m_group->get_info(group_ci, level);
+    ci.add("link_group", group_ci);
+  }
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::set_sender_factory(FragmentSendStage::sender_factory_t factory)
+{
+  if (m_group) {
+    m_group->set_sender_factory(std::move(factory));
+  } else {
+    inherited::m_fragment_send_stage.set_sender_factory(std::move(factory));
+  }
+}
+
+template<class RDT, class LBT>
+std::unique_ptr<daqdataformats::Fragment>
+MultiLinkRequestHandlerModel<RDT, LBT>::extract(const dfmessages::DataRequest& datarequest,
+                                                bool send_partial_fragment_if_available,
+                                                bool& not_yet)
+{
+  {
+    std::unique_lock<std::mutex> lock(inherited::m_cv_mutex);
+    inherited::m_cv.wait(lock, [&] { return !inherited::m_cleanup_requested; });
+    inherited::m_requests_running++;
+  }
+  inherited::m_cv.notify_all();
+  auto result = inherited::data_request(datarequest, send_partial_fragment_if_available);
+  {
+    std::lock_guard<std::mutex> lock(inherited::m_cv_mutex);
+    inherited::m_requests_running--;
+  }
+  inherited::m_cv.notify_all();
+  not_yet = result.result_code == inherited::ResultCode::kNotYet;
+  return std::move(result.fragment);
+}
+
+template<class RDT, class LBT>
+uint64_t // NOLINT(build/unsigned)
+MultiLinkRequestHandlerModel<RDT, LBT>::newest_timestamp()
+{
+  auto last_frame = inherited::m_latency_buffer->back(); // NOLINT
+  return last_frame == nullptr ? 0 : last_frame->get_first_timestamp();
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::leave_group()
+{
+  if (m_group) {
+    m_group->remove_link(this);
+    m_group.reset();
+  }
+}
+
+template<class RDT, class LBT>
+std::shared_ptr<typename MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup>
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::get(const std::string& name)
+{
+  static std::mutex s_groups_mutex;
+  static std::map<std::string, std::weak_ptr<LinkGroup>> s_groups;
+  std::lock_guard<std::mutex> lock(s_groups_mutex);
+  auto group = s_groups[name].lock();
+  if (!group) {
+    // The group goes away with its last link
+    group = std::make_shared<LinkGroup>(name);
+    s_groups[name] = group;
+  }
+  return group;
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::add_link(link_t* link,
+                                                            const readoutconfig::RequestHandlerConf& conf)
+{
+  std::lock_guard<std::mutex> lock(m_links_mutex);
+  if (m_links.empty()) {
+    m_sourceid = link->m_sourceid;
+    m_num_request_handling_threads = conf.num_request_handling_threads;
+    m_request_timeout_ms = conf.request_timeout_ms;
+    m_warn_on_timeout = conf.warn_on_timeout;
+    m_fragment_send_stage.conf(m_sourceid,
+                               conf.fragment_send_queue_size,
+                               conf.fragment_send_batch_size,
+                               conf.fragment_queue_timeout_ms,
+                               conf.fragment_send_timeout_ms);
+    m_cleanup_thread.set_name("cleanup", conf.source_id);
+  }
+  auto pos = std::find_if(m_links.begin(), m_links.end(), [&](const link_t* other) {
+    return link->m_sourceid.id < other->m_sourceid.id;
+  });
+  m_links.insert(pos, link);
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::remove_link(link_t* link)
+{
+  std::lock_guard<std::mutex> lock(m_links_mutex);
+  m_links.erase(std::remove(m_links.begin(), m_links.end(), link), m_links.end());
+}
+
+template<class RDT, class LBT>
+bool
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::is_first_link(const link_t* link)
+{
+  std::lock_guard<std::mutex> lock(m_links_mutex);
+  return !m_links.empty() && m_links.front() == link;
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::start()
+{
+  std::lock_guard<std::mutex> lock(m_run_mutex);
+  if (m_num_running_links++ > 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> links_lock(m_links_mutex);
+    m_run_links = m_links;
+  }
+  m_handled_requests = 0;
+  m_num_requests_delayed = 0;
+  m_num_requests_timed_out = 0;
+  m_num_fragments_send_dropped = 0;
+  m_response_time_acc = 0;
+
+  m_request_handler_thread_pool = std::make_unique<boost::asio::thread_pool>(m_num_request_handling_threads);
+  m_fragment_send_stage.start();
+  m_run_marker.store(true);
+  m_cleanup_thread.set_work(&LinkGroup::periodic_cleanups, this);
+  m_waiting_queue_thread = std::thread(&LinkGroup::check_waiting_requests, this);
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Link group " << m_name << " started with " << m_run_links.size() << " links";
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::stop()
+{
+  std::lock_guard<std::mutex> lock(m_run_mutex);
+  if (m_num_running_links == 0 || --m_num_running_links > 0) {
+    return;
+  }
+  m_run_marker.store(false);
+  while (!m_cleanup_thread.get_readiness()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // Returns once every request in flight is answered
+  m_waiting_queue_thread.join();
+  m_request_handler_thread_pool->join();
+  // Extractors are done: drain what is still queued for sending
+  m_fragment_send_stage.stop();
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::issue_request(const dfmessages::DataRequest& datarequest,
+                                                                 bool send_partial_fragment_if_available)
+{
+  if (!m_run_marker.load()) {
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Link group " << m_name << " is not running, dropping request for trigger "
+                                << datarequest.trigger_number;
+    return;
+  }
+  ++m_num_requests_in_flight;
+  auto pending =
+    std::make_shared<PendingRequest>(datarequest, send_partial_fragment_if_available, m_run_links.size());
+  extract_missing(pending, send_partial_fragment_if_available);
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::extract_missing(std::shared_ptr<PendingRequest> pending,
+                                                                   bool send_partial_fragment_if_available)
+{
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < pending->not_yet.size(); ++i) {
+    if (pending->not_yet[i]) {
+      missing.push_back(i);
+    }
+  }
+  pending->links_remaining = missing.size();
+  for (auto i : missing) {
+    boost::asio::post(*m_request_handler_thread_pool, [this, pending, i, send_partial_fragment_if_available]() {
+      bool not_yet = false;
+      pending->sections[i] = m_run_links[i]->extract(pending->request, send_partial_fragment_if_available, not_yet);
+      pending->not_yet[i] = not_yet;
+      if (--pending->links_remaining == 0) {
+        complete_request(pending);
+      }
+    });
+  }
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::complete_request(std::shared_ptr<PendingRequest> pending)
+{
+  const auto& dr = pending->request;
+  if (std::any_of(pending->not_yet.begin(), pending->not_yet.end(), [](char c) { return c != 0; })) {
+    // The sections found are kept: only the links still missing the data are looked up again
+    ++m_num_requests_delayed;
+    pending->t_waiting = std::chrono::high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(m_waiting_requests_lock);
+    m_waiting_requests.push_back(pending);
+    return;
+  }
+
+  auto frag_header = m_run_links.front()->create_fragment_header(dr);
+  frag_header.element_id = dr.request_information.component;
+  std::vector<std::pair<void*, size_t>> sections;
+  for (auto& section : pending->sections) {
+    frag_header.error_bits |= section->get_error_bits();
+    sections.emplace_back(section->get_storage_location(), section->get_size());
+  }
+  // The sections are copied once more, into the combined fragment: its size is only known once every link is
+  // looked up, and holding off the cleanups of all links until then would stall them all.
+  auto fragment = std::make_unique<daqdataformats::Fragment>(sections);
+  fragment->set_header_fields(frag_header);
+  pending->sections.clear();
+  if (!m_fragment_send_stage.enqueue(dr.data_destination, std::move(fragment))) {
+    m_num_fragments_send_dropped++;
+  }
+
+  int took = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() -
+                                                                   pending->t_begin).count();
+  m_response_time_acc.fetch_add(took);
+  int current = m_response_time_max.load();
+  while (took > current && !m_response_time_max.compare_exchange_weak(current, took)) {
+  }
+  current = m_response_time_min.load();
+  while (took < current && !m_response_time_min.compare_exchange_weak(current, took)) {
+  }
+  m_handled_requests++;
+  --m_num_requests_in_flight;
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::periodic_cleanups()
+{
+  while (m_run_marker.load()) {
+    for (auto* link : m_run_links) {
+      link->cleanup_check();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::check_waiting_requests()
+{
+  // Same policy as the single-link handler, per link still missing the data: it is looked up again once an element
+  // past the end of the window arrived, or partially once the request waited for m_request_timeout_ms. At stop,
+  // this runs until every request in flight is answered.
+  std::vector<uint64_t> newest_ts(m_run_links.size()); // NOLINT(build/unsigned)
+  while (m_run_marker.load() || m_num_requests_in_flight.load() > 0) {
+    {
+      std::lock_guard<std::mutex> lock_guard(m_waiting_requests_lock);
+      for (size_t l = 0; l < m_run_links.size(); ++l) {
+        newest_ts[l] = m_run_links[l]->newest_timestamp();
+      }
+
+      for (size_t i = 0; i < m_waiting_requests.size();) {
+        auto& pending = m_waiting_requests[i];
+        bool ready = true;
+        for (size_t l = 0; l < m_run_links.size(); ++l) {
+          // A stopped link reports the missing data as not found straight away
+          if (pending->not_yet[l] && m_run_links[l]->m_run_marker.load() &&
+              pending->request.request_information.window_end >= newest_ts[l]) {
+            ready = false;
+          }
+        }
+        if (ready) {
+          extract_missing(pending, pending->send_partial_fragment_if_available);
+        } else if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() -
+                                                                         pending->t_waiting).count() >=
+                   m_request_timeout_ms) {
+          extract_missing(pending, true);
+          if (m_warn_on_timeout) {
+            ers::warning(dunedaq::readoutlibs::VerboseRequestTimedOut(ERS_HERE, m_sourceid,
+                                                                      pending->request.trigger_number,
+                                                                      pending->request.sequence_number,
+                                                                      pending->request.run_number,
+                                                                      pending->request.request_information.window_begin,
+                                                                      pending->request.request_information.window_end,
+                                                                      pending->request.data_destination));
+          }
+          m_num_requests_timed_out++;
+        } else {
+          i++;
+          continue;
+        }
+        std::swap(m_waiting_requests[i], m_waiting_requests.back());
+        m_waiting_requests.pop_back();
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+template<class RDT, class LBT>
+void
+MultiLinkRequestHandlerModel<RDT, LBT>::LinkGroup::get_info(opmonlib::InfoCollector& ci, int level)
+{
+  readoutinfo::RequestHandlerInfo info;
+  info.num_requests_handled = m_handled_requests.exchange(0);
+  info.num_requests_delayed = m_num_requests_delayed.exchange(0);
+  info.num_requests_timed_out = m_num_requests_timed_out.exchange(0);
+  info.num_fragments_send_queued = m_fragment_send_stage.get_queue_depth();
+  info.num_fragments_send_dropped = m_num_fragments_send_dropped.exchange(0);
+  info.tot_request_response_time = m_response_time_acc.exchange(0);
+  info.max_request_response_time = m_response_time_max.exchange(0);
+  info.min_request_response_time = m_response_time_min.exchange(std::numeric_limits<int>::max());
+  if (info.num_requests_handled > 0) {
+    info.avg_request_response_time = info.tot_request_response_time / info.num_requests_handled;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_waiting_requests_lock);
+    info.num_requests_waiting = m_waiting_requests.size();
+  }
+  ci.add(info);
+  m_fragment_send_stage.get_info(ci, level);
+}
+
+} // namespace readoutlibs
+} // namespace dunedaq
@@ -68,7 +68,7 @@ ReadoutModel<RDT, RHT, LBT, RPT>::init(const nlohmann::json& args)
     }
     errstring += "timesync_output";
   }
-  if (m_data_request_receiver == nullptr)
+  if (m_data_request_receivers.empty())
   {
     if (errstring != "") { 
       errstring += ", "; 
@@ -119,6 +119,7 @@ ReadoutModel<RDT, RHT, LBT, RPT>::conf(const nlohmann::json& args)
   }
 
   m_request_handler_impl->conf(args);
+  m_request_handler_tracks_completeness = m_request_handler_impl->tracks_completeness();
 
   // Zero consume related metrics
   m_rawq_timeout_count = 0;
@@ -165,9 +166,15 @@ ReadoutModel<RDT, RHT, LBT, RPT>::start(const nlohmann::json& args)
     m_consumer_thread.set_work(&ReadoutModel<RDT, RHT, LBT, RPT>::run_consume, this);
   }
   m_timesync_thread.set_work(&ReadoutModel<RDT, RHT, LBT, RPT>::run_timesync, this);
-  // Register callback to receive and dispatch data requests
-  m_data_request_receiver->add_callback(
-    std::bind(&ReadoutModel<RDT, RHT, LBT, RPT>::dispatch_requests, this, std::placeholders::_1));
+  // Register callbacks to receive and dispatch data requests, one per request input
+  for (auto& rr : m_data_request_receivers) {
+    rr->num_requests = 0;
+    auto* counter = &rr->num_requests;
+    rr->receiver->add_callback([this, counter](dfmessages::DataRequest& data_request) {
+      ++(*counter);
+      dispatch_requests(data_request);
+    });
+  }
 }
 
 template<class RDT, class RHT, class LBT, class RPT>
@@ -177,7 +184,9 @@ ReadoutModel<RDT, RHT, LBT, RPT>::stop(const nlohmann::json& args)
   TLOG_DEBUG(TLVL_WORK_STEPS) << "Stoppping threads...";
 
   // Stop receiving data requests as first thing
-  m_data_request_receiver->remove_callback();
+  for (auto& rr : m_data_request_receivers) {
+    rr->receiver->remove_callback();
+  }
   // Stop the other threads
   m_request_handler_impl->stop(args);
   while (!m_timesync_thread.get_readiness()) {
@@ -220,9 +229,19 @@ ReadoutModel<RDT, RHT, LBT, RPT>::get_info(opmonlib::InfoCollector& ci, int leve
 
   ri.rate_payloads_consumed = new_packets / seconds / 1000.;
   ri.num_raw_queue_timeouts = rawq_timeouts;
+  ri.num_request_receivers = m_data_request_receivers.size();
 
   ci.add(ri);
 
+  for (auto& rr : m_data_request_receivers) {
+    readoutinfo::RequestReceiverInfo rri;
+    rri.num_requests = rr->num_requests.exchange(0);
+    rri.rate_requests = rri.num_requests / seconds;
+    opmonlib::InfoCollector child;
+    child.add(rri);
+    ci.add(rr->name, child);
+  }
+
   m_request_handler_impl->get_info(ci, level);
   m_raw_processor_impl->get_info(ci, level);
 }
@@ -232,18 +251,15 @@ void
 ReadoutModel<RDT, RHT, LBT, RPT>::setup_request_queues(const nlohmann::json& args)
 {
   auto ini = args.get<appfwk::app::ModInit>();	  
+  // Every "request_input" or "request_input_*" connection gets its own receiver and callback
   for (const auto& cr : ini.conn_refs) {
-    if(cr.name == "request_input") {
-      m_data_request_receiver = get_iom_receiver<dfmessages::DataRequest>(cr.uid) ;
+    if (cr.name == "request_input" || cr.name.rfind("request_input_", 0) == 0) {
+      auto rr = std::make_unique<RequestReceiver>();
+      rr->name = cr.name;
+      rr->receiver = get_iom_receiver<dfmessages::DataRequest>(cr.uid);
+      m_data_request_receivers.push_back(std::move(rr));
     }
   }
-  //int index = 0;
-  //iomanager::ConnectionRef request_input_ref = iomanager::ConnectionRef{ "input", "request_input_*", iomanager::Direction::kInput };
-  // Loop over request_input refs...
-  //while (queue_index.find("data_requests_" + std::to_string(index)) != queue_index.end()) {
-  //  m_data_request_receivers.push_back( get_iom_receiver<dfmessages::DataRequest>(ini.conn_refs["request_input"]) );
-    //index++;
-  //}
 }
 
 template<class RDT, class RHT, class LBT, class RPT>
@@ -266,9 +282,13 @@ ReadoutModel<RDT, RHT, LBT, RPT>::run_consume()
           m_request_handler_impl->report_tardy_packet(payload, diff1);
         }
       }
+      // Only elements the latency buffer accepted count as present
+      auto first_timestamp = payload.get_first_timestamp();
       if (!m_latency_buffer_impl->write(std::move(payload))) {
         TLOG_DEBUG(TLVL_TAKE_NOTE) << "***ERROR: Latency buffer is full and data was overwritten!";
         m_num_payloads_overwritten++;
+      } else if (m_request_handler_tracks_completeness) {
+        m_request_handler_impl->report_written_element(first_timestamp);
       }
       m_raw_processor_impl->postprocess_item(m_latency_buffer_impl->back());
       ++m_num_payloads;
@@ -329,9 +349,13 @@ ReadoutModel<RDT, RHT, LBT, RPT>::consume_payload(RDT&& payload)
           m_request_handler_impl->report_tardy_packet(payload, diff1);
         }
       }
+      // Only elements the latency buffer accepted count as present
+      auto first_timestamp = payload.get_first_timestamp();
       if (!m_latency_buffer_impl->write(std::move(payload))) {
         TLOG_DEBUG(TLVL_TAKE_NOTE) << "***ERROR: Latency buffer is full and data was overwritten!";
         m_num_payloads_overwritten++;
+      } else if (m_request_handler_tracks_completeness) {
+        m_request_handler_impl->report_written_element(first_timestamp);
       }
       m_raw_processor_impl->postprocess_item(m_latency_buffer_impl->back());
       ++m_num_payloads;
@@ -25,6 +25,16 @@ RecorderModel<ReadoutType>::get_info(opmonlib::InfoCollector& ci, int /* level *
                                                                                m_time_point_last_info)
                        .count();
   info.throughput_processed_packets = m_packets_processed_since_last_info / time_diff;
+  info.throughput_recorded_bytes = m_bytes_recorded_since_last_info.exchange(0) / time_diff;
+  int batches = m_batches_since_last_info.exchange(0);
+  info.average_batch_size = batches ? static_cast<double>(m_packets_processed_since_last_info) / batches : 0.;
+  auto& block_stats = m_recording_writer.get_block_stats();
+  info.num_buffer_waits = block_stats.num_buffer_waits.exchange(0);
+  info.buffer_wait_time = block_stats.buffer_wait_time.exchange(0);
+  auto write_latency = block_stats.write_latency.snapshot_and_reset();
+  info.write_latency_p50 = write_latency.percentile(0.5);
+  info.write_latency_p99 = write_latency.percentile(0.99);
+  info.write_latency_max = write_latency.max();
 
   ci.add(info);
 
@@ -42,15 +52,47 @@ RecorderModel<ReadoutType>::do_conf(const nlohmann::json& args)
     TLOG(TLVL_WORK_STEPS) << "Removed existing output file from previous run" << std::endl;
   }
 
-  m_buffered_writer.open(
-    m_conf.output_file, m_conf.stream_buffer_size, m_conf.compression_algorithm, m_conf.use_o_direct);
+  BufferedFileWriterOptions writer_options;
+  writer_options.buffer_size = m_conf.stream_buffer_size;
+  writer_options.compression_algorithm = m_conf.compression_algorithm;
+  writer_options.use_o_direct = m_conf.use_o_direct;
+  writer_options.io_backend = m_conf.io_backend;
+  writer_options.io_queue_depth = m_conf.io_queue_depth;
+  writer_options.compression_threads = m_conf.compression_threads;
+  writer_options.compression_level = m_conf.compression_level;
+  writer_options.compression_dictionary = m_conf.compression_dictionary;
+  RecordingFileOptions recording_options;
+  recording_options.format = m_conf.recording_format;
+  recording_options.source_id = m_conf.source_id;
+  recording_options.element_size = sizeof(ReadoutType);
+  recording_options.clock_frequency_hz = m_conf.recording_clock_frequency;
+  recording_options.index_interval = m_conf.recording_index_interval;
+  recording_options.stripe_directories = m_conf.stripe_directories;
+  recording_options.stripe_size = m_conf.stripe_size;
+  recording_options.segment_size = m_conf.segment_size;
+  m_recording_writer.open(m_conf.output_file, writer_options, recording_options);
+  // The batch is a whole number of blocks, so that the writer never stages the end of one. With the direct backend,
+  // it is at least one writer buffer, so that the writer takes it without copying it.
+  size_t batch_bytes = std::max(m_conf.batch_size, 1) * sizeof(ReadoutType);
+  if (m_conf.io_backend == "direct") {
+    batch_bytes = std::max<size_t>(batch_bytes, m_conf.stream_buffer_size);
+  }
+  size_t elements_per_block_multiple = s_block_size / std::gcd(sizeof(ReadoutType), s_block_size);
+  size_t batch_elements = (batch_bytes + sizeof(ReadoutType) - 1) / sizeof(ReadoutType);
+  batch_elements = (batch_elements + elements_per_block_multiple - 1) / elements_per_block_multiple *
+                   elements_per_block_multiple;
+  m_batch.resize(batch_elements);
+  m_batch_fill = 0;
+  TLOG_DEBUG(TLVL_WORK_STEPS) << "Staging batches of up to " << batch_elements << " elements";
+  m_receive_timeout = std::chrono::milliseconds(m_conf.receive_timeout_ms);
   m_work_thread.set_name(m_name, 0);
 }
 
 template<class ReadoutType>
 void 
-RecorderModel<ReadoutType>::do_start(const nlohmann::json& /* args */)
+RecorderModel<ReadoutType>::do_start(const nlohmann::json& args)
 {
+  m_recording_writer.set_run_number(args.value<dunedaq::daqdataformats::run_number_t>("run", 1));
   m_packets_processed_total = 0;
   m_run_marker.store(true);
   m_work_thread.set_work(&RecorderModel<ReadoutType>::do_work, this);
@@ -72,21 +114,51 @@ RecorderModel<ReadoutType>::do_work()
 {
   m_time_point_last_info = std::chrono::steady_clock::now();
 
-  ReadoutType element;
-  while (m_run_marker) {
-    try {
-      element = m_data_receiver->receive(std::chrono::milliseconds(100)); // RS -> Use confed timeout?
-      m_packets_processed_total++;
-      m_packets_processed_since_last_info++;
-      if (!m_buffered_writer.write(reinterpret_cast<char*>(&element), sizeof(element))) { // NOLINT
-        ers::warning(CannotWriteToFile(ERS_HERE, m_conf.output_file));
+  m_batch_fill = 0;
+  bool ok = true;
+  while (ok && m_run_marker) {
+    // Wait for the first element, then drain whatever is already queued into the staging buffer
+    auto opt_element = m_data_receiver->try_receive(m_receive_timeout);
+    if (!opt_element) {
+      // Nothing is coming in: write out what is staged rather than hold on to it
+      ok = m_batch_fill == 0 || write_batch();
+      continue;
+    }
+    while (opt_element) {
+      m_batch[m_batch_fill++] = std::move(opt_element.value());
+      if (m_batch_fill == m_batch.size()) {
         break;
       }
-    } catch (const dunedaq::iomanager::TimeoutExpired& excpt) {
-      continue;
+      opt_element = m_data_receiver->try_receive(std::chrono::milliseconds(0));
+    }
+    if (m_batch_fill == m_batch.size()) {
+      ok = write_batch();
     }
   }
-  m_buffered_writer.flush();
+  if (ok && m_batch_fill > 0) {
+    write_batch();
+  }
+  m_recording_writer.flush();
+}
+
+template<class ReadoutType>
+bool
+RecorderModel<ReadoutType>::write_batch()
+{
+  size_t batch_size = m_batch_fill;
+  m_batch_fill = 0;
+  m_packets_processed_total += batch_size;
+  m_packets_processed_since_last_info += batch_size;
+  m_bytes_recorded_since_last_info += batch_size * sizeof(ReadoutType);
+  m_batches_since_last_info++;
+  if (!m_recording_writer.write(reinterpret_cast<char*>(m_batch.data()), // NOLINT
+                                batch_size * sizeof(ReadoutType),
+                                m_batch.front().get_first_timestamp(),
+                                m_batch[batch_size - 1].get_first_timestamp())) {
+    ers::warning(CannotWriteToFile(ERS_HERE, m_conf.output_file));
+    return false;
+  }
+  return true;
 }
 
 } // namespace readoutlibs
@@ -28,7 +28,48 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::conf(const
     if (conf.use_o_direct) {
       m_oflag |= O_DIRECT;
     }
-    m_fd = ::open(conf.output_file.c_str(), m_oflag, 0644);
+
+    if (conf.recording_format != "raw" && conf.recording_format != "indexed") {
+      ers::error(ConfigurationError(ERS_HERE, inherited::m_sourceid, "Non-recognized recording format"));
+    }
+    m_indexed = conf.recording_format == "indexed";
+    m_index_interval = std::max(conf.recording_index_interval, 1);
+    m_clock_frequency_hz = conf.recording_clock_frequency;
+
+    if (conf.segment_size != 0) {
+      ers::warning(ConfigurationError(
+        ERS_HERE, inherited::m_sourceid, "Zero-copy recordings are not segmented, recording to a single file"));
+    }
+
+    m_stripe_fds.clear();
+    if (!conf.stripe_directories.empty() && m_indexed) {
+      ers::error(ConfigurationError(
+        ERS_HERE, inherited::m_sourceid, "Indexed recordings can not be striped, recording to a single file"));
+    }
+    if (!conf.stripe_directories.empty() && !m_indexed) {
+      // The output file becomes the manifest of the stripes
+      StripeManifest manifest;
+      manifest.stripe_size = conf.stripe_size;
+      for (size_t i = 0; i < conf.stripe_directories.size(); ++i) {
+        auto stripe = StripeManifest::stripe_file_name(conf.stripe_directories[i], conf.output_file, i);
+        remove(stripe.c_str());
+        int fd = ::open(stripe.c_str(), m_oflag, 0644);
+        if (fd == -1) {
+          ers::error(CannotOpenFile(ERS_HERE, stripe));
+        }
+        m_stripe_fds.push_back(fd);
+        manifest.stripes.push_back(stripe);
+      }
+      try {
+        manifest.write(conf.output_file);
+      } catch (const ers::Issue& excpt) {
+        ers::error(excpt);
+      }
+      m_stripe_size = conf.stripe_size;
+      m_fd = -1;
+    } else {
+      m_fd = ::open(conf.output_file.c_str(), m_oflag, 0644);
+    }
     inherited::m_recording_configured = true;
   }
   inherited::conf(args);
@@ -44,12 +85,32 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
       CommandError(ERS_HERE, inherited::m_sourceid, "A recording is still running, no new recording was started!"));
     return;
   }
+  auto params = args.get<readoutconfig::RecordingParams>();
+  if (params.start_timestamp != 0 || params.end_timestamp != 0) {
+    ers::error(CommandError(ERS_HERE,
+                            inherited::m_sourceid,
+                            "Zero-copy recording does not support timestamp ranges, no recording was started!"));
+    return;
+  }
+  // Wrap-arounds stay aligned, and can be written with O_DIRECT, if the ring is a whole number of aligned blocks
+  size_t ring_size = reinterpret_cast<const char*>(inherited::m_latency_buffer->end_of_buffer()) -     // NOLINT
+                     reinterpret_cast<const char*>(inherited::m_latency_buffer->start_of_buffer()); // NOLINT
+  size_t ring_alignment = inherited::m_latency_buffer->get_alignment_size();
+  if (ring_alignment == 0 || ring_size % ring_alignment || ring_size % s_block_size ||
+      inherited::m_stream_buffer_size % s_block_size || (!m_stripe_fds.empty() && m_stripe_size % s_block_size)) {
+    ers::error(CommandError(ERS_HERE,
+                            inherited::m_sourceid,
+                            "Latency buffer, stream buffer and stripe sizes must be multiples of the alignment for "
+                            "zero-copy recording, no recording was started!"));
+    return;
+  }
   inherited::m_recording_thread.set_work(
     [&](int duration) {
       size_t chunk_size = inherited::m_stream_buffer_size;
       size_t alignment_size = inherited::m_latency_buffer->get_alignment_size();
       TLOG() << "Start recording for " << duration << " second(s)" << std::endl;
       inherited::m_recording.exchange(true);
+      inherited::start_recording_throttle();
       auto start_of_recording = std::chrono::high_resolution_clock::now();
       auto current_time = start_of_recording;
       inherited::m_next_timestamp_to_record = 0;
@@ -61,6 +122,29 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
       const char* end_of_buffer_pointer = reinterpret_cast<const char*>(inherited::m_latency_buffer->end_of_buffer()); // NOLINT
 
       size_t bytes_written = 0;
+      m_file_offset = 0;
+      m_write_stall_time = std::chrono::nanoseconds(0);
+      m_stripe_queues.clear();
+      m_queued_writes.clear();
+      for (size_t i = 0; i < m_stripe_fds.size(); ++i) {
+        m_stripe_queues.push_back(std::make_unique<FileWriteQueue>(m_stripe_fds[i], 2, "stripe-" + std::to_string(i)));
+      }
+      m_stripe_bytes.assign(m_stripe_fds.size(), 0);
+      m_current_stripe = 0;
+      m_current_stripe_fill = 0;
+
+      if (m_indexed) {
+        m_index.reset();
+        auto header = recording::make_file_header(static_cast<uint32_t>(inherited::m_sourceid.subsystem), // NOLINT
+                                                  inherited::m_sourceid.id,
+                                                  ReadoutType::fixed_payload_size,
+                                                  m_clock_frequency_hz,
+                                                  chunk_size,
+                                                  "None");
+        if (!write_out(header.data(), header.size())) {
+          ers::warning(CannotWriteToFile(ERS_HERE, inherited::m_output_file));
+        }
+      }
 
       while (std::chrono::duration_cast<std::chrono::seconds>(current_time - start_of_recording).count() < duration) {
         if (!inherited::m_cleanup_requested || (inherited::m_next_timestamp_to_record == 0)) {
@@ -112,7 +196,7 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
             bool failed_write = false;
             if (current_write_pointer + chunk_size < current_end_pointer) {
               // We can write a whole chunk to file
-              failed_write |= !::write(m_fd, current_write_pointer, chunk_size);
+              failed_write |= !write_chunk(current_write_pointer, chunk_size);
               if (!failed_write) {
                 bytes_written += chunk_size;
               }
@@ -120,17 +204,14 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
             } else if (current_end_pointer < current_write_pointer) {
               if (current_write_pointer + chunk_size < end_of_buffer_pointer) {
                 // Write whole chunk to file
-                failed_write |= !::write(m_fd, current_write_pointer, chunk_size);
+                failed_write |= !write_chunk(current_write_pointer, chunk_size);
                 if (!failed_write) {
                   bytes_written += chunk_size;
                 }
                 current_write_pointer += chunk_size;
               } else {
-                // Write the last bit of the buffer without using O_DIRECT as it possibly doesn't fulfill the
-                // alignment requirement
-                fcntl(m_fd, F_SETFL, O_CREAT | O_WRONLY);
-                failed_write |= !::write(m_fd, current_write_pointer, end_of_buffer_pointer - current_write_pointer);
-                fcntl(m_fd, F_SETFL, m_oflag);
+                // Write the last bit of the buffer, a whole number of aligned blocks as the ring is
+                failed_write |= !write_chunk(current_write_pointer, end_of_buffer_pointer - current_write_pointer);
                 if (!failed_write) {
                   bytes_written += end_of_buffer_pointer - current_write_pointer;
                 }
@@ -147,11 +228,13 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
               ers::warning(CannotWriteToFile(ERS_HERE, inherited::m_output_file));
             }
             considered_chunks_in_loop++;
-            // This expression is "a bit" complicated as it finds the last frame that was written to file completely
+            // This expression is "a bit" complicated as it finds the last frame that was written to file completely.
+            // Queued stripe writes still read from the latency buffer, so it stops at the oldest of them.
             inherited::m_next_timestamp_to_record =
               reinterpret_cast<const ReadoutType*>( // NOLINT
                 start_of_buffer_pointer +
-                (((current_write_pointer - start_of_buffer_pointer) / ReadoutType::fixed_payload_size) *
+                (((oldest_unwritten(current_write_pointer) - start_of_buffer_pointer) /
+                  ReadoutType::fixed_payload_size) *
                  ReadoutType::fixed_payload_size))
                 ->get_first_timestamp();
           }
@@ -166,24 +249,167 @@ ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::record(con
           (((current_write_pointer - start_of_buffer_pointer) / ReadoutType::fixed_payload_size) *
            ReadoutType::fixed_payload_size);
         if (last_started_frame != current_write_pointer) {
-          fcntl(m_fd, F_SETFL, O_CREAT | O_WRONLY);
-          if (!::write(m_fd,
-                       current_write_pointer,
-                       (last_started_frame + ReadoutType::fixed_payload_size) - current_write_pointer)) {
+          if (!write_chunk(current_write_pointer,
+                           (last_started_frame + ReadoutType::fixed_payload_size) - current_write_pointer)) {
             ers::warning(CannotWriteToFile(ERS_HERE, inherited::m_output_file));
           } else {
             bytes_written += (last_started_frame + ReadoutType::fixed_payload_size) - current_write_pointer;
           }
         }
       }
+      if (m_indexed && !finish_index()) {
+        ers::warning(CannotWriteToFile(ERS_HERE, inherited::m_output_file));
+      }
+      if (!m_stripe_fds.empty() && !wait_stripes()) {
+        ers::warning(CannotWriteToFile(ERS_HERE, inherited::m_output_file));
+      }
+      m_stripe_queues.clear();
+      for (int fd : m_stripe_fds) {
+        ::close(fd);
+      }
       ::close(m_fd);
 
       inherited::m_next_timestamp_to_record = std::numeric_limits<uint64_t>::max(); // NOLINT (build/unsigned)
 
-      TLOG() << "Stopped recording, wrote " << bytes_written << " bytes";
+      inherited::report_recording(bytes_written,
+                                  std::chrono::high_resolution_clock::now() - start_of_recording,
+                                  m_write_stall_time);
       inherited::m_recording.exchange(false);
     },
-    args.get<readoutconfig::RecordingParams>().duration);
+    params.duration);
+}
+
+template<class ReadoutType, class LatencyBufferType>
+bool
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::write_out(const char* data, size_t size)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto written = ::write(m_fd, data, size);
+  m_write_stall_time += std::chrono::steady_clock::now() - start;
+  if (written != static_cast<ssize_t>(size)) {
+    return false;
+  }
+  m_file_offset += size;
+  return true;
+}
+
+template<class ReadoutType, class LatencyBufferType>
+bool
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::write_chunk(const char* chunk, size_t size)
+{
+  inherited::throttle_recording(size);
+  bool ok = true;
+  if (m_indexed) {
+    auto header = recording::make_record_header(recording::kDataRecord, s_block_size, size, s_block_size);
+
+    // Elements do not span the end of the latency buffer, so they start at multiples of their size from its start
+    const char* start_of_buffer = reinterpret_cast<const char*>(inherited::m_latency_buffer->start_of_buffer()); // NOLINT
+    size_t element_size = ReadoutType::fixed_payload_size;
+    size_t first_offset = (element_size - (chunk - start_of_buffer) % element_size) % element_size;
+    header.first_element_offset = first_offset;
+    if (first_offset < size) {
+      const char* last_element = start_of_buffer + (chunk + size - 1 - start_of_buffer) / element_size * element_size;
+      header.first_timestamp = reinterpret_cast<const ReadoutType*>(chunk + first_offset)->get_first_timestamp(); // NOLINT
+      header.last_timestamp = reinterpret_cast<const ReadoutType*>(last_element)->get_first_timestamp();       // NOLINT
+      m_index.add({ header.first_timestamp, header.last_timestamp, m_file_offset, size });
+    }
+    m_bounce_buffer.assign(s_block_size, 0);
+    std::memcpy(m_bounce_buffer.data(), &header, sizeof(header));
+    ok = write_out(m_bounce_buffer.data(), s_block_size);
+  }
+
+  size_t direct_size = size / s_block_size * s_block_size;
+  if (ok && direct_size > 0) {
+    ok = m_stripe_fds.empty() ? write_out(chunk, direct_size) : write_stripes(chunk, direct_size);
+  }
+  size_t tail = size - direct_size;
+  if (ok && tail > 0) {
+    // Only the last frame of a recording ends off a block boundary. It goes through the bounce buffer, zero padded
+    // to a whole block, so that O_DIRECT stays on. In raw files the padding is cut off again.
+    m_bounce_buffer.assign(s_block_size, 0);
+    std::memcpy(m_bounce_buffer.data(), chunk + direct_size, tail);
+    if (!m_stripe_fds.empty()) {
+      // Appended to the current stripe once the queued writes are done
+      int fd = m_stripe_fds[m_current_stripe];
+      ok = wait_stripes() && ::write(fd, m_bounce_buffer.data(), s_block_size) == static_cast<ssize_t>(s_block_size);
+      m_stripe_bytes[m_current_stripe] += tail;
+      ok = ok && ::ftruncate(fd, m_stripe_bytes[m_current_stripe]) == 0;
+    } else {
+      ok = write_out(m_bounce_buffer.data(), s_block_size);
+    }
+    if (ok && !m_indexed && m_stripe_fds.empty()) {
+      m_file_offset -= s_block_size - tail;
+      ok = ::ftruncate(m_fd, m_file_offset) == 0;
+    }
+  }
+
+  if (ok && m_indexed && m_index.num_pending() >= m_index_interval) {
+    auto index = m_index.make_index_record(m_file_offset);
+    ok = write_out(index.data(), index.size());
+  }
+  return ok;
+}
+
+template<class ReadoutType, class LatencyBufferType>
+bool
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::write_stripes(const char* data, size_t size)
+{
+  bool ok = true;
+  while (size > 0) {
+    size_t n = std::min(size, m_stripe_size - m_current_stripe_fill);
+    auto start = std::chrono::steady_clock::now();
+    m_queued_writes.push_back({ m_current_stripe, m_stripe_queues[m_current_stripe]->get_num_submitted(), data });
+    ok = m_stripe_queues[m_current_stripe]->submit(data, n) && ok;
+    m_write_stall_time += std::chrono::steady_clock::now() - start;
+    m_stripe_bytes[m_current_stripe] += n;
+    data += n;
+    size -= n;
+    m_current_stripe_fill += n;
+    if (m_current_stripe_fill == m_stripe_size) {
+      m_current_stripe = (m_current_stripe + 1) % m_stripe_queues.size();
+      m_current_stripe_fill = 0;
+    }
+  }
+  return ok;
+}
+
+template<class ReadoutType, class LatencyBufferType>
+bool
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::wait_stripes()
+{
+  auto start = std::chrono::steady_clock::now();
+  bool ok = true;
+  for (auto& queue : m_stripe_queues) {
+    ok = queue->wait_all() && ok;
+  }
+  m_queued_writes.clear();
+  m_write_stall_time += std::chrono::steady_clock::now() - start;
+  return ok;
+}
+
+template<class ReadoutType, class LatencyBufferType>
+const char*
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::oldest_unwritten(const char* write_pointer)
+{
+  // Writes to different stripes complete out of order: only the oldest one counts
+  while (!m_queued_writes.empty() &&
+         m_stripe_queues[m_queued_writes.front().stripe]->get_num_done() > m_queued_writes.front().sequence) {
+    m_queued_writes.pop_front();
+  }
+  return m_queued_writes.empty() ? write_pointer : m_queued_writes.front().data;
+}
+
+template<class ReadoutType, class LatencyBufferType>
+bool
+ZeroCopyRecordingRequestHandlerModel<ReadoutType, LatencyBufferType>::finish_index()
+{
+  bool ok = true;
+  if (m_index.num_pending() > 0) {
+    auto index = m_index.make_index_record(m_file_offset);
+    ok = write_out(index.data(), index.size());
+  }
+  auto trailer = m_index.make_trailer_record(m_file_offset, s_block_size);
+  return write_out(trailer.data(), trailer.size()) && ok;
 }
 
 } // namespace readoutlibs
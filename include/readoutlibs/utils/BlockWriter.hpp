@@ -0,0 +1,56 @@
+/**
+ * @file BlockWriter.hpp Interface of the block-oriented write backends of
+ * the BufferedFileWriter
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_BLOCKWRITER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_BLOCKWRITER_HPP_
+
+#include "readoutlibs/utils/LatencyHistogram.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+// Statistics filled by the block writers. Owned by the caller so that they can be read at any time.
+struct BlockWriterStats
+{
+  std::atomic<uint64_t> num_buffer_waits{ 0 }; // NOLINT(build/unsigned) acquire() calls that found no free buffer
+  std::atomic<uint64_t> buffer_wait_time{ 0 }; // NOLINT(build/unsigned) time spent waiting for a free buffer, in us
+  LatencyHistogram write_latency;              // from submission to completion of a write, in us
+};
+
+/**
+ * A pool of aligned buffers of a fixed size, written to a file asynchronously. The caller fills a buffer obtained
+ * with acquire() and hands it over with submit(), together with the file offset to write it at. The backend puts
+ * the buffer back into the pool once it has been written. Buffers in the pool keep their contents until they are
+ * acquired again.
+ */
+class BlockWriter
+{
+public:
+  virtual ~BlockWriter() = default;
+
+  // A free buffer. Waits if all buffers are being written.
+  virtual char* acquire() = 0;
+
+  // Write size bytes of an acquired buffer at the given offset of the file
+  virtual void submit(char* buffer, size_t size, uint64_t offset) = 0; // NOLINT(build/unsigned)
+
+  // Wait until all submitted buffers are written. Returns false if any write failed.
+  virtual bool wait_all() = 0;
+
+  // Whether any write failed so far
+  virtual bool failed() const = 0;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_BLOCKWRITER_HPP_
@@ -11,6 +11,16 @@
 
 #include "readoutlibs/ReadoutIssues.hpp"
 #include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/DirectFileSource.hpp"
+#include "readoutlibs/utils/ParallelZstdDecompressor.hpp"
+#include "readoutlibs/utils/PrefetchingReader.hpp"
+#include "readoutlibs/utils/RecordingFileReader.hpp"
+#include "readoutlibs/utils/RecordingFormat.hpp"
+#include "readoutlibs/utils/StripeManifest.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+#ifdef WITH_LZ4_SUPPORT
+#include "readoutlibs/utils/Lz4Filter.hpp"
+#endif
 
 #include "logging/Logging.hpp"
 
@@ -23,17 +33,46 @@
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
 
 namespace dunedaq {
 namespace readoutlibs {
+
+/**
+ * Settings of a BufferedFileReader.
+ * io_backend selects how the file is read: "stream" reads and decompresses it on the calling thread, through the page
+ * cache. "prefetch" reads it on a background thread, up to io_queue_depth buffers of buffer_size ahead of the reads,
+ * which then only copy out of those buffers. Decompression also runs on that thread. Prefetching starts as soon as
+ * the file is opened, so the file should be complete by then. With use_o_direct, the file is read with O_DIRECT,
+ * bypassing the page cache, if the file system supports it. Indexed recordings are always read with the stream
+ * backend.
+ * See BufferedFileReader::open for the compression settings.
+ */
+struct BufferedFileReaderOptions
+{
+  size_t buffer_size = 8388608;
+  std::string compression_algorithm = "None";
+  size_t decompression_threads = 0;
+  std::string compression_dictionary;
+  std::string io_backend = "stream";
+  size_t io_queue_depth = 4;
+  bool use_o_direct = true;
+};
+
 /**
  * Class to read data of a specified type in a buffered manner.
  * @tparam ReadoutType Type of the data that is read from the file.
@@ -52,20 +91,38 @@ public:
    * Constructor to construct and initalize an instance. The file will be open after initialization.
    * @param filename The file to be used.
    * @param buffer_size The size of the buffer to be used.
-   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lzma or zlib
+   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lz4, lzma or zlib
+   * @param decompression_threads With zstd, the number of threads decompressing frames in parallel. 0 decompresses
+   * on the calling thread.
+   * @param compression_dictionary With zstd, the dictionary file the data was compressed with.
    * @throw CannotOpenFile If the file can not be opened.
    * @throw ConfigurationError If the compression algorithm parameter is not recognized.
    */
-  BufferedFileReader(std::string filename, size_t buffer_size, std::string compression_algorithm = "None")
+  BufferedFileReader(std::string filename,
+                     size_t buffer_size,
+                     std::string compression_algorithm = "None",
+                     size_t decompression_threads = 0,
+                     const std::string& compression_dictionary = "")
   {
-    open(filename, buffer_size, compression_algorithm);
+    open(filename, buffer_size, compression_algorithm, decompression_threads, compression_dictionary);
   }
 
+  /**
+   * Constructor to construct and initalize an instance. The file will be open after initialization.
+   * @param filename The file to be used.
+   * @param options The reader settings.
+   * @throw CannotOpenFile If the file can not be opened.
+   * @throw ConfigurationError If the options are not valid.
+   */
+  BufferedFileReader(std::string filename, const BufferedFileReaderOptions& options) { open(filename, options); }
+
   /**
    * Constructor to construct and instance without opening a file.
    */
   BufferedFileReader() {}
 
+  ~BufferedFileReader() { close(); }
+
   BufferedFileReader(const BufferedFileReader&) = delete;            ///< BufferedFileReader is not copy-constructible
   BufferedFileReader& operator=(const BufferedFileReader&) = delete; ///< BufferedFileReader is not copy-assginable
   BufferedFileReader(BufferedFileReader&&) = delete;                 ///< BufferedFileReader is not move-constructible
@@ -75,25 +132,142 @@ public:
    * Open a file.
    * @param filename The file to be used.
    * @param buffer_size The size of the buffer to be used.
-   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lzma or zlib
+   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lz4, lzma or zlib
+   * @param decompression_threads With zstd, the number of threads decompressing frames in parallel. 0 decompresses
+   * on the calling thread. Only files written with parallel compression have several frames to work on.
+   * @param compression_dictionary With zstd, the dictionary file the data was compressed with. Data is then
+   * decompressed as with decompression_threads of at least 1.
+   * Files in the indexed recording format are detected from their header, which also gives their compression. If the
+   * file is a stripe manifest, the stripes it lists are read in turn, with the compression given in the manifest.
    * @throw CannotOpenFile If the file can not be opened.
    * @throw ConfigurationError If the compression algorithm parameter is not recognized.
    */
-  void open(std::string filename, size_t buffer_size, std::string compression_algorithm = "None")
+  void open(std::string filename,
+            size_t buffer_size,
+            std::string compression_algorithm = "None",
+            size_t decompression_threads = 0,
+            const std::string& compression_dictionary = "")
+  {
+    BufferedFileReaderOptions options;
+    options.buffer_size = buffer_size;
+    options.compression_algorithm = compression_algorithm;
+    options.decompression_threads = decompression_threads;
+    options.compression_dictionary = compression_dictionary;
+    open(filename, options);
+  }
+
+  /**
+   * Open a file with the given settings.
+   * @param filename The file to be used.
+   * @param options The reader settings.
+   * @throw CannotOpenFile If the file can not be opened.
+   * @throw ConfigurationError If the options are not valid.
+   */
+  void open(std::string filename, const BufferedFileReaderOptions& options)
   {
     m_filename = filename;
-    m_buffer_size = buffer_size;
-    m_compression_algorithm = compression_algorithm;
+    m_buffer_size = options.buffer_size;
+    m_compression_algorithm = options.compression_algorithm;
+    size_t decompression_threads = options.decompression_threads;
+    if (decompression_threads > 0 && m_compression_algorithm != "zstd") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                   "Parallel decompression is only supported with zstd, not " +
+                                                     m_compression_algorithm);
+    }
+    if (options.io_backend != "stream" && options.io_backend != "prefetch") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Non-recognized I/O backend: " + options.io_backend);
+    }
+    std::shared_ptr<const ZstdDictionary> dictionary;
+    if (!options.compression_dictionary.empty()) {
+      dictionary = std::make_shared<ZstdDictionary>(ZstdDictionary::read(options.compression_dictionary));
+    }
 
     int fd = ::open(m_filename.c_str(), O_RDONLY);
     if (fd == -1) {
       throw BufferedReaderWriterCannotOpenFile(ERS_HERE, m_filename);
     }
 
-    io_source_t io_source(fd, boost::iostreams::file_descriptor_flags::close_handle);
+    char magic[16];
+    auto magic_size = ::pread(fd, magic, sizeof(magic), 0);
+    if (magic_size > 0 && StripeManifest::is_manifest(magic, magic_size)) {
+      ::close(fd);
+      auto manifest = StripeManifest::read(m_filename);
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Reading a recording striped over " << manifest.stripes.size() << " files";
+      auto stripe_options = options;
+      stripe_options.compression_algorithm = manifest.compression_algorithm;
+      for (auto& stripe : manifest.stripes) {
+        m_stripes.push_back(std::make_unique<BufferedFileReader<char, Alignment>>(stripe, stripe_options));
+      }
+      m_stripe_size = manifest.stripe_size;
+      m_current_stripe = 0;
+      m_current_stripe_fill = 0;
+      m_has_pending = false;
+      m_is_open = true;
+      return;
+    }
+    if (magic_size > 0 && recording::is_recording_file_header(magic, magic_size)) {
+      m_recording_reader = std::make_unique<RecordingFileReader>(fd, dictionary);
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Reading an indexed recording with codec " << m_recording_reader->get_header().codec
+                                  << std::endl;
+      m_has_pending = false;
+      m_is_open = true;
+      return;
+    }
+
+    // With prefetching, the file is read in aligned chunks, which allows O_DIRECT
+    io_source_t io_source;
+    if (options.io_backend == "prefetch") {
+      int direct_fd = options.use_o_direct ? ::open(m_filename.c_str(), O_RDONLY | O_DIRECT) : -1;
+      if (direct_fd != -1) {
+        ::close(fd);
+        fd = direct_fd;
+      } else if (options.use_o_direct) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Could not open " << m_filename
+                                    << " with O_DIRECT, prefetching through the page cache";
+      }
+      m_direct_source = std::make_unique<DirectFileSource>(fd, m_buffer_size, Alignment);
+    } else {
+      io_source.open(fd, boost::iostreams::file_descriptor_flags::close_handle);
+    }
+    auto push_source = [&] {
+      if (m_direct_source) {
+        m_input_stream.push(*m_direct_source, m_buffer_size);
+      } else {
+        m_input_stream.push(io_source, m_buffer_size);
+      }
+    };
+
+    if (dictionary && m_compression_algorithm != "zstd") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                   "Compression dictionaries are only supported with zstd, not " +
+                                                     m_compression_algorithm);
+    }
+    if (decompression_threads > 0 || dictionary) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Using zstd compression, decompressed on " << decompression_threads << " threads"
+                                  << std::endl;
+      push_source();
+      m_decompressor = std::make_unique<ParallelZstdDecompressor>(
+        std::max<size_t>(decompression_threads, 1),
+        m_buffer_size,
+        [this](char* data, size_t size) {
+          m_input_stream.read(data, size);
+          return static_cast<size_t>(m_input_stream.gcount());
+        },
+        dictionary);
+      start_prefetching(options);
+      m_is_open = true;
+      return;
+    }
     if (m_compression_algorithm == "zstd") {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Using zstd compression" << std::endl;
       m_input_stream.push(boost::iostreams::zstd_decompressor());
+    } else if (m_compression_algorithm == "lz4") {
+#ifdef WITH_LZ4_SUPPORT
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Using lz4 compression" << std::endl;
+      m_input_stream.push(Lz4Decompressor());
+#else
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "readoutlibs was built without lz4 support");
+#endif
     } else if (m_compression_algorithm == "lzma") {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Using lzma compression" << std::endl;
       m_input_stream.push(boost::iostreams::lzma_decompressor());
@@ -107,7 +281,62 @@ public:
                                                    "Non-recognized compression algorithm: " + m_compression_algorithm);
     }
 
-    m_input_stream.push(io_source, m_buffer_size);
+    // Uncompressed data is prefetched straight from the file into the prefetch buffers
+    if (!m_direct_source || m_compression_algorithm != "None") {
+      push_source();
+    }
+    start_prefetching(options);
+    m_is_open = true;
+  }
+
+  /**
+   * Open an uncompressed raw file by mapping it into memory, instead of reading it through a stream. read_mapped then
+   * hands out elements in place, without copying them; read and read_n copy from the mapping. The kernel is told that
+   * the file is read sequentially, and the next readahead_size bytes are requested ahead of the reads.
+   * @param filename The file to be used.
+   * @param readahead_size The number of bytes to request ahead of the current position.
+   * @throw CannotOpenFile If the file can not be opened or mapped.
+   * @throw ConfigurationError If the file is an indexed recording or a stripe manifest.
+   */
+  void open_mapped(std::string filename, size_t readahead_size = 67108864)
+  {
+    m_filename = filename;
+    m_buffer_size = readahead_size;
+    m_compression_algorithm = "None";
+
+    int fd = ::open(m_filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd == -1 || ::fstat(fd, &st) != 0) {
+      if (fd != -1) {
+        ::close(fd);
+      }
+      throw BufferedReaderWriterCannotOpenFile(ERS_HERE, m_filename);
+    }
+    char magic[16];
+    auto magic_size = ::pread(fd, magic, sizeof(magic), 0);
+    if (magic_size > 0 &&
+        (StripeManifest::is_manifest(magic, magic_size) || recording::is_recording_file_header(magic, magic_size))) {
+      ::close(fd);
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Only raw recordings can be mapped: " + m_filename);
+    }
+    if (st.st_size > 0) {
+      void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map == MAP_FAILED) {
+        ::close(fd);
+        throw BufferedReaderWriterCannotOpenFile(ERS_HERE, m_filename);
+      }
+      m_map = static_cast<char*>(map);
+      m_map_size = st.st_size;
+      ::madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+    }
+    ::close(fd); // the mapping keeps the file open
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Mapped " << m_map_size << " bytes of " << m_filename << std::endl;
+
+    m_map_pos = 0;
+    m_readahead_end = 0;
+    advise_readahead();
+    m_mapped = true;
+    m_has_pending = false;
     m_is_open = true;
   }
 
@@ -122,14 +351,117 @@ public:
   /**
    * Read one element from the file.
    * @param element Reference to the element that will contain the value that was read.
-   * @return true if the read was successful, false if the reader is not open or the read was not successful.
+   * @return true if the read was successful, false if the reader is not open or the read was not successful. See
+   * failed for whether the end of the file or an error was reached.
    */
   bool read(ReadoutType& element)
   {
     if (!m_is_open)
       return false;
-    m_input_stream.read(reinterpret_cast<char*>(&element), sizeof(element)); // NOLINT
-    return (m_input_stream.gcount() == sizeof(element));
+    if (m_has_pending) {
+      element = m_pending;
+      m_has_pending = false;
+      return true;
+    }
+    return read(reinterpret_cast<char*>(&element), sizeof(element)) == sizeof(element); // NOLINT
+  }
+
+  /**
+   * Read up to count elements from the file with a single read, which is much cheaper than reading them one by one.
+   * @return The number of elements read, less than count only at the end of the file or on an error.
+   */
+  size_t read_n(ReadoutType* elements, size_t count)
+  {
+    if (!m_is_open || count == 0)
+      return 0;
+    size_t done = 0;
+    if (m_has_pending) {
+      elements[0] = m_pending;
+      m_has_pending = false;
+      done = 1;
+    }
+    size_t size = (count - done) * sizeof(ReadoutType);
+    return done + read(reinterpret_cast<char*>(elements + done), size) / sizeof(ReadoutType); // NOLINT
+  }
+
+  /**
+   * Hand out up to max_count elements in place, from a file opened with open_mapped. The elements stay valid until
+   * the reader is closed.
+   * @param elements Set to the first element handed out.
+   * @return The number of elements handed out, 0 at the end of the file or if the file is not mapped.
+   */
+  size_t read_mapped(const ReadoutType*& elements, size_t max_count)
+  {
+    if (!m_is_open || !m_mapped)
+      return 0;
+    size_t count = std::min(max_count, (m_map_size - m_map_pos) / sizeof(ReadoutType));
+    elements = reinterpret_cast<const ReadoutType*>(m_map + m_map_pos); // NOLINT
+    m_map_pos += count * sizeof(ReadoutType);
+    advise_readahead();
+    return count;
+  }
+
+  /**
+   * Read bytes from the file, regardless of element boundaries.
+   * @return The number of bytes read, less than size only at the end of the file or on an error.
+   */
+  size_t read(char* destination, size_t size)
+  {
+    if (!m_is_open)
+      return 0;
+    if (m_mapped) {
+      size = std::min(size, m_map_size - m_map_pos);
+      std::memcpy(destination, m_map + m_map_pos, size);
+      m_map_pos += size;
+      advise_readahead();
+      return size;
+    }
+    if (!m_stripes.empty()) {
+      return read_stripes(destination, size);
+    }
+    if (m_recording_reader) {
+      return m_recording_reader->read(destination, size);
+    }
+    if (m_prefetcher) {
+      return m_prefetcher->read(destination, size);
+    }
+    return read_input(destination, size);
+  }
+
+  /**
+   * Check why the reads came short: the data may be truncated or corrupt, or the file may not be readable, rather
+   * than at its end.
+   * @return true if the reads stopped because of an error.
+   */
+  bool failed() const
+  {
+    if (!m_stripes.empty()) {
+      return std::any_of(m_stripes.begin(), m_stripes.end(), [](const auto& stripe) { return stripe->failed(); });
+    }
+    return m_input_failed || (m_decompressor && m_decompressor->failed()) || (m_prefetcher && m_prefetcher->failed()) ||
+           (m_recording_reader && m_recording_reader->failed());
+  }
+
+  /**
+   * Position the reader on the first element with a timestamp at or after the given one. Only files in the indexed
+   * recording format can be searched; the index is loaded on the first call.
+   * @return true if such an element was found, false otherwise or if the file is not indexed.
+   */
+  bool seek_to_timestamp(uint64_t timestamp) // NOLINT(build/unsigned)
+  {
+    m_has_pending = false;
+    if (!m_is_open || !m_recording_reader || !m_recording_reader->seek_to_record(timestamp)) {
+      return false;
+    }
+    ReadoutType element;
+    while (m_recording_reader->read(reinterpret_cast<char*>(&element), sizeof(element)) == sizeof(element)) { // NOLINT
+      if (element.get_first_timestamp() >= timestamp) {
+        m_pending = element;
+        m_has_pending = true;
+        return true;
+      }
+    }
+    return false;
   }
 
   /**
@@ -137,11 +469,92 @@ public:
    */
   void close()
   {
+    if (m_prefetcher) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Reads waited for prefetching " << m_prefetcher->get_num_stalls() << " times";
+    }
+    m_prefetcher.reset(); // first, as it reads from the stream
+    m_stripes.clear();
+    m_recording_reader.reset();
+    m_has_pending = false;
+    m_input_failed = false;
+    m_decompressor.reset();
     m_input_stream.reset();
+    m_direct_source.reset();
+    unmap();
     m_is_open = false;
   }
 
 private:
+  void start_prefetching(const BufferedFileReaderOptions& options)
+  {
+    if (options.io_backend != "prefetch") {
+      return;
+    }
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "Prefetching " << options.io_queue_depth << " buffers ahead" << std::endl;
+    m_prefetcher = std::make_unique<PrefetchingReader>(
+      options.io_queue_depth, m_buffer_size, Alignment, [this](char* data, size_t size) { return read_input(data, size); });
+  }
+
+  // Read from the decompressor or the stream. Called from the prefetching thread if there is one.
+  size_t read_input(char* destination, size_t size)
+  {
+    if (m_decompressor) {
+      return m_decompressor->read(destination, size);
+    }
+    if (m_input_stream.empty()) {
+      auto got = m_direct_source->read(destination, size);
+      return got > 0 ? got : 0;
+    }
+    m_input_stream.read(destination, size);
+    if (m_input_stream.bad()) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Reading " << m_filename << " failed";
+      m_input_failed = true;
+    }
+    return m_input_stream.gcount();
+  }
+
+  // Ask the kernel for the next readahead window once half of the current one is consumed
+  void advise_readahead()
+  {
+    if (m_readahead_end >= m_map_size || m_map_pos + m_buffer_size / 2 < m_readahead_end) {
+      return;
+    }
+    static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    size_t begin = m_readahead_end / page_size * page_size;
+    m_readahead_end = std::min(m_map_pos + m_buffer_size, m_map_size);
+    ::madvise(m_map + begin, m_readahead_end - begin, MADV_WILLNEED);
+  }
+
+  void unmap()
+  {
+    if (m_map) {
+      ::munmap(m_map, m_map_size);
+    }
+    m_map = nullptr;
+    m_map_size = 0;
+    m_map_pos = 0;
+    m_mapped = false;
+  }
+
+  size_t read_stripes(char* destination, size_t size)
+  {
+    size_t copied = 0;
+    while (copied < size) {
+      size_t n = std::min(size - copied, m_stripe_size - m_current_stripe_fill);
+      size_t got = m_stripes[m_current_stripe]->read(destination + copied, n);
+      copied += got;
+      m_current_stripe_fill += got;
+      if (m_current_stripe_fill == m_stripe_size) {
+        m_current_stripe = (m_current_stripe + 1) % m_stripes.size();
+        m_current_stripe_fill = 0;
+      }
+      if (got < n) {
+        break;
+      }
+    }
+    return copied;
+  }
+
   // Config parameters
   std::string m_filename;
   size_t m_buffer_size;
@@ -149,7 +562,23 @@ private:
 
   // Internals
   filtering_istream_t m_input_stream;
+  std::unique_ptr<ParallelZstdDecompressor> m_decompressor;
+  std::unique_ptr<DirectFileSource> m_direct_source;
+  std::unique_ptr<RecordingFileReader> m_recording_reader;
+  std::vector<std::unique_ptr<BufferedFileReader<char, Alignment>>> m_stripes;
+  size_t m_stripe_size = 0;
+  size_t m_current_stripe = 0;
+  size_t m_current_stripe_fill = 0;
+  bool m_mapped = false;
+  char* m_map = nullptr;
+  size_t m_map_size = 0;
+  size_t m_map_pos = 0;
+  size_t m_readahead_end = 0;
+  ReadoutType m_pending; // element found by seek_to_timestamp, returned by the next read
+  bool m_has_pending = false;
   bool m_is_open = false;
+  std::atomic<bool> m_input_failed{ false }; // set on the prefetching thread if there is one
+  std::unique_ptr<PrefetchingReader> m_prefetcher; // last, so that it stops before what it reads from is destroyed
 };
 
 } // namespace readoutlibs
@@ -13,6 +13,14 @@
 
 #include "readoutlibs/ReadoutIssues.hpp"
 #include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/BlockWriter.hpp"
+#include "readoutlibs/utils/IoUringBlockWriter.hpp"
+#include "readoutlibs/utils/ParallelZstdCompressor.hpp"
+#include "readoutlibs/utils/ThreadedBlockWriter.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+#ifdef WITH_LZ4_SUPPORT
+#include "readoutlibs/utils/Lz4Filter.hpp"
+#endif
 
 #include "logging/Logging.hpp"
 
@@ -25,17 +33,53 @@
 #include <boost/iostreams/stream.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <cstring>
 #include <limits>
+#include <memory>
 #include <string>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
 
 namespace dunedaq {
 namespace readoutlibs {
+
+/**
+ * Settings of a BufferedFileWriter.
+ * io_backend selects how buffers are written: "stream" writes them synchronously through boost::iostreams. The block
+ * backends fill io_queue_depth aligned buffers in turn and write them in the background: "threaded" from an I/O
+ * thread, "io_uring" with several writes in flight (needs WITH_LIBURING_SUPPORT). "direct" writes synchronously with
+ * pwrite: writes of at least buffer_size bytes go straight from the caller's memory if it is aligned, anything else
+ * is staged in an aligned buffer.
+ * With zstd, compression_threads > 0 compresses chunks of buffer_size into independent frames on that many threads,
+ * which also works with the block backends. Otherwise compression runs on the calling thread, with the stream backend
+ * only. compression_level applies to zstd either way, and to lz4 (3 and above is LZ4 HC).
+ * compression_dictionary is a zstd dictionary file, e.g. trained with readoutlibs_train_zstd_dictionary. Data is then
+ * compressed as with compression_threads of at least 1, and needs the same dictionary to be read back.
+ * block_stats, if set, is filled instead of the writer's own statistics, e.g. to share them between several writers.
+ */
+struct BufferedFileWriterOptions
+{
+  size_t buffer_size = 8388608;
+  std::string compression_algorithm = "None";
+  bool use_o_direct = true;
+  std::string io_backend = "stream";
+  size_t io_queue_depth = 4;
+  size_t compression_threads = 0;
+  int compression_level = 1;
+  std::string compression_dictionary;
+  BlockWriterStats* block_stats = nullptr;
+};
+
 /**
  * Class to buffer and write data of a specified type to a file using O_DIRECT. In addition, data can be compressed.
  * before being written.
@@ -58,7 +102,7 @@ public:
    * created.
    * @param buffer_size The size of the buffer that is used before data is written to the file. Make sure that this
    * size fulfils size requirements of O_DIRECT, otherwise writes will fail.
-   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lzma or zlib
+   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lz4, lzma or zlib
    * @param use_o_direct file descriptors : avoid excessive resource footprint. It also avoids the intermediate aligned buffer, requires the source latency buffer to be memory aligned.
    * @throw CannotOpenFile If the file can not be opened.
    * @throw ConfigurationError If the compression algorithm parameter is not recognized.
@@ -93,7 +137,7 @@ public:
    * created.
    * @param buffer_size The size of the buffer that is used before data is written to the file. Make sure that this
    * size fulfils size requirements of O_DIRECT, otherwise writes will fail.
-   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lzma or zlib
+   * @param compression_algorithm The compression algorithm to use. Can be one of: None, zstd, lz4, lzma or zlib
    * @param use_o_direct file descriptors : avoid excessive resource footprint. It also avoids the intermediate aligned buffer, requires the source latency buffer to be memory aligned.
    * @throw CannotOpenFile If the file can not be opened.
    * @throw ConfigurationError If the compression algorithm parameter is not recognized.
@@ -103,14 +147,66 @@ public:
             std::string compression_algorithm = "None",
             bool use_o_direct = true)
   {
-    m_use_o_direct = use_o_direct;
+    BufferedFileWriterOptions options;
+    options.buffer_size = buffer_size;
+    options.compression_algorithm = compression_algorithm;
+    options.use_o_direct = use_o_direct;
+    open(filename, options);
+  }
+
+  /**
+   * Open a file with the given settings.
+   * @throw CannotOpenFile If the file can not be opened.
+   * @throw ConfigurationError If the compression algorithm or the I/O backend is not recognized or not supported, or
+   * if the buffer size does not fit the alignment required by a block backend.
+   */
+  void open(std::string filename, const BufferedFileWriterOptions& options)
+  {
+    m_use_o_direct = options.use_o_direct;
     if (m_is_open) {
       close();
     }
 
     m_filename = filename;
-    m_buffer_size = buffer_size;
-    m_compression_algorithm = compression_algorithm;
+    m_buffer_size = options.buffer_size;
+    m_compression_algorithm = options.compression_algorithm;
+    std::shared_ptr<const ZstdDictionary> dictionary;
+    if (!options.compression_dictionary.empty()) {
+      if (m_compression_algorithm != "zstd") {
+        throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                     "Compression dictionaries are only supported with zstd, not " +
+                                                       m_compression_algorithm);
+      }
+      dictionary = std::make_shared<ZstdDictionary>(ZstdDictionary::read(options.compression_dictionary));
+    }
+    // The boost zstd filter takes no dictionary, so dictionary compression goes through the parallel compressor
+    bool parallel_compression = options.compression_threads > 0 || dictionary;
+    if (parallel_compression && m_compression_algorithm != "zstd") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                   "Parallel compression is only supported with zstd, not " +
+                                                     m_compression_algorithm);
+    }
+    if (options.io_backend != "stream") {
+      if (options.io_backend != "threaded" && options.io_backend != "io_uring" && options.io_backend != "direct") {
+        throw BufferedReaderWriterConfigurationError(ERS_HERE, "Non-recognized I/O backend: " + options.io_backend);
+      }
+      if (m_compression_algorithm != "None" && !parallel_compression) {
+        throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                     "Compression is not supported with the " + options.io_backend +
+                                                       " I/O backend");
+      }
+      if (m_buffer_size == 0 || m_buffer_size % Alignment != 0) {
+        throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                     "The buffer size must be a multiple of " +
+                                                       std::to_string(Alignment) + " with the " + options.io_backend +
+                                                       " I/O backend");
+      }
+#ifndef WITH_LIBURING_SUPPORT
+      if (options.io_backend == "io_uring") {
+        throw BufferedReaderWriterConfigurationError(ERS_HERE, "readoutlibs was built without io_uring support");
+      }
+#endif
+    }
     auto oflag = O_CREAT | O_WRONLY;
     if (m_use_o_direct) {
       oflag = oflag | O_DIRECT;
@@ -121,10 +217,68 @@ public:
       throw BufferedReaderWriterCannotOpenFile(ERS_HERE, m_filename);
     }
 
-    m_sink = io_sink_t(m_fd, boost::iostreams::file_descriptor_flags::close_handle);
+    m_stats = options.block_stats != nullptr ? options.block_stats : &m_block_stats;
+    m_direct = options.io_backend == "direct";
+    if (m_direct) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Writing directly to the file descriptor";
+      m_stage.resize(m_buffer_size);
+      m_stage_fill = 0;
+      m_file_offset = 0;
+    } else if (options.io_backend != "stream") {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Using the " << options.io_backend << " backend with " << options.io_queue_depth
+                                  << " buffers";
+      try {
+        if (options.io_backend == "threaded") {
+          m_block_writer = std::make_unique<ThreadedBlockWriter>(
+            m_fd, options.io_queue_depth, m_buffer_size, Alignment, *m_stats);
+        }
+#ifdef WITH_LIBURING_SUPPORT
+        if (options.io_backend == "io_uring") {
+          m_block_writer = std::make_unique<IoUringBlockWriter>(
+            m_fd, options.io_queue_depth, m_buffer_size, Alignment, *m_stats);
+        }
+#endif
+      } catch (...) {
+        ::close(m_fd);
+        throw;
+      }
+      m_block_offset = 0;
+      m_block_fill = 0;
+      m_block = nullptr;
+    } else {
+      m_sink = io_sink_t(m_fd, boost::iostreams::file_descriptor_flags::close_handle);
+    }
+
+    if (parallel_compression) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Using zstd compression on " << options.compression_threads << " threads"
+                                  << (dictionary ? " with dictionary " + options.compression_dictionary : "")
+                                  << std::endl;
+      m_chunk.clear();
+      m_chunk.reserve(m_buffer_size);
+      m_compressor = std::make_unique<ParallelZstdCompressor>(
+        std::max<size_t>(options.compression_threads, 1),
+        options.compression_level,
+        [this](const char* data, size_t size) { return write_raw(data, size); },
+        dictionary);
+    }
+    if (m_block_writer || m_direct || parallel_compression) {
+      if (!m_block_writer && !m_direct) {
+        m_output_stream.push(m_sink, m_buffer_size);
+      }
+      m_is_open = true;
+      return;
+    }
+
     if (m_compression_algorithm == "zstd") {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Using zstd compression" << std::endl;
-      m_output_stream.push(boost::iostreams::zstd_compressor(boost::iostreams::zstd::best_speed));
+      m_output_stream.push(boost::iostreams::zstd_compressor(boost::iostreams::zstd_params(options.compression_level)));
+    } else if (m_compression_algorithm == "lz4") {
+#ifdef WITH_LZ4_SUPPORT
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Using lz4 compression" << std::endl;
+      m_output_stream.push(Lz4Compressor(options.compression_level));
+#else
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "readoutlibs was built without lz4 support");
+#endif
     } else if (m_compression_algorithm == "lzma") {
       TLOG_DEBUG(TLVL_WORK_STEPS) << "Using lzma compression" << std::endl;
       m_output_stream.push(boost::iostreams::lzma_compressor(boost::iostreams::lzma::best_speed));
@@ -157,8 +311,10 @@ public:
   {
     if (!m_is_open)
       return false;
-    m_output_stream.write(memory, size); // NOLINT
-    return !m_output_stream.bad();
+    if (m_compressor) {
+      return write_chunks(memory, size);
+    }
+    return write_raw(memory, size);
   }
 
   /**
@@ -166,6 +322,24 @@ public:
    */
   void close()
   {
+    if (m_compressor) {
+      flush_chunks();
+      m_compressor.reset();
+    }
+    if (m_block_writer) {
+      flush_blocks();
+      m_block = nullptr;
+      m_block_writer.reset();
+      ::close(m_fd);
+      m_is_open = false;
+      return;
+    }
+    if (m_direct) {
+      flush_direct();
+      ::close(m_fd);
+      m_is_open = false;
+      return;
+    }
     // Set the file descriptor to not use O_DIRECT. This is necessary because the write size has to be aligned for
     // O_DIRECT to succeed. This is not guaranteed for the data that remains in the buffer.
     fcntl(m_fd, F_SETFL, O_CREAT | O_WRONLY);
@@ -174,11 +348,22 @@ public:
   }
 
   /**
-   * If no compression is used, this writes all data from buffers to the file. In case that compression is used,
-   * this is not guaranteed.
+   * If no compression or parallel zstd compression is used, this writes all data from buffers to the file. In case
+   * that compression is used on the calling thread, this is not guaranteed.
    */
   void flush()
   {
+    if (m_compressor) {
+      flush_chunks();
+    }
+    if (m_block_writer) {
+      flush_blocks();
+      return;
+    }
+    if (m_direct) {
+      flush_direct();
+      return;
+    }
     // Set the file descriptor to not use O_DIRECT. This is necessary because the write size has to be aligned for
     // O_DIRECT to succeed. This is not guaranteed for the data that remains in the buffer.
     fcntl(m_fd, F_SETFL, O_CREAT | O_WRONLY);
@@ -192,7 +377,175 @@ public:
     fcntl(m_fd, F_SETFL, oflag);
   }
 
+  /**
+   * Statistics of the block backends: waits for a free buffer and write latencies. Nothing is recorded with the
+   * stream backend.
+   */
+  BlockWriterStats& get_block_stats() { return *m_stats; }
+
 private:
+  // Write to the file, without compressing
+  bool write_raw(const char* memory, size_t size)
+  {
+    if (m_block_writer) {
+      return write_blocks(memory, size);
+    }
+    if (m_direct) {
+      return write_direct(memory, size);
+    }
+    m_output_stream.write(memory, size); // NOLINT
+    return !m_output_stream.bad();
+  }
+
+  // Copy into the current chunk, handing it to the compressor once full
+  bool write_chunks(const char* memory, size_t size)
+  {
+    bool ok = true;
+    while (size > 0) {
+      size_t n = std::min(size, m_buffer_size - m_chunk.size());
+      m_chunk.insert(m_chunk.end(), memory, memory + n);
+      memory += n;
+      size -= n;
+      if (m_chunk.size() == m_buffer_size) {
+        ok = submit_chunk() && ok;
+      }
+    }
+    return ok;
+  }
+
+  bool submit_chunk()
+  {
+    std::vector<char> chunk;
+    chunk.reserve(m_buffer_size);
+    std::swap(chunk, m_chunk);
+    return m_compressor->compress(std::move(chunk));
+  }
+
+  // Close the current chunk into a frame, and output all frames
+  bool flush_chunks()
+  {
+    bool ok = true;
+    if (!m_chunk.empty()) {
+      ok = submit_chunk();
+    }
+    return m_compressor->flush() && ok;
+  }
+
+  // Copy into the current block, handing it to the backend once full
+  bool write_blocks(const char* memory, size_t size)
+  {
+    while (size > 0) {
+      if (m_block == nullptr) {
+        m_block = m_block_writer->acquire();
+      }
+      size_t n = std::min(size, m_buffer_size - m_block_fill);
+      std::memcpy(m_block + m_block_fill, memory, n);
+      m_block_fill += n;
+      memory += n;
+      size -= n;
+      if (m_block_fill == m_buffer_size) {
+        m_block_writer->submit(m_block, m_buffer_size, m_block_offset);
+        m_block_offset += m_buffer_size;
+        m_block = nullptr;
+        m_block_fill = 0;
+      }
+    }
+    return !m_block_writer->failed();
+  }
+
+  // Write out everything, including the partial tail block. O_DIRECT stays on: the tail is written padded to the
+  // alignment and the padding is cut from the file afterwards. The tail block is written again, completed, once
+  // more data comes in.
+  bool flush_blocks()
+  {
+    bool ok = true;
+    if (m_block_fill > 0) {
+      size_t padded = (m_block_fill + Alignment - 1) / Alignment * Alignment;
+      std::memset(m_block + m_block_fill, 0, padded - m_block_fill);
+      m_block_writer->submit(m_block, padded, m_block_offset);
+      ok = m_block_writer->wait_all();
+      // The written buffer is back in the pool with its contents intact: continue the tail in a free buffer
+      char* next = m_block_writer->acquire();
+      if (next != m_block) {
+        std::memcpy(next, m_block, m_block_fill);
+      }
+      m_block = next;
+    } else {
+      ok = m_block_writer->wait_all();
+    }
+    if (ftruncate(m_fd, m_block_offset + m_block_fill) != 0) {
+      ok = false;
+    }
+    return ok;
+  }
+
+  // Write whole buffers straight from the caller's memory when it is aligned and nothing is staged, otherwise copy
+  // into the staging buffer and write it once full
+  bool write_direct(const char* memory, size_t size)
+  {
+    bool ok = true;
+    while (size > 0) {
+      if (m_stage_fill == 0 && size >= m_buffer_size &&
+          (!m_use_o_direct || reinterpret_cast<std::uintptr_t>(memory) % Alignment == 0)) { // NOLINT
+        size_t n = size / Alignment * Alignment;
+        ok = pwrite_fully(memory, n, m_file_offset) && ok;
+        m_file_offset += n;
+        memory += n;
+        size -= n;
+        continue;
+      }
+      size_t n = std::min(size, m_buffer_size - m_stage_fill);
+      std::memcpy(m_stage.data() + m_stage_fill, memory, n);
+      m_stage_fill += n;
+      memory += n;
+      size -= n;
+      if (m_stage_fill == m_buffer_size) {
+        ok = pwrite_fully(m_stage.data(), m_buffer_size, m_file_offset) && ok;
+        m_file_offset += m_buffer_size;
+        m_stage_fill = 0;
+      }
+    }
+    return ok;
+  }
+
+  // Write out the staged tail, padded to the alignment, and cut the padding from the file. The tail stays staged and
+  // is written again, completed, once more data comes in.
+  bool flush_direct()
+  {
+    bool ok = true;
+    if (m_stage_fill > 0) {
+      size_t padded = (m_stage_fill + Alignment - 1) / Alignment * Alignment;
+      std::memset(m_stage.data() + m_stage_fill, 0, padded - m_stage_fill);
+      ok = pwrite_fully(m_stage.data(), padded, m_file_offset);
+    }
+    if (ftruncate(m_fd, m_file_offset + m_stage_fill) != 0) {
+      ok = false;
+    }
+    return ok;
+  }
+
+  bool pwrite_fully(const char* data, size_t size, uint64_t offset) // NOLINT(build/unsigned)
+  {
+    auto start = std::chrono::steady_clock::now();
+    while (size > 0) {
+      auto written = ::pwrite(m_fd, data, size, offset);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Write failed: "
+                                    << (written < 0 ? std::string(strerror(errno)) : "nothing written");
+        return false;
+      }
+      data += written;
+      size -= written;
+      offset += written;
+    }
+    m_stats->write_latency.record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    return true;
+  }
+
   // Config parameters
   std::string m_filename;
   size_t m_buffer_size;
@@ -204,6 +557,24 @@ private:
   filtering_ostream_t m_output_stream;
   bool m_is_open = false;
   bool m_use_o_direct = true;
+
+  // Block backend
+  BlockWriterStats m_block_stats;
+  BlockWriterStats* m_stats = &m_block_stats;
+  std::unique_ptr<BlockWriter> m_block_writer;
+
+  // Direct backend
+  bool m_direct = false;
+  std::vector<char, aligned_allocator_t> m_stage;
+  size_t m_stage_fill = 0;
+  uint64_t m_file_offset = 0; // NOLINT(build/unsigned)
+
+  // Parallel compression
+  std::vector<char> m_chunk;
+  std::unique_ptr<ParallelZstdCompressor> m_compressor;
+  char* m_block = nullptr;
+  size_t m_block_fill = 0;
+  uint64_t m_block_offset = 0; // NOLINT(build/unsigned)
 };
 
 } // namespace readoutlibs
@@ -0,0 +1,233 @@
+/**
+ * @file DeadlineScheduler.hpp Thread pool with prioritised task classes and
+ * earliest-deadline-first ordering inside each class
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DEADLINESCHEDULER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DEADLINESCHEDULER_HPP_
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/** DeadlineScheduler usage:
+ *
+ *  DeadlineScheduler sched;
+ *  sched.conf({ { "short", 4 }, { "long", 1 } }); // index 0 has the highest priority
+ *  sched.start();
+ *  sched.post(1, std::chrono::steady_clock::now() + std::chrono::seconds(1), [] { do_work(); });
+ *  sched.stop(); // runs what is still queued, then joins
+ */
+/** NOTES:
+    Every class owns a share of worker threads. A worker serves its own class first, so that a class always makes
+    progress with the threads it was given, however busy the classes above it are. When its own queue is empty, it
+    helps out with the most urgent task of the highest priority non-empty class above it, so idle workers of low
+    priority classes take short, high priority work, while high priority workers are never blocked by low priority
+    tasks. Inside a class, tasks are ordered by deadline (ties are served in submission order).
+ */
+class DeadlineScheduler
+{
+public:
+  using clock_t = std::chrono::steady_clock;
+
+  struct ClassConfig
+  {
+    std::string name;
+    size_t num_threads;
+  };
+
+  // Counters of a class, accumulated since the last call to get_stats()
+  struct ClassStats
+  {
+    std::string name;
+    uint64_t num_tasks = 0;          // NOLINT(build/unsigned)
+    uint64_t num_queued = 0;         // NOLINT(build/unsigned)
+    uint64_t max_queued = 0;         // NOLINT(build/unsigned)
+    uint64_t num_deadline_misses = 0; // NOLINT(build/unsigned)
+    uint64_t tot_queue_time_us = 0;  // NOLINT(build/unsigned)
+    uint64_t max_queue_time_us = 0;  // NOLINT(build/unsigned)
+    uint64_t tot_run_time_us = 0;    // NOLINT(build/unsigned)
+    uint64_t max_run_time_us = 0;    // NOLINT(build/unsigned)
+  };
+
+  DeadlineScheduler() {}
+
+  ~DeadlineScheduler() { stop(); }
+
+  DeadlineScheduler(const DeadlineScheduler&) = delete;            ///< DeadlineScheduler is not copy-constructible
+  DeadlineScheduler& operator=(const DeadlineScheduler&) = delete; ///< DeadlineScheduler is not copy-assginable
+  DeadlineScheduler(DeadlineScheduler&&) = delete;                 ///< DeadlineScheduler is not move-constructible
+  DeadlineScheduler& operator=(DeadlineScheduler&&) = delete;      ///< DeadlineScheduler is not move-assignable
+
+  // Define the classes, in decreasing order of priority. Must not be called while running.
+  void conf(const std::vector<ClassConfig>& classes, const std::string& thread_name = "reqsched", int tid = 0)
+  {
+    m_classes.clear();
+    for (const auto& cc : classes) {
+      m_classes.emplace_back(cc);
+    }
+    m_thread_name = thread_name;
+    m_thread_id = tid;
+  }
+
+  size_t num_classes() const { return m_classes.size(); }
+
+  const std::string& class_name(size_t index) const { return m_classes[index].config.name; }
+
+  // Spawn the worker threads of every class
+  void start()
+  {
+    m_quit = false;
+    for (size_t k = 0; k < m_classes.size(); ++k) {
+      for (size_t i = 0; i < std::max<size_t>(m_classes[k].config.num_threads, 1); ++i) {
+        m_workers.emplace_back(&DeadlineScheduler::run_worker, this, k);
+        char tname[16];
+        snprintf(tname, 16, "%s-%d", m_thread_name.c_str(), m_thread_id); // NOLINT
+        pthread_setname_np(m_workers.back().native_handle(), tname);
+      }
+    }
+  }
+
+  // Execute everything that is still queued, then join the workers
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+    m_workers.clear();
+  }
+
+  // Queue a task in the given class
+  void post(size_t class_index, clock_t::time_point deadline, std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto& tc = m_classes[std::min(class_index, m_classes.size() - 1)];
+      tc.queue.push(Task{ deadline, clock_t::now(), m_sequence++, std::move(task) });
+      tc.stats.max_queued = std::max<uint64_t>(tc.stats.max_queued, tc.queue.size()); // NOLINT(build/unsigned)
+    }
+    m_cv.notify_all();
+  }
+
+  // Snapshot and reset the per-class counters
+  std::vector<ClassStats> get_stats()
+  {
+    std::vector<ClassStats> result;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& tc : m_classes) {
+      tc.stats.name = tc.config.name;
+      tc.stats.num_queued = tc.queue.size();
+      result.push_back(tc.stats);
+      tc.stats = ClassStats();
+      tc.stats.max_queued = tc.queue.size();
+    }
+    return result;
+  }
+
+private:
+  struct Task
+  {
+    clock_t::time_point deadline;
+    clock_t::time_point enqueued;
+    uint64_t sequence; // NOLINT(build/unsigned)
+    std::function<void()> work;
+
+    // Inverted for std::priority_queue, so that the earliest deadline is on top
+    bool operator<(const Task& other) const
+    {
+      return deadline == other.deadline ? sequence > other.sequence : deadline > other.deadline;
+    }
+  };
+
+  struct TaskClass
+  {
+    explicit TaskClass(const ClassConfig& cc)
+      : config(cc)
+    {}
+    ClassConfig config;
+    std::priority_queue<Task> queue;
+    ClassStats stats;
+  };
+
+  void run_worker(size_t class_index)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      size_t served = m_classes.size();
+      m_cv.wait(lock, [&] {
+        if (!m_classes[class_index].queue.empty()) {
+          served = class_index;
+          return true;
+        }
+        for (size_t k = 0; k < class_index; ++k) {
+          if (!m_classes[k].queue.empty()) {
+            served = k;
+            return true;
+          }
+        }
+        return m_quit;
+      });
+      if (served == m_classes.size()) {
+        return;
+      }
+      Task task = std::move(const_cast<Task&>(m_classes[served].queue.top())); // NOLINT
+      m_classes[served].queue.pop();
+      lock.unlock();
+
+      auto started = clock_t::now();
+      task.work();
+      auto finished = clock_t::now();
+
+      auto queue_us = std::chrono::duration_cast<std::chrono::microseconds>(started - task.enqueued).count();
+      auto run_us = std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count();
+      lock.lock();
+      auto& stats = m_classes[served].stats;
+      ++stats.num_tasks;
+      stats.tot_queue_time_us += queue_us;
+      stats.max_queue_time_us = std::max<uint64_t>(stats.max_queue_time_us, queue_us); // NOLINT(build/unsigned)
+      stats.tot_run_time_us += run_us;
+      stats.max_run_time_us = std::max<uint64_t>(stats.max_run_time_us, run_us); // NOLINT(build/unsigned)
+      if (finished > task.deadline) {
+        ++stats.num_deadline_misses;
+      }
+    }
+  }
+
+  std::vector<TaskClass> m_classes;
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_quit = false;
+  uint64_t m_sequence = 0; // NOLINT(build/unsigned)
+  std::string m_thread_name;
+  int m_thread_id = 0;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DEADLINESCHEDULER_HPP_
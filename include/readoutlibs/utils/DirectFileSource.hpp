@@ -0,0 +1,138 @@
+/**
+ * @file DirectFileSource.hpp boost::iostreams source reading a file with
+ * aligned reads, as required with O_DIRECT
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DIRECTFILESOURCE_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DIRECTFILESOURCE_HPP_
+
+#include <boost/iostreams/categories.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ios>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Reads a file sequentially with pread, always at aligned offsets and in multiples of the alignment, so that the file
+ * can be opened with O_DIRECT. Reads into aligned memory of at least the alignment go straight to the destination;
+ * anything else is served from an aligned buffer of buffer_size. Takes ownership of the file descriptor, which is
+ * closed with the last copy of the source.
+ */
+class DirectFileSource
+{
+public:
+  using char_type = char;
+  using category = boost::iostreams::source_tag;
+
+  DirectFileSource(int fd, size_t buffer_size, size_t alignment)
+    : m_state(std::make_shared<State>(fd, buffer_size, alignment))
+  {}
+
+  /**
+   * @return The number of bytes read, -1 at the end of the file.
+   * @throw std::ios_base::failure If the file can not be read.
+   */
+  std::streamsize read(char* destination, std::streamsize size)
+  {
+    auto& state = *m_state;
+    std::streamsize copied = 0;
+    while (copied < size) {
+      if (state.begin == state.end) {
+        if (state.eof) {
+          break;
+        }
+        size_t remaining = size - copied;
+        if (reinterpret_cast<uintptr_t>(destination + copied) % state.alignment == 0 && // NOLINT
+            remaining >= state.alignment) {
+          size_t direct_size = remaining / state.alignment * state.alignment;
+          size_t got = state.read_fully(destination + copied, direct_size);
+          copied += got;
+          state.eof = got < direct_size;
+          continue;
+        }
+        state.begin = 0;
+        state.end = state.read_fully(state.buffer, state.buffer_size);
+        state.eof = state.end < state.buffer_size;
+        continue;
+      }
+      size_t n = std::min(static_cast<size_t>(size - copied), state.end - state.begin);
+      std::memcpy(destination + copied, state.buffer + state.begin, n);
+      state.begin += n;
+      copied += n;
+    }
+    return copied > 0 ? copied : -1;
+  }
+
+private:
+  // Shared by the copies boost::iostreams makes of the source
+  struct State
+  {
+    State(int fd_, size_t buffer_size_, size_t alignment_)
+      : fd(fd_)
+      , alignment(alignment_)
+      , buffer_size((std::max<size_t>(buffer_size_, 1) + alignment_ - 1) / alignment_ * alignment_)
+    {
+      buffer = static_cast<char*>(std::aligned_alloc(alignment, buffer_size));
+      if (buffer == nullptr) {
+        ::close(fd);
+        throw std::bad_alloc();
+      }
+    }
+    ~State()
+    {
+      std::free(buffer);
+      ::close(fd);
+    }
+
+    // Read up to size bytes at the current offset. Returns less than size only at the end of the file.
+    size_t read_fully(char* data, size_t size)
+    {
+      size_t total = 0;
+      while (total < size) {
+        auto got = ::pread(fd, data + total, size - total, offset);
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got < 0) {
+          throw std::ios_base::failure(std::string("Read failed: ") + strerror(errno));
+        }
+        if (got == 0) {
+          break;
+        }
+        total += got;
+        offset += got;
+      }
+      return total;
+    }
+
+    int fd;
+    size_t alignment;
+    size_t buffer_size;
+    char* buffer = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t offset = 0; // NOLINT(build/unsigned)
+    bool eof = false;
+  };
+
+  std::shared_ptr<State> m_state;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_DIRECTFILESOURCE_HPP_
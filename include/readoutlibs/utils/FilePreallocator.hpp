@@ -0,0 +1,92 @@
+/**
+ * @file FilePreallocator.hpp Creates and allocates the next file of a
+ * recording in the background
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEPREALLOCATOR_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEPREALLOCATOR_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Allocates the extents of a file ahead of time, so that writing it, especially with O_DIRECT, does not stall on
+ * block allocation. The file keeps its size of 0: writers open it without truncating, and should truncate it to
+ * its written size when done, to release the blocks that were not used.
+ */
+class FilePreallocator
+{
+public:
+  FilePreallocator() {}
+
+  ~FilePreallocator() { wait(); }
+
+  FilePreallocator(const FilePreallocator&) = delete;            ///< FilePreallocator is not copy-constructible
+  FilePreallocator& operator=(const FilePreallocator&) = delete; ///< FilePreallocator is not copy-assginable
+  FilePreallocator(FilePreallocator&&) = delete;                 ///< FilePreallocator is not move-constructible
+  FilePreallocator& operator=(FilePreallocator&&) = delete;      ///< FilePreallocator is not move-assignable
+
+  // Start creating the file, replacing any existing one, and allocating size bytes for it on a background thread
+  void prepare(const std::string& filename, size_t size)
+  {
+    wait();
+    m_filename = filename;
+    m_thread = std::thread([this, size] { m_ok = allocate(m_filename, size); });
+  }
+
+  // Wait for the file being prepared. Returns false if it could not be created or allocated.
+  bool wait()
+  {
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+    return m_ok;
+  }
+
+  // The file being prepared, or prepared last
+  const std::string& get_filename() const { return m_filename; }
+
+private:
+  static bool allocate(const std::string& filename, size_t size)
+  {
+    ::unlink(filename.c_str());
+    int fd = ::open(filename.c_str(), O_CREAT | O_WRONLY, 0644);
+    if (fd == -1) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Could not create " << filename << ": " << strerror(errno);
+      return false;
+    }
+    bool ok = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0;
+    if (!ok) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Could not preallocate " << filename << ": " << strerror(errno);
+    }
+    ::close(fd);
+    return ok;
+  }
+
+  std::string m_filename;
+  std::thread m_thread;
+  bool m_ok = false;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEPREALLOCATOR_HPP_
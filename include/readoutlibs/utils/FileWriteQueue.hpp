@@ -0,0 +1,159 @@
+/**
+ * @file FileWriteQueue.hpp Writes memory owned by the caller to a file
+ * from a dedicated thread
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEWRITEQUEUE_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEWRITEQUEUE_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Appends pieces of memory to a file descriptor, in submission order, from a dedicated thread. Unlike the block
+ * writers, nothing is copied: the memory must stay valid until its write is done, at the latest when wait_all()
+ * returns. Writes are numbered from 0 in submission order, and write n is done once get_num_done() is above n. At
+ * most max_pending writes are queued, including the one in progress.
+ */
+class FileWriteQueue
+{
+public:
+  FileWriteQueue(int fd, size_t max_pending, const std::string& name)
+    : m_fd(fd)
+    , m_max_pending(std::max<size_t>(max_pending, 1))
+  {
+    m_thread = std::thread(&FileWriteQueue::run_writer, this);
+    pthread_setname_np(m_thread.native_handle(), name.substr(0, 15).c_str());
+  }
+
+  ~FileWriteQueue()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+
+  FileWriteQueue(const FileWriteQueue&) = delete;            ///< FileWriteQueue is not copy-constructible
+  FileWriteQueue& operator=(const FileWriteQueue&) = delete; ///< FileWriteQueue is not copy-assginable
+  FileWriteQueue(FileWriteQueue&&) = delete;                 ///< FileWriteQueue is not move-constructible
+  FileWriteQueue& operator=(FileWriteQueue&&) = delete;      ///< FileWriteQueue is not move-assignable
+
+  // Queue a write. Waits while max_pending writes are queued. Returns false if any write failed so far.
+  bool submit(const char* data, size_t size)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [&] { return m_pending.size() < m_max_pending; });
+      m_pending.push_back({ data, size });
+    }
+    ++m_num_submitted;
+    m_cv.notify_all();
+    return !m_failed;
+  }
+
+  // Number of writes submitted so far, which is also the number of the next one
+  uint64_t get_num_submitted() const { return m_num_submitted; } // NOLINT(build/unsigned)
+
+  // Number of writes done, successfully or not
+  uint64_t get_num_done() const { return m_num_done; } // NOLINT(build/unsigned)
+
+  // Wait until all queued writes are done. Returns false if any write failed.
+  bool wait_all()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_pending.empty(); });
+    return !m_failed;
+  }
+
+private:
+  struct PendingWrite
+  {
+    const char* data;
+    size_t size;
+  };
+
+  void run_writer()
+  {
+    while (true) {
+      PendingWrite write;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_quit || !m_pending.empty(); });
+        if (m_pending.empty()) {
+          return; // quit, and nothing left to write
+        }
+        write = m_pending.front();
+      }
+      if (!write_fully(write.data, write.size)) {
+        m_failed = true;
+      }
+      {
+        // The write is only removed once done, so that the queue bounds the memory in use
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.pop_front();
+        ++m_num_done;
+      }
+      m_cv.notify_all();
+    }
+  }
+
+  bool write_fully(const char* data, size_t size)
+  {
+    while (size > 0) {
+      auto written = ::write(m_fd, data, size);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Write failed: "
+                                    << (written < 0 ? std::string(strerror(errno)) : "nothing written");
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
+    return true;
+  }
+
+  int m_fd;
+  size_t m_max_pending;
+  std::deque<PendingWrite> m_pending; // the front one is being written
+  std::atomic<uint64_t> m_num_submitted{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<uint64_t> m_num_done{ 0 };      // NOLINT(build/unsigned)
+  bool m_quit = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+  std::atomic<bool> m_failed{ false };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_FILEWRITEQUEUE_HPP_
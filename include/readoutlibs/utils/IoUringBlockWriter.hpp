@@ -0,0 +1,228 @@
+/**
+ * @file IoUringBlockWriter.hpp Block writer backend based on io_uring, with
+ * registered buffers and several writes in flight
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_IOURINGBLOCKWRITER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_IOURINGBLOCKWRITER_HPP_
+
+#ifdef WITH_LIBURING_SUPPORT
+
+#include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/BlockWriter.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <liburing.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Writes blocks through an io_uring. Every buffer of the pool can be in flight at the same time; the caller only
+ * waits when all of them are. Completions are reaped by a dedicated thread, which puts the written buffers back
+ * into the pool. If the ring itself fails, the writer is marked failed and stops writing: buffers are handed out
+ * again straight away, and their data is dropped.
+ */
+class IoUringBlockWriter : public BlockWriter
+{
+public:
+  IoUringBlockWriter(int fd, size_t num_buffers, size_t buffer_size, size_t alignment, BlockWriterStats& stats)
+    : m_fd(fd)
+    , m_num_buffers(std::max<size_t>(num_buffers, 1))
+    , m_buffer_size(buffer_size)
+    , m_expected_sizes(m_num_buffers, 0)
+    , m_submit_times(m_num_buffers)
+    , m_stats(stats)
+  {
+    m_memory = static_cast<char*>(std::aligned_alloc(alignment, m_num_buffers * m_buffer_size));
+    if (m_memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    // One submission slot per buffer, plus one for the wake-up of the reaper at destruction
+    int ret = io_uring_queue_init(m_num_buffers + 1, &m_ring, 0);
+    if (ret < 0) {
+      std::free(m_memory);
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "io_uring setup failed: " + std::string(strerror(-ret)));
+    }
+    std::vector<iovec> iovecs(m_num_buffers);
+    for (size_t i = 0; i < m_num_buffers; ++i) {
+      iovecs[i].iov_base = m_memory + i * m_buffer_size;
+      iovecs[i].iov_len = m_buffer_size;
+      m_free.push_back(i);
+    }
+    // Registered buffers are not mapped again on every write, but count against the locked memory limit
+    m_registered = io_uring_register_buffers(&m_ring, iovecs.data(), iovecs.size()) == 0;
+    if (!m_registered) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Could not register io_uring buffers, using unregistered writes";
+    }
+    m_reaper = std::thread(&IoUringBlockWriter::reap, this);
+  }
+
+  ~IoUringBlockWriter()
+  {
+    wait_all();
+    io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+    io_uring_prep_nop(sqe);
+    io_uring_sqe_set_data(sqe, nullptr);
+    io_uring_submit(&m_ring);
+    m_reaper.join();
+    if (m_registered) {
+      io_uring_unregister_buffers(&m_ring);
+    }
+    io_uring_queue_exit(&m_ring);
+    std::free(m_memory);
+  }
+
+  IoUringBlockWriter(const IoUringBlockWriter&) = delete;            ///< IoUringBlockWriter is not copy-constructible
+  IoUringBlockWriter& operator=(const IoUringBlockWriter&) = delete; ///< IoUringBlockWriter is not copy-assginable
+  IoUringBlockWriter(IoUringBlockWriter&&) = delete;                 ///< IoUringBlockWriter is not move-constructible
+  IoUringBlockWriter& operator=(IoUringBlockWriter&&) = delete;      ///< IoUringBlockWriter is not move-assignable
+
+  char* acquire() override
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free.empty()) {
+      auto wait_start = std::chrono::steady_clock::now();
+      m_cv.wait(lock, [&] { return !m_free.empty(); });
+      ++m_stats.num_buffer_waits;
+      m_stats.buffer_wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - wait_start)
+                                    .count();
+    }
+    auto index = m_free.back();
+    m_free.pop_back();
+    return m_memory + index * m_buffer_size;
+  }
+
+  void submit(char* buffer, size_t size, uint64_t offset) override // NOLINT(build/unsigned)
+  {
+    size_t index = (buffer - m_memory) / m_buffer_size;
+    m_expected_sizes[index] = size;
+    m_submit_times[index] = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_reaper_stopped) {
+        m_free.push_back(index);
+        return;
+      }
+      ++m_in_flight;
+    }
+    // Never empty: there are at most as many writes in flight as submission slots
+    io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+    if (m_registered) {
+      io_uring_prep_write_fixed(sqe, m_fd, buffer, size, offset, index);
+    } else {
+      io_uring_prep_write(sqe, m_fd, buffer, size, offset);
+    }
+    // Tags are offset by one: a null tag is the wake-up
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(index + 1)); // NOLINT
+    io_uring_submit(&m_ring);
+  }
+
+  bool wait_all() override
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_in_flight == 0; });
+    return !m_failed;
+  }
+
+  bool failed() const override { return m_failed; }
+
+private:
+  void reap()
+  {
+    while (true) {
+      io_uring_cqe* cqe = nullptr;
+      int ret = io_uring_wait_cqe(&m_ring, &cqe);
+      if (ret == -EINTR) {
+        continue;
+      }
+      if (ret < 0) {
+        // Nothing is going to complete any more: fail, and give every buffer back so that nobody waits forever
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "io_uring completion wait failed: " << strerror(-ret);
+        m_failed = true;
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_reaper_stopped = true;
+          m_in_flight = 0;
+          m_free.clear();
+          for (size_t i = 0; i < m_num_buffers; ++i) {
+            m_free.push_back(i);
+          }
+        }
+        m_cv.notify_all();
+        return;
+      }
+      auto tag = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)); // NOLINT
+      int res = cqe->res;
+      io_uring_cqe_seen(&m_ring, cqe);
+      if (tag == 0) {
+        return;
+      }
+      size_t index = tag - 1;
+      m_stats.write_latency.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_submit_times[index])
+          .count());
+      if (res < 0 || static_cast<size_t>(res) != m_expected_sizes[index]) {
+        // Short writes to regular files only happen on errors such as a full disk: no retry
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "io_uring write failed: "
+                                    << (res < 0 ? std::string(strerror(-res)) : "short write of " + std::to_string(res));
+        m_failed = true;
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(index);
+        --m_in_flight;
+      }
+      m_cv.notify_all();
+    }
+  }
+
+  int m_fd;
+  size_t m_num_buffers;
+  size_t m_buffer_size;
+  char* m_memory = nullptr;
+  std::vector<size_t> m_expected_sizes;
+  std::vector<std::chrono::steady_clock::time_point> m_submit_times;
+  BlockWriterStats& m_stats;
+  bool m_registered = false;
+
+  io_uring m_ring;
+  std::thread m_reaper;
+
+  std::vector<size_t> m_free;
+  size_t m_in_flight = 0;
+  bool m_reaper_stopped = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::atomic<bool> m_failed{ false };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // WITH_LIBURING_SUPPORT
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_IOURINGBLOCKWRITER_HPP_
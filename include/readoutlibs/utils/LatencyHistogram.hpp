@@ -0,0 +1,151 @@
+/**
+ * @file LatencyHistogram.hpp Lock-free log-linear (HDR style) histogram
+ * for latency measurements
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LATENCYHISTOGRAM_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LATENCYHISTOGRAM_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/** LatencyHistogram usage:
+ *
+ *  LatencyHistogram hist;
+ *  hist.record(us);                  // from any number of threads
+ *  auto snap = hist.snapshot_and_reset();
+ *  auto p99 = snap.percentile(0.99);
+ */
+/** NOTES:
+    Values are binned in powers of two, each split into 16 linear sub-buckets, so the relative
+    error of a reported value is below 1/16. Values below 32 are exact; values beyond 2^41 are
+    clamped. Recording is a single relaxed atomic increment on a bucket of one of a few shards;
+    threads are spread over the shards to avoid contention on the same cache lines.
+ */
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned s_sub_bucket_bits = 4;
+  static constexpr uint64_t s_sub_buckets = 1ULL << s_sub_bucket_bits; // NOLINT(build/unsigned)
+  static constexpr unsigned s_max_magnitude = 40;
+  static constexpr size_t s_num_buckets = (s_max_magnitude - s_sub_bucket_bits + 2) * s_sub_buckets;
+  static constexpr size_t s_num_shards = 8;
+
+  // A consolidated copy of the counts, used for the queries
+  class Snapshot
+  {
+  public:
+    uint64_t count() const { return m_count; } // NOLINT(build/unsigned)
+
+    uint64_t max() const { return m_max; } // NOLINT(build/unsigned)
+
+    // Highest value equivalent to the bucket holding the given quantile (0 if empty)
+    uint64_t percentile(double quantile) const // NOLINT(build/unsigned)
+    {
+      if (m_count == 0) {
+        return 0;
+      }
+      auto target = static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0) * m_count)); // NOLINT
+      target = std::max<uint64_t>(target, 1);                                                     // NOLINT
+      uint64_t seen = 0;                                                                          // NOLINT
+      for (size_t i = 0; i < m_counts.size(); ++i) {
+        seen += m_counts[i];
+        if (seen >= target) {
+          return std::min(bucket_upper(i), m_max);
+        }
+      }
+      return m_max;
+    }
+
+  private:
+    friend class LatencyHistogram;
+    std::vector<uint64_t> m_counts = std::vector<uint64_t>(s_num_buckets, 0); // NOLINT(build/unsigned)
+    uint64_t m_count = 0;                                                      // NOLINT(build/unsigned)
+    uint64_t m_max = 0;                                                        // NOLINT(build/unsigned)
+  };
+
+  LatencyHistogram() {}
+
+  LatencyHistogram(const LatencyHistogram&) = delete;            ///< LatencyHistogram is not copy-constructible
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete; ///< LatencyHistogram is not copy-assginable
+  LatencyHistogram(LatencyHistogram&&) = delete;                 ///< LatencyHistogram is not move-constructible
+  LatencyHistogram& operator=(LatencyHistogram&&) = delete;      ///< LatencyHistogram is not move-assignable
+
+  void record(uint64_t value) // NOLINT(build/unsigned)
+  {
+    auto& shard = m_shards[shard_index()];
+    shard.counts[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    auto current = shard.max.load(std::memory_order_relaxed);
+    while (value > current && !shard.max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Merge the shards and clear them. Concurrent records end up in either this or the next snapshot.
+  Snapshot snapshot_and_reset()
+  {
+    Snapshot snap;
+    for (auto& shard : m_shards) {
+      for (size_t i = 0; i < s_num_buckets; ++i) {
+        auto n = shard.counts[i].exchange(0, std::memory_order_relaxed);
+        snap.m_counts[i] += n;
+        snap.m_count += n;
+      }
+      snap.m_max = std::max(snap.m_max, shard.max.exchange(0, std::memory_order_relaxed));
+    }
+    return snap;
+  }
+
+  static size_t bucket_index(uint64_t value) // NOLINT(build/unsigned)
+  {
+    if (value < s_sub_buckets) {
+      return value;
+    }
+    unsigned magnitude = 63 - __builtin_clzll(value);
+    if (magnitude > s_max_magnitude) {
+      return s_num_buckets - 1;
+    }
+    unsigned shift = magnitude - s_sub_bucket_bits;
+    return (shift + 1) * s_sub_buckets + ((value >> shift) - s_sub_buckets);
+  }
+
+  static uint64_t bucket_upper(size_t index) // NOLINT(build/unsigned)
+  {
+    if (index < s_sub_buckets) {
+      return index;
+    }
+    unsigned shift = index / s_sub_buckets - 1;
+    uint64_t lower = (s_sub_buckets + index % s_sub_buckets) << shift; // NOLINT(build/unsigned)
+    return lower + (1ULL << shift) - 1;
+  }
+
+private:
+  struct alignas(64) Shard
+  {
+    std::array<std::atomic<uint64_t>, s_num_buckets> counts{}; // NOLINT(build/unsigned)
+    std::atomic<uint64_t> max{ 0 };                            // NOLINT(build/unsigned)
+  };
+
+  static size_t shard_index()
+  {
+    static std::atomic<size_t> next_shard{ 0 };
+    thread_local size_t index = next_shard.fetch_add(1, std::memory_order_relaxed) % s_num_shards;
+    return index;
+  }
+
+  std::array<Shard, s_num_shards> m_shards;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LATENCYHISTOGRAM_HPP_
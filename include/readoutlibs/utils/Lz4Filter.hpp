@@ -0,0 +1,191 @@
+/**
+ * @file Lz4Filter.hpp boost::iostreams filters for the LZ4 frame format
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LZ4FILTER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LZ4FILTER_HPP_
+
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/operations.hpp>
+
+#include <lz4frame.h>
+
+#include <ios>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Compresses a stream into a single LZ4 frame, to be pushed onto a filtering output stream like the boost
+ * compressors. level follows LZ4: below 3 is the fast mode, 3 and above the slower high-compression mode.
+ */
+class Lz4Compressor
+{
+public:
+  using char_type = char;
+  struct category
+    : boost::iostreams::output_filter_tag
+    , boost::iostreams::multichar_tag
+    , boost::iostreams::closable_tag
+  {};
+
+  explicit Lz4Compressor(int level = 0)
+    : m_state(std::make_shared<State>(level))
+  {}
+
+  template<typename Sink>
+  std::streamsize write(Sink& sink, const char* data, std::streamsize size)
+  {
+    auto& state = *m_state;
+    if (!state.begun) {
+      begin(sink);
+    }
+    state.output.resize(LZ4F_compressBound(size, &state.preferences));
+    auto written =
+      LZ4F_compressUpdate(state.cctx, state.output.data(), state.output.size(), data, size, nullptr);
+    check(written);
+    boost::iostreams::write(sink, state.output.data(), written);
+    return size;
+  }
+
+  template<typename Sink>
+  void close(Sink& sink)
+  {
+    auto& state = *m_state;
+    if (!state.begun) {
+      begin(sink); // an empty stream is still a valid frame
+    }
+    state.output.resize(LZ4F_compressBound(0, &state.preferences));
+    auto written = LZ4F_compressEnd(state.cctx, state.output.data(), state.output.size(), nullptr);
+    check(written);
+    boost::iostreams::write(sink, state.output.data(), written);
+    state.begun = false;
+  }
+
+private:
+  // Shared by the copies boost::iostreams makes of the filter
+  struct State
+  {
+    explicit State(int level)
+    {
+      preferences.compressionLevel = level;
+      check(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION));
+    }
+    ~State() { LZ4F_freeCompressionContext(cctx); }
+
+    LZ4F_cctx* cctx = nullptr;
+    LZ4F_preferences_t preferences{};
+    std::vector<char> output;
+    bool begun = false;
+  };
+
+  static void check(size_t result)
+  {
+    if (LZ4F_isError(result)) {
+      throw std::ios_base::failure(std::string("LZ4 compression failed: ") + LZ4F_getErrorName(result));
+    }
+  }
+
+  template<typename Sink>
+  void begin(Sink& sink)
+  {
+    auto& state = *m_state;
+    state.output.resize(LZ4F_HEADER_SIZE_MAX);
+    auto written = LZ4F_compressBegin(state.cctx, state.output.data(), state.output.size(), &state.preferences);
+    check(written);
+    boost::iostreams::write(sink, state.output.data(), written);
+    state.begun = true;
+  }
+
+  std::shared_ptr<State> m_state;
+};
+
+/**
+ * Decompresses a stream of one or more LZ4 frames, to be pushed onto a filtering input stream.
+ */
+class Lz4Decompressor
+{
+public:
+  using char_type = char;
+  struct category
+    : boost::iostreams::input_filter_tag
+    , boost::iostreams::multichar_tag
+    , boost::iostreams::closable_tag
+  {};
+
+  explicit Lz4Decompressor(size_t input_size = 65536)
+    : m_state(std::make_shared<State>(input_size))
+  {}
+
+  template<typename Source>
+  std::streamsize read(Source& source, char* destination, std::streamsize size)
+  {
+    auto& state = *m_state;
+    std::streamsize produced = 0;
+    while (produced < size) {
+      if (state.input_begin == state.input_end && !state.input_done) {
+        auto got = boost::iostreams::read(source, state.input.data(), state.input.size());
+        state.input_done = got <= 0;
+        state.input_begin = 0;
+        state.input_end = got > 0 ? got : 0;
+      }
+      size_t output_size = size - produced;
+      size_t input_size = state.input_end - state.input_begin;
+      auto result = LZ4F_decompress(state.dctx,
+                                    destination + produced,
+                                    &output_size,
+                                    state.input.data() + state.input_begin,
+                                    &input_size,
+                                    nullptr);
+      if (LZ4F_isError(result)) {
+        throw std::ios_base::failure(std::string("LZ4 decompression failed: ") + LZ4F_getErrorName(result));
+      }
+      state.input_begin += input_size;
+      produced += output_size;
+      if (output_size == 0 && input_size == 0 && state.input_done) {
+        break;
+      }
+    }
+    return produced > 0 ? produced : -1;
+  }
+
+  template<typename Source>
+  void close(Source& /*source*/)
+  {
+    m_state = std::make_shared<State>(m_state->input.size());
+  }
+
+private:
+  // Shared by the copies boost::iostreams makes of the filter
+  struct State
+  {
+    explicit State(size_t input_size)
+      : input(input_size)
+    {
+      auto result = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+      if (LZ4F_isError(result)) {
+        throw std::ios_base::failure(std::string("LZ4 decompression failed: ") + LZ4F_getErrorName(result));
+      }
+    }
+    ~State() { LZ4F_freeDecompressionContext(dctx); }
+
+    LZ4F_dctx* dctx = nullptr;
+    std::vector<char> input;
+    size_t input_begin = 0;
+    size_t input_end = 0;
+    bool input_done = false;
+  };
+
+  std::shared_ptr<State> m_state;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_LZ4FILTER_HPP_
@@ -0,0 +1,184 @@
+/**
+ * @file ParallelZstdCompressor.hpp Compression of data chunks into
+ * independent zstd frames by a pool of worker threads
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDCOMPRESSOR_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDCOMPRESSOR_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Compresses each submitted chunk into its own zstd frame, on a pool of worker threads. The frames carry the size
+ * of their content, so that they can be located and decompressed independently. Together they form a regular zstd
+ * stream. Frames are passed to the output function in submission order, from the submitting thread. With a
+ * dictionary, every frame is compressed with it.
+ */
+class ParallelZstdCompressor
+{
+public:
+  using output_t = std::function<bool(const char*, size_t)>;
+
+  ParallelZstdCompressor(size_t num_threads,
+                         int level,
+                         output_t output,
+                         std::shared_ptr<const ZstdDictionary> dictionary = nullptr)
+    : m_level(level)
+    , m_max_queued(2 * std::max<size_t>(num_threads, 1))
+    , m_output(std::move(output))
+    , m_dictionary(std::move(dictionary))
+  {
+    for (size_t i = 0; i < std::max<size_t>(num_threads, 1); ++i) {
+      m_threads.emplace_back(&ParallelZstdCompressor::run_worker, this);
+    }
+  }
+
+  ~ParallelZstdCompressor()
+  {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  ParallelZstdCompressor(const ParallelZstdCompressor&) = delete; ///< ParallelZstdCompressor is not copy-constructible
+  ParallelZstdCompressor& operator=(const ParallelZstdCompressor&) =
+    delete;                                                      ///< ParallelZstdCompressor is not copy-assginable
+  ParallelZstdCompressor(ParallelZstdCompressor&&) = delete; ///< ParallelZstdCompressor is not move-constructible
+  ParallelZstdCompressor& operator=(ParallelZstdCompressor&&) =
+    delete; ///< ParallelZstdCompressor is not move-assignable
+
+  // Queue a chunk for compression. Outputs the frames finished so far, and waits while too many chunks are queued.
+  // Returns false if any compression or output failed.
+  bool compress(std::vector<char>&& chunk)
+  {
+    auto job = std::make_shared<Job>();
+    job->input = std::move(chunk);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.push_back(job);
+      m_todo.push_back(job);
+    }
+    m_work_cv.notify_one();
+    return output_frames(m_max_queued);
+  }
+
+  // Wait for all queued chunks and output their frames
+  bool flush() { return output_frames(0); }
+
+private:
+  struct Job
+  {
+    std::vector<char> input;
+    std::unique_ptr<char[]> output;
+    size_t output_size = 0;
+    bool done = false;
+    bool ok = true;
+  };
+
+  // Output the finished frames in order, waiting until at most max_queued chunks remain
+  bool output_frames(size_t max_queued)
+  {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [&] { return m_jobs.size() <= max_queued || m_jobs.front()->done; });
+        if (m_jobs.empty() || !m_jobs.front()->done) {
+          return !m_failed;
+        }
+        job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      if (!job->ok || !m_output(job->output.get(), job->output_size)) {
+        m_failed = true;
+      }
+    }
+  }
+
+  void run_worker()
+  {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, m_level);
+    if (m_dictionary) {
+      m_dictionary->load_into(cctx);
+    }
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_cv.wait(lock, [&] { return m_quit || !m_todo.empty(); });
+        if (m_todo.empty()) {
+          break;
+        }
+        job = std::move(m_todo.front());
+        m_todo.pop_front();
+      }
+      auto bound = ZSTD_compressBound(job->input.size());
+      job->output.reset(new char[bound]);
+      auto size = ZSTD_compress2(cctx, job->output.get(), bound, job->input.data(), job->input.size());
+      if (ZSTD_isError(size)) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "zstd compression failed: " << ZSTD_getErrorName(size);
+        job->ok = false;
+      } else {
+        job->output_size = size;
+      }
+      std::vector<char>().swap(job->input);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job->done = true;
+      }
+      m_done_cv.notify_all();
+    }
+    ZSTD_freeCCtx(cctx);
+  }
+
+  int m_level;
+  size_t m_max_queued;
+  output_t m_output;
+  std::shared_ptr<const ZstdDictionary> m_dictionary;
+
+  std::deque<std::shared_ptr<Job>> m_jobs; // in submission order, until output
+  std::deque<std::shared_ptr<Job>> m_todo; // not yet picked up by a worker
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  bool m_quit = false;
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_failed{ false };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDCOMPRESSOR_HPP_
@@ -0,0 +1,285 @@
+/**
+ * @file ParallelZstdDecompressor.hpp Decompression of the frames of a zstd
+ * stream by a pool of worker threads
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDDECOMPRESSOR_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDDECOMPRESSOR_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <zstd.h>
+#include <zstd_errors.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Splits a zstd stream into its frames and decompresses several of them ahead on a pool of worker threads. This
+ * pays off for streams of many frames, as written by the ParallelZstdCompressor; a stream written as one frame
+ * is decompressed by a single worker, and kept in memory whole. Streams compressed with a dictionary need the same
+ * dictionary here.
+ */
+class ParallelZstdDecompressor
+{
+public:
+  // Read up to size bytes of the compressed stream. Returns 0 at the end.
+  using input_t = std::function<size_t(char*, size_t)>;
+
+  ParallelZstdDecompressor(size_t num_threads,
+                           size_t read_size,
+                           input_t input,
+                           std::shared_ptr<const ZstdDictionary> dictionary = nullptr)
+    : m_max_queued(2 * std::max<size_t>(num_threads, 1))
+    , m_read_size(std::max<size_t>(read_size, 4096))
+    , m_input(std::move(input))
+    , m_dictionary(std::move(dictionary))
+  {
+    for (size_t i = 0; i < std::max<size_t>(num_threads, 1); ++i) {
+      m_threads.emplace_back(&ParallelZstdDecompressor::run_worker, this);
+    }
+  }
+
+  ~ParallelZstdDecompressor()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  ParallelZstdDecompressor(const ParallelZstdDecompressor&) =
+    delete; ///< ParallelZstdDecompressor is not copy-constructible
+  ParallelZstdDecompressor& operator=(const ParallelZstdDecompressor&) =
+    delete; ///< ParallelZstdDecompressor is not copy-assginable
+  ParallelZstdDecompressor(ParallelZstdDecompressor&&) =
+    delete; ///< ParallelZstdDecompressor is not move-constructible
+  ParallelZstdDecompressor& operator=(ParallelZstdDecompressor&&) =
+    delete; ///< ParallelZstdDecompressor is not move-assignable
+
+  // Copy up to size decompressed bytes. Returns the number of bytes copied: less than size only at the end of the
+  // stream or on an error.
+  size_t read(char* destination, size_t size)
+  {
+    size_t copied = 0;
+    while (copied < size) {
+      if (m_current && m_current_pos < m_current->output_size) {
+        size_t n = std::min(size - copied, m_current->output_size - m_current_pos);
+        std::memcpy(destination + copied, m_current->output.get() + m_current_pos, n);
+        m_current_pos += n;
+        copied += n;
+        continue;
+      }
+      m_current.reset();
+      queue_frames();
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_jobs.empty()) {
+          break;
+        }
+        m_done_cv.wait(lock, [&] { return m_jobs.front()->done; });
+        m_current = std::move(m_jobs.front());
+        m_jobs.pop_front();
+      }
+      m_current_pos = 0;
+      if (!m_current->ok) {
+        m_failed = true;
+        m_current.reset();
+        break;
+      }
+      queue_frames();
+    }
+    return copied;
+  }
+
+  // Whether the stream was found truncated or corrupt
+  bool failed() const { return m_failed; }
+
+private:
+  struct Job
+  {
+    std::vector<char> input;
+    std::unique_ptr<char[]> output;
+    size_t output_size = 0;
+    bool done = false;
+    bool ok = true;
+  };
+
+  // Hand the next frames of the stream to the workers, up to m_max_queued
+  void queue_frames()
+  {
+    while (!m_failed && m_jobs.size() < m_max_queued) {
+      auto job = next_frame();
+      if (!job) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+        m_todo.push_back(job);
+      }
+      m_work_cv.notify_one();
+    }
+  }
+
+  std::shared_ptr<Job> next_frame()
+  {
+    while (true) {
+      size_t available = m_raw_end - m_raw_begin;
+      if (available > 0) {
+        size_t frame_size = ZSTD_findFrameCompressedSize(m_raw.data() + m_raw_begin, available);
+        if (!ZSTD_isError(frame_size)) {
+          auto job = std::make_shared<Job>();
+          job->input.assign(m_raw.data() + m_raw_begin, m_raw.data() + m_raw_begin + frame_size);
+          m_raw_begin += frame_size;
+          return job;
+        }
+        if (ZSTD_getErrorCode(frame_size) != ZSTD_error_srcSize_wrong || m_input_done) {
+          TLOG_DEBUG(TLVL_WORK_STEPS) << "Truncated or corrupt zstd stream: " << ZSTD_getErrorName(frame_size);
+          m_failed = true;
+          return nullptr;
+        }
+      } else if (m_input_done) {
+        return nullptr;
+      }
+      // The frame is incomplete: read more of the stream
+      if (m_raw_begin > 0) {
+        std::memmove(m_raw.data(), m_raw.data() + m_raw_begin, available);
+        m_raw_begin = 0;
+        m_raw_end = available;
+      }
+      if (m_raw.size() - m_raw_end < m_read_size) {
+        m_raw.resize(std::max(2 * m_raw.size(), m_raw_end + m_read_size));
+      }
+      size_t n = m_input(m_raw.data() + m_raw_end, m_raw.size() - m_raw_end);
+      if (n == 0) {
+        m_input_done = true;
+      }
+      m_raw_end += n;
+    }
+  }
+
+  static bool decompress(ZSTD_DCtx* dctx, Job& job)
+  {
+    auto content_size = ZSTD_getFrameContentSize(job.input.data(), job.input.size());
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR) {
+      job.output.reset(new char[content_size]);
+      auto size = ZSTD_decompressDCtx(dctx, job.output.get(), content_size, job.input.data(), job.input.size());
+      if (ZSTD_isError(size) || size != content_size) {
+        return false;
+      }
+      job.output_size = size;
+      return true;
+    }
+    // Frames written by a streaming compressor do not carry their content size
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    size_t capacity = std::max<size_t>(ZSTD_DStreamOutSize(), 4 * job.input.size());
+    job.output.reset(new char[capacity]);
+    ZSTD_inBuffer in{ job.input.data(), job.input.size(), 0 };
+    while (true) {
+      if (job.output_size == capacity) {
+        std::unique_ptr<char[]> larger(new char[2 * capacity]);
+        std::memcpy(larger.get(), job.output.get(), job.output_size);
+        job.output = std::move(larger);
+        capacity *= 2;
+      }
+      ZSTD_outBuffer out{ job.output.get(), capacity, job.output_size };
+      auto ret = ZSTD_decompressStream(dctx, &out, &in);
+      if (ZSTD_isError(ret)) {
+        return false;
+      }
+      job.output_size = out.pos;
+      if (ret == 0) {
+        return true; // end of the frame
+      }
+      if (in.pos == in.size && out.pos < out.size) {
+        return false; // the frame needs more input than it has
+      }
+    }
+  }
+
+  void run_worker()
+  {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (m_dictionary) {
+      m_dictionary->load_into(dctx);
+    }
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_cv.wait(lock, [&] { return m_quit || !m_todo.empty(); });
+        if (m_quit) {
+          break;
+        }
+        job = std::move(m_todo.front());
+        m_todo.pop_front();
+      }
+      job->ok = decompress(dctx, *job);
+      if (!job->ok) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "zstd decompression failed";
+      }
+      std::vector<char>().swap(job->input);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job->done = true;
+      }
+      m_done_cv.notify_all();
+    }
+    ZSTD_freeDCtx(dctx);
+  }
+
+  size_t m_max_queued;
+  size_t m_read_size;
+  input_t m_input;
+  std::shared_ptr<const ZstdDictionary> m_dictionary;
+
+  // Compressed stream not yet split into frames
+  std::vector<char> m_raw;
+  size_t m_raw_begin = 0;
+  size_t m_raw_end = 0;
+  bool m_input_done = false;
+
+  // Frame being read from
+  std::shared_ptr<Job> m_current;
+  size_t m_current_pos = 0;
+
+  std::deque<std::shared_ptr<Job>> m_jobs; // in stream order, until read
+  std::deque<std::shared_ptr<Job>> m_todo; // not yet picked up by a worker
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  bool m_quit = false;
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_failed{ false };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PARALLELZSTDDECOMPRESSOR_HPP_
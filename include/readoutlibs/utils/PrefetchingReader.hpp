@@ -0,0 +1,177 @@
+/**
+ * @file PrefetchingReader.hpp Reads ahead of the consumer into a ring of
+ * buffers from a dedicated thread
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PREFETCHINGREADER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PREFETCHINGREADER_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Fills a ring of aligned buffers from an input function on a dedicated thread, up to num_buffers ahead of the
+ * consumer. Whatever the input does, e.g. reading with O_DIRECT or decompressing, runs on that thread; the consumer
+ * only copies out of full buffers, and only waits when the thread has not kept up.
+ */
+class PrefetchingReader
+{
+public:
+  // Read up to size bytes into data, which is aligned. Returns less than size only at the end of the input.
+  using input_t = std::function<size_t(char*, size_t)>;
+
+  PrefetchingReader(size_t num_buffers, size_t buffer_size, size_t alignment, input_t input)
+    : m_num_buffers(std::max<size_t>(num_buffers, 2))
+    , m_buffer_size((std::max<size_t>(buffer_size, 1) + alignment - 1) / alignment * alignment)
+    , m_input(std::move(input))
+  {
+    m_memory = static_cast<char*>(std::aligned_alloc(alignment, m_num_buffers * m_buffer_size));
+    if (m_memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    for (size_t i = 0; i < m_num_buffers; ++i) {
+      m_free.push_back(i);
+    }
+    m_thread = std::thread(&PrefetchingReader::run_reader, this);
+    pthread_setname_np(m_thread.native_handle(), "prefetcher");
+  }
+
+  ~PrefetchingReader()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    std::free(m_memory);
+  }
+
+  PrefetchingReader(const PrefetchingReader&) = delete;            ///< PrefetchingReader is not copy-constructible
+  PrefetchingReader& operator=(const PrefetchingReader&) = delete; ///< PrefetchingReader is not copy-assginable
+  PrefetchingReader(PrefetchingReader&&) = delete;                 ///< PrefetchingReader is not move-constructible
+  PrefetchingReader& operator=(PrefetchingReader&&) = delete;      ///< PrefetchingReader is not move-assignable
+
+  // Copy up to size bytes. Returns the number of bytes copied: less than size only at the end of the input.
+  size_t read(char* destination, size_t size)
+  {
+    size_t copied = 0;
+    while (copied < size) {
+      if (m_current_pos < m_current_size) {
+        size_t n = std::min(size - copied, m_current_size - m_current_pos);
+        std::memcpy(destination + copied, m_memory + m_current * m_buffer_size + m_current_pos, n);
+        m_current_pos += n;
+        copied += n;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_has_current) {
+        m_free.push_back(m_current);
+        m_has_current = false;
+        m_cv.notify_all();
+      }
+      if (m_full.empty() && !m_done) {
+        ++m_num_stalls;
+        m_cv.wait(lock, [&] { return !m_full.empty() || m_done; });
+      }
+      if (m_full.empty()) {
+        break;
+      }
+      std::tie(m_current, m_current_size) = m_full.front();
+      m_full.pop_front();
+      m_current_pos = 0;
+      m_has_current = true;
+    }
+    return copied;
+  }
+
+  // Whether the input failed, rather than ended
+  bool failed() const { return m_failed; }
+
+  // Number of reads that had to wait for the input
+  size_t get_num_stalls() const { return m_num_stalls; }
+
+private:
+  void run_reader()
+  {
+    while (true) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_quit || !m_free.empty(); });
+        if (m_quit) {
+          return;
+        }
+        index = m_free.front();
+        m_free.pop_front();
+      }
+      size_t size = 0;
+      try {
+        size = m_input(m_memory + index * m_buffer_size, m_buffer_size);
+      } catch (const std::exception& e) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Prefetching failed: " << e.what();
+        m_failed = true;
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_full.emplace_back(index, size);
+        m_done = size < m_buffer_size;
+      }
+      m_cv.notify_all();
+      if (size < m_buffer_size) {
+        return;
+      }
+    }
+  }
+
+  size_t m_num_buffers;
+  size_t m_buffer_size;
+  input_t m_input;
+  char* m_memory = nullptr;
+
+  // Buffer being consumed, owned by the consumer
+  size_t m_current = 0;
+  size_t m_current_size = 0;
+  size_t m_current_pos = 0;
+  bool m_has_current = false;
+
+  std::deque<size_t> m_free;
+  std::deque<std::pair<size_t, size_t>> m_full; // buffer index and size, in input order
+  bool m_done = false;
+  bool m_quit = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+  std::atomic<bool> m_failed{ false };
+  std::atomic<size_t> m_num_stalls{ 0 };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_PREFETCHINGREADER_HPP_
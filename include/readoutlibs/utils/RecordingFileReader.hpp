@@ -0,0 +1,232 @@
+/**
+ * @file RecordingFileReader.hpp Sequential and timestamp-indexed reading of
+ * files in the indexed recording format
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEREADER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEREADER_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/RecordingFormat.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Reads the element stream of an indexed recording, record by record, and positions it on the data record holding
+ * a given timestamp. The index is loaded on the first seek, from the trailer at the end of the file, or by walking
+ * the records if the file has no trailer.
+ */
+class RecordingFileReader
+{
+public:
+  /**
+   * @param fd Descriptor of the file, positioned anywhere. Closed on destruction.
+   * @param dictionary The zstd dictionary the records were compressed with, if any.
+   * @throw ConfigurationError If the file header is not valid.
+   */
+  explicit RecordingFileReader(int fd, std::shared_ptr<const ZstdDictionary> dictionary = nullptr)
+    : m_fd(fd)
+  {
+    if (::pread(m_fd, &m_header, sizeof(m_header), 0) != sizeof(m_header) ||
+        !recording::is_recording_file_header(m_header.magic, sizeof(m_header.magic))) {
+      ::close(m_fd);
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Not an indexed recording file");
+    }
+    m_codec = std::string(m_header.codec, strnlen(m_header.codec, sizeof(m_header.codec)));
+    if (m_codec != "None" && m_codec != "zstd") {
+      ::close(m_fd);
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Non-recognized recording codec: " + m_codec);
+    }
+    m_next_offset = m_header.header_size;
+    struct stat st;
+    m_file_size = ::fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    m_dctx = ZSTD_createDCtx();
+    if (dictionary) {
+      dictionary->load_into(m_dctx);
+    }
+  }
+
+  ~RecordingFileReader()
+  {
+    ZSTD_freeDCtx(m_dctx);
+    ::close(m_fd);
+  }
+
+  RecordingFileReader(const RecordingFileReader&) = delete;            ///< RecordingFileReader is not copy-constructible
+  RecordingFileReader& operator=(const RecordingFileReader&) = delete; ///< RecordingFileReader is not copy-assginable
+  RecordingFileReader(RecordingFileReader&&) = delete;                 ///< RecordingFileReader is not move-constructible
+  RecordingFileReader& operator=(RecordingFileReader&&) = delete;      ///< RecordingFileReader is not move-assignable
+
+  const recording::FileHeader& get_header() const { return m_header; }
+
+  // Whether a data record was found truncated or corrupt
+  bool failed() const { return m_failed; }
+
+  // Copy up to size bytes of the element stream. Returns the number of bytes copied, less than size only at the end.
+  size_t read(char* destination, size_t size)
+  {
+    size_t copied = 0;
+    while (copied < size) {
+      if (m_content_pos == m_content.size() && !load_next_data_record()) {
+        break;
+      }
+      size_t n = std::min(size - copied, m_content.size() - m_content_pos);
+      std::memcpy(destination + copied, m_content.data() + m_content_pos, n);
+      m_content_pos += n;
+      copied += n;
+    }
+    return copied;
+  }
+
+  /**
+   * Position the stream on the first element of the first data record with elements at or after the timestamp.
+   * @return false if there is no such record.
+   */
+  bool seek_to_record(uint64_t timestamp) // NOLINT(build/unsigned)
+  {
+    if (!m_index_loaded) {
+      load_index();
+    }
+    auto entry = std::lower_bound(
+      m_index.begin(), m_index.end(), timestamp, [](const recording::IndexEntry& e, uint64_t ts) { // NOLINT
+        return e.last_timestamp < ts;
+      });
+    if (entry == m_index.end()) {
+      return false;
+    }
+    m_next_offset = entry->offset;
+    if (!load_next_data_record()) {
+      return false;
+    }
+    m_content_pos = std::min<size_t>(m_record.first_element_offset, m_content.size());
+    return true;
+  }
+
+private:
+  bool read_record_header(uint64_t offset, recording::RecordHeader& header) // NOLINT(build/unsigned)
+  {
+    if (::pread(m_fd, &header, sizeof(header), offset) != sizeof(header) ||
+        std::memcmp(header.magic, recording::s_record_magic, sizeof(header.magic)) != 0 ||
+        header.record_size < sizeof(header)) {
+      return false;
+    }
+    return true;
+  }
+
+  bool load_next_data_record()
+  {
+    recording::RecordHeader header;
+    while (read_record_header(m_next_offset, header)) {
+      uint64_t offset = m_next_offset; // NOLINT(build/unsigned)
+      m_next_offset += header.record_size;
+      if (header.type != recording::kDataRecord) {
+        continue;
+      }
+      m_record = header;
+      m_content_pos = 0;
+      m_stored.resize(header.stored_size);
+      if (::pread(m_fd, m_stored.data(), header.stored_size, offset + header.payload_offset) !=
+          static_cast<ssize_t>(header.stored_size)) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Truncated data record at offset " << offset;
+        m_failed = true;
+        break;
+      }
+      if (m_codec == "None") {
+        std::swap(m_content, m_stored);
+        return true;
+      }
+      m_content.resize(header.content_size);
+      auto size = ZSTD_decompressDCtx(m_dctx, m_content.data(), m_content.size(), m_stored.data(), m_stored.size());
+      if (ZSTD_isError(size) || size != header.content_size) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Corrupt data record at offset " << offset;
+        m_failed = true;
+        break;
+      }
+      return true;
+    }
+    m_content.clear();
+    m_content_pos = 0;
+    return false;
+  }
+
+  void load_index()
+  {
+    m_index_loaded = true;
+    m_index.clear();
+    recording::RecordHeader trailer;
+    if (m_file_size >= m_header.header_size + sizeof(trailer) &&
+        read_record_header(m_file_size - sizeof(trailer), trailer) && trailer.type == recording::kTrailerRecord) {
+      // Walk the chain of index records back from the last one
+      std::vector<std::vector<recording::IndexEntry>> chunks;
+      recording::RecordHeader header;
+      for (uint64_t offset = trailer.previous_index_offset; offset != 0; // NOLINT(build/unsigned)
+           offset = header.previous_index_offset) {
+        if (!read_record_header(offset, header) || header.type != recording::kIndexRecord) {
+          break;
+        }
+        std::vector<recording::IndexEntry> entries(header.stored_size / sizeof(recording::IndexEntry));
+        if (::pread(m_fd, entries.data(), entries.size() * sizeof(recording::IndexEntry), offset + header.payload_offset) !=
+            static_cast<ssize_t>(entries.size() * sizeof(recording::IndexEntry))) {
+          break;
+        }
+        chunks.push_back(std::move(entries));
+      }
+      for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk) {
+        m_index.insert(m_index.end(), chunk->begin(), chunk->end());
+      }
+      return;
+    }
+
+    TLOG_DEBUG(TLVL_WORK_STEPS) << "No trailer found, indexing the recording by walking its records";
+    recording::RecordHeader header;
+    for (uint64_t offset = m_header.header_size; read_record_header(offset, header); // NOLINT(build/unsigned)
+         offset += header.record_size) {
+      if (header.type == recording::kDataRecord && header.first_element_offset < header.content_size) {
+        m_index.push_back({ header.first_timestamp, header.last_timestamp, offset, header.content_size });
+      }
+    }
+  }
+
+  int m_fd;
+  recording::FileHeader m_header;
+  std::string m_codec;
+  uint64_t m_file_size = 0; // NOLINT(build/unsigned)
+  ZSTD_DCtx* m_dctx = nullptr;
+
+  // Current data record
+  uint64_t m_next_offset = 0; // NOLINT(build/unsigned)
+  recording::RecordHeader m_record;
+  std::vector<char> m_stored;
+  std::vector<char> m_content;
+  size_t m_content_pos = 0;
+
+  bool m_index_loaded = false;
+  bool m_failed = false;
+  std::vector<recording::IndexEntry> m_index;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEREADER_HPP_
@@ -0,0 +1,448 @@
+/**
+ * @file RecordingFileWriter.hpp Writes recordings either as raw element
+ * streams or in the indexed recording format
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEWRITER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEWRITER_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/utils/BufferedFileWriter.hpp"
+#include "readoutlibs/utils/FilePreallocator.hpp"
+#include "readoutlibs/utils/ParallelZstdCompressor.hpp"
+#include "readoutlibs/utils/RecordingFormat.hpp"
+#include "readoutlibs/utils/StripedFileWriter.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Description of a recording. format is "raw" for a headerless stream of elements, or "indexed" for the format of
+ * RecordingFormat.hpp, with data records of up to the writer's buffer size. Raw recordings can be striped over
+ * stripe_directories, in units of stripe_size bytes.
+ * With a segment_size, the recording is split into files of about that many bytes of elements, before compression.
+ * Each segment is complete on its own and named after the run and the timestamps of its first and last elements.
+ */
+struct RecordingFileOptions
+{
+  std::string format = "raw";
+  uint32_t subsystem = 0; // NOLINT(build/unsigned)
+  uint32_t source_id = 0; // NOLINT(build/unsigned)
+  size_t element_size = 0;
+  uint64_t clock_frequency_hz = 62500000; // NOLINT(build/unsigned)
+  size_t index_interval = 64;             // data records per index record
+  std::vector<std::string> stripe_directories;
+  size_t stripe_size = 8388608;
+  size_t segment_size = 0;
+};
+
+/**
+ * Writes whole elements to a recording file through a BufferedFileWriter. In the indexed format, elements are
+ * grouped into data records, compressed on their own with zstd if requested, and indexed by timestamp. Each
+ * flush() completes the index, so the file can be searched by timestamp after every recording.
+ *
+ * Segmented recordings write to <filename>.seg<N>.inprogress files, preallocated in the background while the
+ * previous segment is written. A segment is complete once the next one is started, or after flush() or close(). It
+ * is then renamed to <filename>.run<run>.seg<N>.<first timestamp>-<last timestamp>.
+ */
+class RecordingFileWriter
+{
+public:
+  RecordingFileWriter() {}
+
+  ~RecordingFileWriter()
+  {
+    if (is_open()) {
+      close();
+    }
+  }
+
+  RecordingFileWriter(const RecordingFileWriter&) = delete;            ///< RecordingFileWriter is not copy-constructible
+  RecordingFileWriter& operator=(const RecordingFileWriter&) = delete; ///< RecordingFileWriter is not copy-assginable
+  RecordingFileWriter(RecordingFileWriter&&) = delete;                 ///< RecordingFileWriter is not move-constructible
+  RecordingFileWriter& operator=(RecordingFileWriter&&) = delete;      ///< RecordingFileWriter is not move-assignable
+
+  /**
+   * Open a file, or prepare the first segment. Existing data will be overwritten.
+   * @throw CannotOpenFile If the file can not be opened.
+   * @throw ConfigurationError If the format or its combination with the writer options is not supported.
+   */
+  void open(const std::string& filename,
+            const BufferedFileWriterOptions& writer_options,
+            const RecordingFileOptions& options)
+  {
+    if (is_open()) {
+      close();
+    }
+    if (options.segment_size == 0) {
+      open_file(filename, writer_options, options);
+      return;
+    }
+    if (!options.stripe_directories.empty()) {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Striped recordings can not be segmented");
+    }
+    if (options.format != "raw" && options.format != "indexed") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Non-recognized recording format: " + options.format);
+    }
+    m_segmented = true;
+    m_filename = filename;
+    m_writer_options = writer_options;
+    m_options = options;
+    m_segment_index = 0;
+    m_preallocator.prepare(segment_file_name(m_segment_index), m_options.segment_size);
+  }
+
+  bool is_open() const { return m_segmented || file_is_open(); }
+
+  // Run number used in the names of the segments completed from now on
+  void set_run_number(uint32_t run_number) { m_run_number = run_number; } // NOLINT(build/unsigned)
+
+  /**
+   * Write whole elements.
+   * @param first_timestamp Timestamp of the first of the elements
+   * @param last_timestamp Timestamp of the last of the elements
+   * @return true if the write was successful, false if the writer is not open or the write was not successful.
+   */
+  bool write(const char* memory,
+             size_t size,
+             uint64_t first_timestamp, // NOLINT(build/unsigned)
+             uint64_t last_timestamp)  // NOLINT(build/unsigned)
+  {
+    if (m_segmented) {
+      if (file_is_open() && m_segment_bytes > 0 && m_segment_bytes + size > m_options.segment_size) {
+        close_segment();
+      }
+      if (!file_is_open() && !open_segment()) {
+        return false;
+      }
+      if (m_segment_bytes == 0) {
+        m_segment_first_timestamp = first_timestamp;
+      }
+      m_segment_last_timestamp = last_timestamp;
+      m_segment_bytes += size;
+    }
+    return write_file(memory, size, first_timestamp, last_timestamp);
+  }
+
+  /**
+   * Write all data to the file. In the indexed format, the index is completed. A segment is completed.
+   */
+  void flush()
+  {
+    if (m_segmented) {
+      if (file_is_open()) {
+        close_segment();
+      }
+      return;
+    }
+    flush_file();
+  }
+
+  void close()
+  {
+    if (m_segmented) {
+      if (file_is_open()) {
+        close_segment();
+      }
+      // Drop the segment prepared in advance
+      m_preallocator.wait();
+      ::unlink(m_preallocator.get_filename().c_str());
+      m_segmented = false;
+      return;
+    }
+    close_file();
+  }
+
+  BlockWriterStats& get_block_stats()
+  {
+    return m_striped_writer.is_open() ? m_striped_writer.get_block_stats() : m_writer.get_block_stats();
+  }
+
+private:
+  void open_file(const std::string& filename,
+                 const BufferedFileWriterOptions& writer_options,
+                 const RecordingFileOptions& options)
+  {
+    if (options.format == "raw") {
+      m_indexed = false;
+      if (options.stripe_directories.empty()) {
+        m_writer.open(filename, writer_options);
+      } else {
+        m_striped_writer.open(filename, options.stripe_directories, options.stripe_size, writer_options);
+      }
+      return;
+    }
+    if (options.format != "indexed") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Non-recognized recording format: " + options.format);
+    }
+    if (!options.stripe_directories.empty()) {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Indexed recordings can not be striped");
+    }
+    if (writer_options.compression_algorithm != "None" && writer_options.compression_algorithm != "zstd") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE,
+                                                   "The indexed recording format does not support " +
+                                                     writer_options.compression_algorithm + " compression");
+    }
+
+    // Compression is applied here per data record, the writer only sees the records
+    BufferedFileWriterOptions raw_options = writer_options;
+    raw_options.compression_algorithm = "None";
+    raw_options.compression_threads = 0;
+    raw_options.compression_dictionary.clear();
+    m_writer.open(filename, raw_options);
+
+    m_indexed = true;
+    m_failed = false;
+    m_unflushed = false;
+    m_block_size = writer_options.buffer_size;
+    m_index_interval = std::max<size_t>(options.index_interval, 1);
+    m_block.clear();
+    m_block.reserve(m_block_size);
+    m_pending_blocks.clear();
+    m_index.reset();
+    m_offset = 0;
+
+    auto header = recording::make_file_header(options.subsystem,
+                                              options.source_id,
+                                              options.element_size,
+                                              options.clock_frequency_hz,
+                                              m_block_size,
+                                              writer_options.compression_algorithm);
+    write_out(header.data(), header.size());
+
+    if (writer_options.compression_algorithm == "zstd") {
+      std::shared_ptr<const ZstdDictionary> dictionary;
+      if (!writer_options.compression_dictionary.empty()) {
+        dictionary = std::make_shared<ZstdDictionary>(ZstdDictionary::read(writer_options.compression_dictionary));
+      }
+      m_compressor = std::make_unique<ParallelZstdCompressor>(
+        std::max<size_t>(writer_options.compression_threads, 1),
+        writer_options.compression_level,
+        [this](const char* data, size_t size) { return write_data_record(data, size); },
+        dictionary);
+    } else if (!writer_options.compression_dictionary.empty()) {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Compression dictionaries are only supported with zstd");
+    }
+  }
+
+  bool file_is_open() const { return m_writer.is_open() || m_striped_writer.is_open(); }
+
+  bool write_file(const char* memory,
+                  size_t size,
+                  uint64_t first_timestamp, // NOLINT(build/unsigned)
+                  uint64_t last_timestamp)  // NOLINT(build/unsigned)
+  {
+    if (m_striped_writer.is_open()) {
+      return m_striped_writer.write(memory, size);
+    }
+    if (!m_indexed) {
+      return m_writer.write(memory, size);
+    }
+    if (!file_is_open()) {
+      return false;
+    }
+    bool ok = true;
+    if (!m_block.empty() && m_block.size() + size > m_block_size) {
+      ok = seal_block();
+    }
+    if (m_block.empty()) {
+      m_block_first_timestamp = first_timestamp;
+    }
+    m_block_last_timestamp = last_timestamp;
+    m_block.insert(m_block.end(), memory, memory + size);
+    m_unflushed = true;
+    return ok && !m_failed;
+  }
+
+  void flush_file()
+  {
+    if (m_indexed && file_is_open()) {
+      finish_index();
+    }
+    m_writer.flush();
+    m_striped_writer.flush();
+  }
+
+  void close_file()
+  {
+    if (m_indexed && file_is_open()) {
+      finish_index();
+      m_compressor.reset();
+    }
+    m_writer.close();
+    m_striped_writer.close();
+  }
+
+  std::string segment_file_name(size_t index) const
+  {
+    return m_filename + ".seg" + std::to_string(index) + ".inprogress";
+  }
+
+  // Open the segment prepared in advance, and start preparing the next one
+  bool open_segment()
+  {
+    if (!m_preallocator.wait()) {
+      TLOG_DEBUG(TLVL_WORK_STEPS) << "Segment " << m_preallocator.get_filename() << " is not preallocated";
+    }
+    try {
+      open_file(m_preallocator.get_filename(), m_writer_options, m_options);
+    } catch (const ers::Issue& excpt) {
+      ers::error(excpt);
+      return false;
+    }
+    m_segment_file = m_preallocator.get_filename();
+    m_open_segment_index = m_segment_index;
+    m_segment_bytes = 0;
+    m_preallocator.prepare(segment_file_name(++m_segment_index), m_options.segment_size);
+    return true;
+  }
+
+  // Complete the open segment: release its unused preallocated space, and give it its final name
+  void close_segment()
+  {
+    close_file();
+    struct stat st;
+    if (::stat(m_segment_file.c_str(), &st) != 0 || ::truncate(m_segment_file.c_str(), st.st_size) != 0) {
+      ers::warning(CannotCompleteSegment(
+        ERS_HERE, m_segment_file, "unused preallocated space not released: " + std::string(strerror(errno))));
+    }
+    auto name = m_filename + ".run" + std::to_string(m_run_number) + ".seg" + std::to_string(m_open_segment_index) +
+                "." + std::to_string(m_segment_first_timestamp) + "-" + std::to_string(m_segment_last_timestamp);
+    if (std::rename(m_segment_file.c_str(), name.c_str()) != 0) {
+      ers::warning(
+        CannotCompleteSegment(ERS_HERE, m_segment_file, "not renamed to " + name + ": " + std::string(strerror(errno))));
+    }
+    m_segment_bytes = 0;
+  }
+
+  struct BlockInfo
+  {
+    uint64_t first_timestamp; // NOLINT(build/unsigned)
+    uint64_t last_timestamp;  // NOLINT(build/unsigned)
+    size_t content_size;
+  };
+
+  bool write_out(const char* data, size_t size)
+  {
+    if (!m_writer.write(data, size)) {
+      m_failed = true;
+      return false;
+    }
+    m_offset += size;
+    return true;
+  }
+
+  bool seal_block()
+  {
+    m_pending_blocks.push_back({ m_block_first_timestamp, m_block_last_timestamp, m_block.size() });
+    if (!m_compressor) {
+      bool ok = write_data_record(m_block.data(), m_block.size());
+      m_block.clear();
+      return ok;
+    }
+    std::vector<char> block;
+    block.reserve(m_block_size);
+    std::swap(block, m_block);
+    return m_compressor->compress(std::move(block));
+  }
+
+  // Called in order for each sealed block, with its stored payload
+  bool write_data_record(const char* payload, size_t stored_size)
+  {
+    auto info = m_pending_blocks.front();
+    m_pending_blocks.pop_front();
+    auto header = recording::make_record_header(recording::kDataRecord, sizeof(recording::RecordHeader), stored_size, 1);
+    header.content_size = info.content_size;
+    header.first_element_offset = 0;
+    header.first_timestamp = info.first_timestamp;
+    header.last_timestamp = info.last_timestamp;
+    m_index.add({ info.first_timestamp, info.last_timestamp, m_offset, info.content_size });
+    bool ok = write_out(reinterpret_cast<const char*>(&header), sizeof(header)) && // NOLINT
+              write_out(payload, stored_size);
+    if (m_index.num_pending() >= m_index_interval) {
+      ok = write_index() && ok;
+    }
+    return ok;
+  }
+
+  bool write_index()
+  {
+    auto record = m_index.make_index_record(m_offset);
+    return write_out(record.data(), record.size());
+  }
+
+  void finish_index()
+  {
+    if (!m_unflushed) {
+      return;
+    }
+    m_unflushed = false;
+    if (!m_block.empty()) {
+      seal_block();
+    }
+    if (m_compressor) {
+      m_compressor->flush();
+    }
+    if (m_index.num_pending() > 0) {
+      write_index();
+    }
+    auto trailer = m_index.make_trailer_record(m_offset, s_trailer_alignment);
+    write_out(trailer.data(), trailer.size());
+  }
+
+  // Trailers end aligned, so that the writer can go on with O_DIRECT after a flush
+  static constexpr size_t s_trailer_alignment = 4096;
+
+  BufferedFileWriter<> m_writer;
+  StripedFileWriter m_striped_writer;
+  bool m_indexed = false;
+  bool m_failed = false;
+  bool m_unflushed = false; // data written since the last trailer
+
+  size_t m_block_size = 0;
+  size_t m_index_interval = 64;
+  std::vector<char> m_block;
+  uint64_t m_block_first_timestamp = 0; // NOLINT(build/unsigned)
+  uint64_t m_block_last_timestamp = 0;  // NOLINT(build/unsigned)
+  std::deque<BlockInfo> m_pending_blocks;
+  std::unique_ptr<ParallelZstdCompressor> m_compressor;
+
+  recording::IndexBuilder m_index;
+  uint64_t m_offset = 0; // NOLINT(build/unsigned)
+
+  // Segmented recordings
+  bool m_segmented = false;
+  std::string m_filename;
+  BufferedFileWriterOptions m_writer_options;
+  RecordingFileOptions m_options;
+  uint32_t m_run_number = 0; // NOLINT(build/unsigned)
+  FilePreallocator m_preallocator;
+  size_t m_segment_index = 0; // of the segment being prepared
+  size_t m_open_segment_index = 0;
+  std::string m_segment_file;
+  size_t m_segment_bytes = 0;
+  uint64_t m_segment_first_timestamp = 0; // NOLINT(build/unsigned)
+  uint64_t m_segment_last_timestamp = 0;  // NOLINT(build/unsigned)
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFILEWRITER_HPP_
@@ -0,0 +1,208 @@
+/**
+ * @file RecordingFormat.hpp Layout of the indexed recording files: a file
+ * header describing the data, data records and a periodic block index
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFORMAT_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFORMAT_HPP_
+
+#include <boost/align/aligned_allocator.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+namespace recording {
+
+/**
+ * An indexed recording is a file header followed by records. Data records hold a block of the element stream, as
+ * stored by the codec of the file. Every few data records, an index record lists the timestamp range and offset of
+ * each data record since the previous index record. Each flush of the writer ends with a trailer record pointing to
+ * the last index record; the last bytes of a complete file are a copy of that trailer's header, so that the index can
+ * be found from the end of the file. Without a trailer (e.g. after a crash), the data records can still be walked
+ * from the start.
+ *
+ * Records are made of a RecordHeader, the payload at payload_offset, and padding up to record_size. Writers that
+ * need aligned writes pad the records, and the header space of data records, to the alignment. All integers are
+ * little endian.
+ */
+
+constexpr char s_file_magic[8] = { 'D', 'U', 'N', 'E', 'R', 'E', 'C', '1' };
+constexpr char s_record_magic[4] = { 'D', 'R', 'E', 'C' };
+constexpr uint32_t s_version = 1;      // NOLINT(build/unsigned)
+constexpr size_t s_file_header_size = 4096;
+
+enum RecordType : uint32_t // NOLINT(build/unsigned)
+{
+  kDataRecord = 1,
+  kIndexRecord = 2,
+  kTrailerRecord = 3
+};
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;            // NOLINT(build/unsigned)
+  uint32_t header_size;        // NOLINT(build/unsigned) offset of the first record
+  uint32_t subsystem;          // NOLINT(build/unsigned) of the source ID
+  uint32_t source_id;          // NOLINT(build/unsigned)
+  uint64_t element_size;       // NOLINT(build/unsigned) size of one element of the stream
+  uint64_t clock_frequency_hz; // NOLINT(build/unsigned) of the timestamps
+  uint64_t block_size;         // NOLINT(build/unsigned) nominal content size of a data record
+  uint64_t creation_time_ns;   // NOLINT(build/unsigned) since the epoch
+  char codec[16];              // None or zstd, applied to each data record on its own
+};
+static_assert(sizeof(FileHeader) <= s_file_header_size, "FileHeader must fit in its reserved space");
+
+struct RecordHeader
+{
+  char magic[4];
+  uint32_t type;                  // NOLINT(build/unsigned) RecordType
+  uint64_t record_size;           // NOLINT(build/unsigned) header, payload and padding
+  uint64_t payload_offset;        // NOLINT(build/unsigned) from the start of the record
+  uint64_t stored_size;           // NOLINT(build/unsigned) of the payload, as stored
+  uint64_t content_size;          // NOLINT(build/unsigned) of the payload, decoded
+  uint64_t first_element_offset;  // NOLINT(build/unsigned) in the content, of the first element starting in it
+  uint64_t first_timestamp;       // NOLINT(build/unsigned) of the first element starting in the content
+  uint64_t last_timestamp;        // NOLINT(build/unsigned) of the last element starting in the content
+  uint64_t previous_index_offset; // NOLINT(build/unsigned) index and trailer records: previous index record, or 0
+  uint64_t reserved;              // NOLINT(build/unsigned)
+};
+static_assert(sizeof(RecordHeader) == 80, "RecordHeader must stay packed in 80 bytes");
+
+// One entry of an index record, per data record holding the start of at least one element
+struct IndexEntry
+{
+  uint64_t first_timestamp; // NOLINT(build/unsigned)
+  uint64_t last_timestamp;  // NOLINT(build/unsigned)
+  uint64_t offset;          // NOLINT(build/unsigned) of the data record in the file
+  uint64_t content_size;    // NOLINT(build/unsigned)
+};
+static_assert(sizeof(IndexEntry) == 32, "IndexEntry must stay packed in 32 bytes");
+
+using aligned_buffer_t = std::vector<char, boost::alignment::aligned_allocator<char, 4096>>;
+
+inline size_t
+round_up(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+inline bool
+is_recording_file_header(const char* data, size_t size)
+{
+  return size >= sizeof(s_file_magic) && std::memcmp(data, s_file_magic, sizeof(s_file_magic)) == 0;
+}
+
+inline aligned_buffer_t
+make_file_header(uint32_t subsystem,          // NOLINT(build/unsigned)
+                 uint32_t source_id,          // NOLINT(build/unsigned)
+                 uint64_t element_size,       // NOLINT(build/unsigned)
+                 uint64_t clock_frequency_hz, // NOLINT(build/unsigned)
+                 uint64_t block_size,         // NOLINT(build/unsigned)
+                 const std::string& codec)
+{
+  aligned_buffer_t buffer(s_file_header_size, 0);
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, s_file_magic, sizeof(header.magic));
+  header.version = s_version;
+  header.header_size = s_file_header_size;
+  header.subsystem = subsystem;
+  header.source_id = source_id;
+  header.element_size = element_size;
+  header.clock_frequency_hz = clock_frequency_hz;
+  header.block_size = block_size;
+  header.creation_time_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  std::strncpy(header.codec, codec.c_str(), sizeof(header.codec) - 1);
+  std::memcpy(buffer.data(), &header, sizeof(header));
+  return buffer;
+}
+
+inline RecordHeader
+make_record_header(RecordType type, size_t header_space, size_t stored_size, size_t alignment)
+{
+  RecordHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, s_record_magic, sizeof(header.magic));
+  header.type = type;
+  header.payload_offset = header_space;
+  header.stored_size = stored_size;
+  header.content_size = stored_size;
+  header.record_size = round_up(header_space + stored_size, alignment);
+  return header;
+}
+
+/**
+ * Collects the index entries of the data records as they are written, and lays out the index and trailer records.
+ */
+class IndexBuilder
+{
+public:
+  explicit IndexBuilder(size_t alignment = 1)
+    : m_alignment(alignment)
+  {}
+
+  void add(const IndexEntry& entry) { m_entries.push_back(entry); }
+
+  size_t num_pending() const { return m_entries.size(); }
+
+  // An index record of the entries added since the previous one, to be written at the given offset of the file
+  aligned_buffer_t make_index_record(uint64_t offset) // NOLINT(build/unsigned)
+  {
+    auto header =
+      make_record_header(kIndexRecord, sizeof(RecordHeader), m_entries.size() * sizeof(IndexEntry), m_alignment);
+    header.previous_index_offset = m_last_index_offset;
+    if (!m_entries.empty()) {
+      header.first_timestamp = m_entries.front().first_timestamp;
+      header.last_timestamp = m_entries.back().last_timestamp;
+    }
+    aligned_buffer_t buffer(header.record_size, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    if (!m_entries.empty()) {
+      std::memcpy(buffer.data() + header.payload_offset, m_entries.data(), header.stored_size);
+    }
+    m_entries.clear();
+    m_last_index_offset = offset;
+    return buffer;
+  }
+
+  // A trailer pointing to the last index record, to be written at the given offset of the file. Its header is
+  // repeated at its end, which is padded to a multiple of end_alignment in the file so that writing can go on aligned.
+  aligned_buffer_t make_trailer_record(uint64_t offset, size_t end_alignment) const // NOLINT(build/unsigned)
+  {
+    auto header = make_record_header(kTrailerRecord, sizeof(RecordHeader), 0, 1);
+    header.record_size = round_up(offset + 2 * sizeof(RecordHeader), end_alignment) - offset;
+    header.previous_index_offset = m_last_index_offset;
+    aligned_buffer_t buffer(header.record_size, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    std::memcpy(buffer.data() + buffer.size() - sizeof(header), &header, sizeof(header));
+    return buffer;
+  }
+
+  void reset()
+  {
+    m_entries.clear();
+    m_last_index_offset = 0;
+  }
+
+private:
+  size_t m_alignment;
+  std::vector<IndexEntry> m_entries;
+  uint64_t m_last_index_offset = 0; // NOLINT(build/unsigned)
+};
+
+} // namespace recording
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_RECORDINGFORMAT_HPP_
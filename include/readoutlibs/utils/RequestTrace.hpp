@@ -0,0 +1,163 @@
+/**
+ * @file RequestTrace.hpp Compact binary trace of incoming data requests,
+ * for offline replay
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_REQUESTTRACE_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_REQUESTTRACE_HPP_
+
+#include "readoutlibs/utils/BufferedFileWriter.hpp"
+
+#include "dfmessages/DataRequest.hpp"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+// One traced request, as written to the trace file
+struct RequestTraceRecord
+{
+  uint64_t arrival_ns;        // NOLINT(build/unsigned) system clock, ns since epoch
+  uint64_t trigger_number;    // NOLINT(build/unsigned)
+  uint64_t trigger_timestamp; // NOLINT(build/unsigned)
+  uint64_t window_begin;      // NOLINT(build/unsigned)
+  uint64_t window_end;        // NOLINT(build/unsigned)
+  uint32_t run_number;        // NOLINT(build/unsigned)
+  uint16_t sequence_number;   // NOLINT(build/unsigned)
+  uint8_t send_partial;       // NOLINT(build/unsigned)
+  uint8_t reserved;           // NOLINT(build/unsigned)
+  char data_destination[64];  // NUL-terminated, truncated to 63 characters
+};
+static_assert(sizeof(RequestTraceRecord) == 112, "RequestTraceRecord must stay packed in 112 bytes");
+
+/**
+ * Appends a RequestTraceRecord per traced request to a file. Thread-safe; trace() only queues the record, and a
+ * dedicated thread writes them out, so tracing never waits for the disk. At most max_queued records are queued:
+ * further ones are dropped and counted.
+ */
+class RequestTraceWriter
+{
+public:
+  RequestTraceWriter() {}
+
+  ~RequestTraceWriter() { close(); }
+
+  RequestTraceWriter(const RequestTraceWriter&) = delete;            ///< RequestTraceWriter is not copy-constructible
+  RequestTraceWriter& operator=(const RequestTraceWriter&) = delete; ///< RequestTraceWriter is not copy-assginable
+  RequestTraceWriter(RequestTraceWriter&&) = delete;                 ///< RequestTraceWriter is not move-constructible
+  RequestTraceWriter& operator=(RequestTraceWriter&&) = delete;      ///< RequestTraceWriter is not move-assignable
+
+  void open(const std::string& filename, size_t buffer_size = 1048576, size_t max_queued = 8192)
+  {
+    close();
+    remove(filename.c_str());
+    m_writer.open(filename, buffer_size, "None", false);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_max_queued = std::max<size_t>(max_queued, 1);
+      m_quit = false;
+    }
+    m_open = true;
+    m_thread = std::thread(&RequestTraceWriter::run_writer, this);
+    pthread_setname_np(m_thread.native_handle(), "reqtrace");
+  }
+
+  bool is_open() const { return m_open; }
+
+  void trace(const dfmessages::DataRequest& dr, bool send_partial_fragment_if_available)
+  {
+    RequestTraceRecord record;
+    record.arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+    record.trigger_number = dr.trigger_number;
+    record.trigger_timestamp = dr.trigger_timestamp;
+    record.window_begin = dr.request_information.window_begin;
+    record.window_end = dr.request_information.window_end;
+    record.run_number = dr.run_number;
+    record.sequence_number = dr.sequence_number;
+    record.send_partial = send_partial_fragment_if_available ? 1 : 0;
+    record.reserved = 0;
+    std::memset(record.data_destination, 0, sizeof(record.data_destination));
+    dr.data_destination.copy(record.data_destination, sizeof(record.data_destination) - 1);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_open || m_quit) {
+        return;
+      }
+      if (m_queued.size() >= m_max_queued) {
+        ++m_num_dropped;
+        return;
+      }
+      m_queued.push_back(record);
+    }
+    m_cv.notify_one();
+  }
+
+  // Number of records dropped because the writer thread fell behind, since the last call
+  uint64_t get_num_dropped() { return m_num_dropped.exchange(0); } // NOLINT(build/unsigned)
+
+  // Write out the queued records and close the file
+  void close()
+  {
+    if (!m_open) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    m_writer.close();
+    m_open = false;
+  }
+
+private:
+  void run_writer()
+  {
+    std::vector<RequestTraceRecord> records;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_quit || !m_queued.empty(); });
+        if (m_queued.empty()) {
+          return; // quit, and nothing left to write
+        }
+        records.assign(m_queued.begin(), m_queued.end());
+        m_queued.clear();
+      }
+      m_writer.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(RequestTraceRecord)); // NOLINT
+    }
+  }
+
+  BufferedFileWriter<> m_writer;
+  size_t m_max_queued = 8192;
+  std::deque<RequestTraceRecord> m_queued;
+  std::atomic<uint64_t> m_num_dropped{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<bool> m_open{ false };
+  bool m_quit = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_REQUESTTRACE_HPP_
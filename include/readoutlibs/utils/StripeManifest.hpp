@@ -0,0 +1,110 @@
+/**
+ * @file StripeManifest.hpp Manifest of a recording striped over several
+ * files, usually on different disks
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEMANIFEST_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEMANIFEST_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * A striped recording writes its stream in units of stripe_size bytes, round-robin to the stripe files. The
+ * manifest takes the place of the single output file and lists the stripes in order. Each stripe is compressed on
+ * its own, so stripe_size counts bytes of the uncompressed stream. It is a small text file:
+ *
+ *   DUNESTRIPES 1
+ *   stripe_size 8388608
+ *   compression None
+ *   stripe /disk0/output.out.0
+ *   stripe /disk1/output.out.1
+ */
+struct StripeManifest
+{
+  static constexpr const char* s_magic = "DUNESTRIPES";
+
+  size_t stripe_size = 0;
+  std::string compression_algorithm = "None";
+  std::vector<std::string> stripes;
+
+  static bool is_manifest(const char* data, size_t size)
+  {
+    return size >= std::strlen(s_magic) && std::memcmp(data, s_magic, std::strlen(s_magic)) == 0;
+  }
+
+  // The stripe file of a recording in one of the stripe directories
+  static std::string stripe_file_name(const std::string& directory, const std::string& filename, size_t index)
+  {
+    auto slash = filename.find_last_of('/');
+    auto base = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    return directory + "/" + base + "." + std::to_string(index);
+  }
+
+  /**
+   * @throw CannotOpenFile If the manifest can not be written.
+   */
+  void write(const std::string& filename) const
+  {
+    std::ofstream out(filename, std::ios::trunc);
+    out << s_magic << " 1\n"
+        << "stripe_size " << stripe_size << "\n"
+        << "compression " << compression_algorithm << "\n";
+    for (auto& stripe : stripes) {
+      out << "stripe " << stripe << "\n";
+    }
+    if (!out) {
+      throw BufferedReaderWriterCannotOpenFile(ERS_HERE, filename);
+    }
+  }
+
+  /**
+   * @throw CannotOpenFile If the manifest can not be read.
+   * @throw ConfigurationError If the manifest is not valid.
+   */
+  static StripeManifest read(const std::string& filename)
+  {
+    std::ifstream in(filename);
+    if (!in) {
+      throw BufferedReaderWriterCannotOpenFile(ERS_HERE, filename);
+    }
+    StripeManifest manifest;
+    std::string line;
+    std::getline(in, line);
+    if (line != std::string(s_magic) + " 1") {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Not a stripe manifest: " + filename);
+    }
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string key;
+      fields >> key;
+      if (key == "stripe_size") {
+        fields >> manifest.stripe_size;
+      } else if (key == "compression") {
+        fields >> manifest.compression_algorithm;
+      } else if (key == "stripe") {
+        manifest.stripes.push_back(line.substr(key.size() + 1));
+      }
+    }
+    if (manifest.stripe_size == 0 || manifest.stripes.empty()) {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Incomplete stripe manifest: " + filename);
+    }
+    return manifest;
+  }
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEMANIFEST_HPP_
@@ -0,0 +1,130 @@
+/**
+ * @file StripedFileWriter.hpp Writes a stream round-robin over several
+ * files, to combine the bandwidth of several disks
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEDFILEWRITER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEDFILEWRITER_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+#include "readoutlibs/utils/BufferedFileWriter.hpp"
+#include "readoutlibs/utils/StripeManifest.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Splits a stream into units of stripe_size bytes, written round-robin through one BufferedFileWriter per stripe
+ * directory. A StripeManifest is written in place of the single output file. With the threaded or io_uring
+ * backends, each stripe is written from its own queue, so the stripes proceed in parallel; with the stream backend
+ * they are written one after the other from the calling thread.
+ */
+class StripedFileWriter
+{
+public:
+  StripedFileWriter() {}
+
+  ~StripedFileWriter() { close(); }
+
+  StripedFileWriter(const StripedFileWriter&) = delete;            ///< StripedFileWriter is not copy-constructible
+  StripedFileWriter& operator=(const StripedFileWriter&) = delete; ///< StripedFileWriter is not copy-assginable
+  StripedFileWriter(StripedFileWriter&&) = delete;                 ///< StripedFileWriter is not move-constructible
+  StripedFileWriter& operator=(StripedFileWriter&&) = delete;      ///< StripedFileWriter is not move-assignable
+
+  /**
+   * Open the stripes and write the manifest. Existing data will be overwritten.
+   * @param filename The manifest file.
+   * @param stripe_directories One stripe file is created in each.
+   * @param stripe_size Bytes of the stream written to a stripe before moving to the next one.
+   * @throw CannotOpenFile If a file can not be opened.
+   * @throw ConfigurationError If the options are not supported.
+   */
+  void open(const std::string& filename,
+            const std::vector<std::string>& stripe_directories,
+            size_t stripe_size,
+            const BufferedFileWriterOptions& options)
+  {
+    close();
+    if (stripe_directories.empty() || stripe_size == 0) {
+      throw BufferedReaderWriterConfigurationError(ERS_HERE, "Striping needs stripe directories and a stripe size");
+    }
+    StripeManifest manifest;
+    manifest.stripe_size = stripe_size;
+    manifest.compression_algorithm = options.compression_algorithm;
+    BufferedFileWriterOptions stripe_options = options;
+    stripe_options.block_stats = &m_block_stats;
+    for (size_t i = 0; i < stripe_directories.size(); ++i) {
+      manifest.stripes.push_back(StripeManifest::stripe_file_name(stripe_directories[i], filename, i));
+      m_stripes.push_back(std::make_unique<BufferedFileWriter<>>());
+      m_stripes.back()->open(manifest.stripes.back(), stripe_options);
+    }
+    manifest.write(filename);
+    m_stripe_size = stripe_size;
+    m_current = 0;
+    m_current_fill = 0;
+  }
+
+  bool is_open() const { return !m_stripes.empty(); }
+
+  /**
+   * Write data to the stripes.
+   * @return true if the write was successful, false if the writer is not open or the write was not successful.
+   */
+  bool write(const char* memory, size_t size)
+  {
+    if (!is_open()) {
+      return false;
+    }
+    bool ok = true;
+    while (size > 0) {
+      size_t n = std::min(size, m_stripe_size - m_current_fill);
+      ok = m_stripes[m_current]->write(memory, n) && ok;
+      memory += n;
+      size -= n;
+      m_current_fill += n;
+      if (m_current_fill == m_stripe_size) {
+        m_current = (m_current + 1) % m_stripes.size();
+        m_current_fill = 0;
+      }
+    }
+    return ok;
+  }
+
+  void flush()
+  {
+    for (auto& stripe : m_stripes) {
+      stripe->flush();
+    }
+  }
+
+  void close()
+  {
+    for (auto& stripe : m_stripes) {
+      stripe->close();
+    }
+    m_stripes.clear();
+  }
+
+  // Statistics of the block backends, over all stripes
+  BlockWriterStats& get_block_stats() { return m_block_stats; }
+
+private:
+  BlockWriterStats m_block_stats;
+  std::vector<std::unique_ptr<BufferedFileWriter<>>> m_stripes;
+  size_t m_stripe_size = 0;
+  size_t m_current = 0;
+  size_t m_current_fill = 0;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_STRIPEDFILEWRITER_HPP_
@@ -0,0 +1,193 @@
+/**
+ * @file ThreadedBlockWriter.hpp Block writer backend that writes buffers
+ * from a dedicated I/O thread
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_THREADEDBLOCKWRITER_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_THREADEDBLOCKWRITER_HPP_
+
+#include "readoutlibs/ReadoutLogging.hpp"
+#include "readoutlibs/utils/BlockWriter.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using dunedaq::readoutlibs::logging::TLVL_WORK_STEPS;
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * Writes blocks with pwrite from a dedicated thread, in submission order. The caller keeps filling free buffers
+ * while the thread drains the full ones, and only waits when all buffers are full.
+ */
+class ThreadedBlockWriter : public BlockWriter
+{
+public:
+  ThreadedBlockWriter(int fd, size_t num_buffers, size_t buffer_size, size_t alignment, BlockWriterStats& stats)
+    : m_fd(fd)
+    , m_num_buffers(std::max<size_t>(num_buffers, 2))
+    , m_buffer_size(buffer_size)
+    , m_stats(stats)
+  {
+    m_memory = static_cast<char*>(std::aligned_alloc(alignment, m_num_buffers * m_buffer_size));
+    if (m_memory == nullptr) {
+      throw std::bad_alloc();
+    }
+    for (size_t i = 0; i < m_num_buffers; ++i) {
+      m_free.push_back(i);
+    }
+    m_thread = std::thread(&ThreadedBlockWriter::run_writer, this);
+    pthread_setname_np(m_thread.native_handle(), "blockwriter");
+  }
+
+  ~ThreadedBlockWriter()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    std::free(m_memory);
+  }
+
+  ThreadedBlockWriter(const ThreadedBlockWriter&) = delete;            ///< ThreadedBlockWriter is not copy-constructible
+  ThreadedBlockWriter& operator=(const ThreadedBlockWriter&) = delete; ///< ThreadedBlockWriter is not copy-assginable
+  ThreadedBlockWriter(ThreadedBlockWriter&&) = delete;                 ///< ThreadedBlockWriter is not move-constructible
+  ThreadedBlockWriter& operator=(ThreadedBlockWriter&&) = delete;      ///< ThreadedBlockWriter is not move-assignable
+
+  char* acquire() override
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_free.empty()) {
+      auto wait_start = std::chrono::steady_clock::now();
+      m_cv.wait(lock, [&] { return !m_free.empty(); });
+      ++m_stats.num_buffer_waits;
+      m_stats.buffer_wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::steady_clock::now() - wait_start)
+                                    .count();
+    }
+    auto index = m_free.back();
+    m_free.pop_back();
+    return m_memory + index * m_buffer_size;
+  }
+
+  void submit(char* buffer, size_t size, uint64_t offset) override // NOLINT(build/unsigned)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.push_back({ static_cast<size_t>(buffer - m_memory) / m_buffer_size,
+                            size,
+                            offset,
+                            std::chrono::steady_clock::now() });
+      ++m_in_flight;
+    }
+    m_cv.notify_all();
+  }
+
+  bool wait_all() override
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_in_flight == 0; });
+    return !m_failed;
+  }
+
+  bool failed() const override { return m_failed; }
+
+private:
+  struct PendingWrite
+  {
+    size_t index;
+    size_t size;
+    uint64_t offset; // NOLINT(build/unsigned)
+    std::chrono::steady_clock::time_point submit_time;
+  };
+
+  void run_writer()
+  {
+    while (true) {
+      PendingWrite write;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_quit || !m_pending.empty(); });
+        if (m_pending.empty()) {
+          return; // quit, and nothing left to write
+        }
+        write = m_pending.front();
+        m_pending.pop_front();
+      }
+      if (!write_fully(m_memory + write.index * m_buffer_size, write.size, write.offset)) {
+        m_failed = true;
+      }
+      m_stats.write_latency.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - write.submit_time)
+          .count());
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(write.index);
+        --m_in_flight;
+      }
+      m_cv.notify_all();
+    }
+  }
+
+  bool write_fully(const char* data, size_t size, uint64_t offset) // NOLINT(build/unsigned)
+  {
+    while (size > 0) {
+      auto written = ::pwrite(m_fd, data, size, offset);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        TLOG_DEBUG(TLVL_WORK_STEPS) << "Block write failed: "
+                                    << (written < 0 ? std::string(strerror(errno)) : "nothing written");
+        return false;
+      }
+      data += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+  }
+
+  int m_fd;
+  size_t m_num_buffers;
+  size_t m_buffer_size;
+  char* m_memory = nullptr;
+  BlockWriterStats& m_stats;
+
+  std::vector<size_t> m_free;
+  std::deque<PendingWrite> m_pending;
+  size_t m_in_flight = 0;
+  bool m_quit = false;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_thread;
+  std::atomic<bool> m_failed{ false };
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_THREADEDBLOCKWRITER_HPP_
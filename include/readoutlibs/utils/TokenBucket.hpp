@@ -0,0 +1,78 @@
+/**
+ * @file TokenBucket.hpp Token bucket limiting the rate of variable
+ * sized work, e.g. bytes written
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_TOKENBUCKET_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_TOKENBUCKET_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/** TokenBucket usage:
+ *
+ *  TokenBucket bucket;
+ *  bucket.configure(100e6, 16e6); // 100 MB/s, bursts of up to 16 MB
+ *  while (writing) {
+ *    bucket.acquire(size);        // sleeps if the rate is exceeded
+ *    // write size bytes
+ *  }
+ */
+/** NOTES:
+    Tokens are added at the configured rate, up to the burst size. acquire() takes its tokens even if there are not
+    enough, and then sleeps until the bucket is out of debt, so pieces larger than the burst size are allowed and
+    the long term rate is kept. A rate of 0 disables the limit. acquire() must be called from a single thread.
+ */
+class TokenBucket
+{
+public:
+  using clock_t = std::chrono::steady_clock;
+
+  TokenBucket() {}
+
+  void configure(double rate, double burst)
+  {
+    m_rate = rate;
+    m_burst = std::max(burst, 1.);
+    m_tokens = m_burst;
+    m_last_refill = clock_t::now();
+  }
+
+  bool is_limited() const { return m_rate > 0; }
+
+  // Take amount tokens, and wait until they are available. Returns the time waited.
+  std::chrono::nanoseconds acquire(double amount)
+  {
+    if (!is_limited()) {
+      return std::chrono::nanoseconds(0);
+    }
+    auto now = clock_t::now();
+    m_tokens = std::min(m_burst, m_tokens + std::chrono::duration<double>(now - m_last_refill).count() * m_rate);
+    m_last_refill = now;
+    m_tokens -= amount;
+    if (m_tokens >= 0) {
+      return std::chrono::nanoseconds(0);
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(-m_tokens / m_rate));
+    std::this_thread::sleep_for(wait);
+    return wait;
+  }
+
+private:
+  double m_rate = 0;
+  double m_burst = 1;
+  double m_tokens = 1;
+  clock_t::time_point m_last_refill;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_TOKENBUCKET_HPP_
@@ -0,0 +1,97 @@
+/**
+ * @file ZstdDictionary.hpp Trained zstd dictionaries, shared by the
+ * writers and readers of a recording
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#ifndef READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_ZSTDDICTIONARY_HPP_
+#define READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_ZSTDDICTIONARY_HPP_
+
+#include "readoutlibs/ReadoutIssues.hpp"
+
+#include <zdict.h>
+#include <zstd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq {
+namespace readoutlibs {
+
+/**
+ * A zstd dictionary, usually trained on a sample recording of one detector type and shipped as a file. Data
+ * compressed with a dictionary can only be decompressed with the same one; zstd checks this with the dictionary ID
+ * stored in each frame.
+ */
+class ZstdDictionary
+{
+public:
+  explicit ZstdDictionary(std::vector<char> content)
+    : m_content(std::move(content))
+  {}
+
+  /**
+   * @throw CannotOpenFile If the file can not be read.
+   */
+  static ZstdDictionary read(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+      throw BufferedReaderWriterCannotOpenFile(ERS_HERE, filename);
+    }
+    return ZstdDictionary(std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+  }
+
+  /**
+   * Train a dictionary of up to capacity bytes on samples of sample_size bytes each, e.g. the elements of a
+   * recording.
+   * @throw ConfigurationError If zstd can not train a dictionary from the samples.
+   */
+  static ZstdDictionary train(const char* samples, size_t sample_size, size_t num_samples, size_t capacity)
+  {
+    std::vector<char> content(capacity);
+    std::vector<size_t> sizes(num_samples, sample_size);
+    auto size = ZDICT_trainFromBuffer(
+      content.data(), content.size(), samples, sizes.data(), static_cast<unsigned>(num_samples)); // NOLINT
+    if (ZDICT_isError(size)) {
+      throw BufferedReaderWriterConfigurationError(
+        ERS_HERE, std::string("Could not train a zstd dictionary: ") + ZDICT_getErrorName(size));
+    }
+    content.resize(size);
+    return ZstdDictionary(std::move(content));
+  }
+
+  /**
+   * @throw CannotOpenFile If the file can not be written.
+   */
+  void write(const std::string& filename) const
+  {
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(m_content.data(), m_content.size());
+    if (!out) {
+      throw BufferedReaderWriterCannotOpenFile(ERS_HERE, filename);
+    }
+  }
+
+  const std::vector<char>& get_content() const { return m_content; }
+
+  // The ID zstd stores in frames compressed with the dictionary, 0 for a raw content dictionary
+  unsigned get_id() const { return ZSTD_getDictID_fromDict(m_content.data(), m_content.size()); }
+
+  void load_into(ZSTD_CCtx* cctx) const { ZSTD_CCtx_loadDictionary(cctx, m_content.data(), m_content.size()); }
+
+  void load_into(ZSTD_DCtx* dctx) const { ZSTD_DCtx_loadDictionary(dctx, m_content.data(), m_content.size()); }
+
+private:
+  std::vector<char> m_content;
+};
+
+} // namespace readoutlibs
+} // namespace dunedaq
+
+#endif // READOUTLIBS_INCLUDE_READOUTLIBS_UTILS_ZSTDDICTIONARY_HPP_
@@ -0,0 +1,207 @@
+/**
+ * @file bench_compression_app.cxx Benchmark of the compression algorithms
+ * supported by the file writer and reader, on a sample recording
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "readoutlibs/utils/ParallelZstdCompressor.hpp"
+#include "readoutlibs/utils/ParallelZstdDecompressor.hpp"
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+#ifdef WITH_LZ4_SUPPORT
+#include "readoutlibs/utils/Lz4Filter.hpp"
+#endif
+
+#include "logging/Logging.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Config.hpp"
+#include "CLI/Formatter.hpp"
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/lzma.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+namespace {
+
+struct Codec
+{
+  std::string algorithm;
+  int level;
+  std::shared_ptr<const ZstdDictionary> dictionary;
+};
+
+// Compress input in chunks of chunk_size, the way BufferedFileWriter does with the same options
+std::vector<char>
+compress(const Codec& codec, const std::vector<char>& input, size_t chunk_size)
+{
+  std::vector<char> output;
+  if (codec.dictionary) {
+    ParallelZstdCompressor compressor(1, codec.level, [&](const char* data, size_t size) {
+      output.insert(output.end(), data, data + size);
+      return true;
+    }, codec.dictionary);
+    for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+      auto end = input.begin() + std::min(offset + chunk_size, input.size());
+      compressor.compress(std::vector<char>(input.begin() + offset, end));
+    }
+    compressor.flush();
+    return output;
+  }
+
+  boost::iostreams::filtering_ostream stream;
+  if (codec.algorithm == "zstd") {
+    stream.push(boost::iostreams::zstd_compressor(boost::iostreams::zstd_params(codec.level)));
+#ifdef WITH_LZ4_SUPPORT
+  } else if (codec.algorithm == "lz4") {
+    stream.push(Lz4Compressor(codec.level));
+#endif
+  } else if (codec.algorithm == "lzma") {
+    stream.push(boost::iostreams::lzma_compressor(boost::iostreams::lzma::best_speed));
+  } else if (codec.algorithm == "zlib") {
+    stream.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib::best_speed));
+  }
+  stream.push(boost::iostreams::back_inserter(output));
+  for (size_t offset = 0; offset < input.size(); offset += chunk_size) {
+    stream.write(input.data() + offset, std::min(chunk_size, input.size() - offset));
+  }
+  stream.reset();
+  return output;
+}
+
+// Decompress into output, which must have the size of the original data. Returns the decompressed size.
+size_t
+decompress(const Codec& codec, const std::vector<char>& input, std::vector<char>& output, size_t chunk_size)
+{
+  boost::iostreams::filtering_istream stream;
+  if (codec.dictionary) {
+    size_t offset = 0;
+    ParallelZstdDecompressor decompressor(1, chunk_size, [&](char* data, size_t size) {
+      size = std::min(size, input.size() - offset);
+      std::memcpy(data, input.data() + offset, size);
+      offset += size;
+      return size;
+    }, codec.dictionary);
+    return decompressor.read(output.data(), output.size());
+  }
+
+  if (codec.algorithm == "zstd") {
+    stream.push(boost::iostreams::zstd_decompressor());
+#ifdef WITH_LZ4_SUPPORT
+  } else if (codec.algorithm == "lz4") {
+    stream.push(Lz4Decompressor());
+#endif
+  } else if (codec.algorithm == "lzma") {
+    stream.push(boost::iostreams::lzma_decompressor());
+  } else if (codec.algorithm == "zlib") {
+    stream.push(boost::iostreams::zlib_decompressor());
+  }
+  stream.push(boost::iostreams::array_source(input.data(), input.size()));
+  size_t total = 0;
+  while (total < output.size()) {
+    stream.read(output.data() + total, std::min(chunk_size, output.size() - total));
+    if (stream.gcount() <= 0) {
+      break;
+    }
+    total += stream.gcount();
+  }
+  return total;
+}
+
+void
+run_codec(const Codec& codec, const std::vector<char>& input, size_t chunk_size)
+{
+  std::string name = codec.algorithm + (codec.algorithm == "zstd" || codec.algorithm == "lz4"
+                                          ? " level " + std::to_string(codec.level)
+                                          : "") +
+                     (codec.dictionary ? " with dictionary" : "");
+  double megabytes = static_cast<double>(input.size()) / (1 << 20);
+
+  auto start = std::chrono::steady_clock::now();
+  auto compressed = compress(codec, input, chunk_size);
+  double compress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<char> output(input.size());
+  start = std::chrono::steady_clock::now();
+  auto decompressed = decompress(codec, compressed, output, chunk_size);
+  double decompress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (decompressed != input.size() || output != input) {
+    TLOG() << name << ": decompressed data does not match the input";
+    return;
+  }
+  TLOG() << name << ": ratio=" << static_cast<double>(input.size()) / std::max<size_t>(compressed.size(), 1)
+         << " compress=" << megabytes / compress_seconds << " MB/s"
+         << " decompress=" << megabytes / decompress_seconds << " MB/s";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  std::string input_file;
+  std::string dictionary_file;
+  std::vector<int> zstd_levels{ 1, 3, 9 };
+  std::vector<int> lz4_levels{ 0, 9 };
+  size_t chunk_size = 8388608;
+  size_t max_size = 1UL << 30;
+
+  CLI::App app{ "readoutlibs_bench_compression" };
+  app.add_option("-i,--input", input_file, "Sample recording to compress.")->required();
+  app.add_option("-d,--dictionary", dictionary_file, "zstd dictionary to also benchmark zstd with.");
+  app.add_option("--zstd_levels", zstd_levels, "zstd compression levels to benchmark.");
+  app.add_option("--lz4_levels", lz4_levels, "lz4 compression levels to benchmark.");
+  app.add_option("-c,--chunk_size", chunk_size, "Size of the writes, like the stream_buffer_size of the writer.");
+  app.add_option("-m,--max_size", max_size, "Maximum number of bytes of the input to use.");
+  CLI11_PARSE(app, argc, argv);
+
+  std::ifstream in(input_file, std::ios::binary);
+  if (!in) {
+    TLOG() << "Could not open " << input_file;
+    return 1;
+  }
+  std::vector<char> input(max_size);
+  in.read(input.data(), input.size());
+  input.resize(in.gcount());
+  TLOG() << "Benchmarking on " << input.size() << " bytes of " << input_file;
+
+  std::shared_ptr<const ZstdDictionary> dictionary;
+  if (!dictionary_file.empty()) {
+    dictionary = std::make_shared<ZstdDictionary>(ZstdDictionary::read(dictionary_file));
+  }
+
+  std::vector<Codec> codecs;
+  for (auto level : zstd_levels) {
+    codecs.push_back({ "zstd", level, nullptr });
+    if (dictionary) {
+      codecs.push_back({ "zstd", level, dictionary });
+    }
+  }
+#ifdef WITH_LZ4_SUPPORT
+  for (auto level : lz4_levels) {
+    codecs.push_back({ "lz4", level, nullptr });
+  }
+#endif
+  codecs.push_back({ "zlib", 0, nullptr });
+  codecs.push_back({ "lzma", 0, nullptr });
+
+  for (auto& codec : codecs) {
+    run_codec(codec, input, chunk_size);
+  }
+  return 0;
+}
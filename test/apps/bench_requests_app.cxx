@@ -0,0 +1,325 @@
+/**
+ * @file bench_requests_app.cxx Benchmark of the request path over the
+ * latency buffer implementations, with synthetic data and in-process requests
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "readoutlibs/ReadoutTypes.hpp"
+#include "readoutlibs/models/BinarySearchQueueModel.hpp"
+#include "readoutlibs/models/DefaultRequestHandlerModel.hpp"
+#include "readoutlibs/models/DefaultSkipListRequestHandler.hpp"
+#include "readoutlibs/models/FixedRateQueueModel.hpp"
+#include "readoutlibs/models/IterableQueueModel.hpp"
+#include "readoutlibs/models/SkipListLatencyBufferModel.hpp"
+#include "readoutlibs/utils/LatencyHistogram.hpp"
+
+#include "logging/Logging.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Config.hpp"
+#include "CLI/Formatter.hpp"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+namespace {
+
+// A frame of the synthetic multi-frame element
+template<size_t Size>
+struct BenchFrame
+{
+  uint64_t timestamp; // NOLINT(build/unsigned)
+  char data[Size - sizeof(uint64_t)];
+
+  uint64_t get_timestamp() const { return timestamp; } // NOLINT(build/unsigned)
+  void set_timestamp(uint64_t ts) { timestamp = ts; }  // NOLINT(build/unsigned)
+};
+
+// A synthetic element made of several frames, like the superchunks of the detector readout types
+template<size_t NumFrames, size_t FrameSize>
+struct BenchElement
+{
+  using FrameType = BenchFrame<FrameSize>;
+
+  FrameType frames[NumFrames];
+
+  bool operator<(const BenchElement& other) const { return get_first_timestamp() < other.get_first_timestamp(); }
+
+  uint64_t get_first_timestamp() const { return frames[0].timestamp; } // NOLINT(build/unsigned)
+  void set_first_timestamp(uint64_t ts) { frames[0].timestamp = ts; }  // NOLINT(build/unsigned)
+
+  size_t get_payload_size() const { return sizeof(frames); }
+  size_t get_num_frames() const { return NumFrames; }
+  size_t get_frame_size() const { return FrameSize; }
+
+  FrameType* begin() { return &frames[0]; }
+  FrameType* end() { return &frames[NumFrames]; }
+
+  static const constexpr size_t fixed_payload_size = NumFrames * FrameSize;
+  static const constexpr uint64_t expected_tick_difference = 32; // NOLINT(build/unsigned)
+  static const constexpr dunedaq::daqdataformats::SourceID::Subsystem subsystem =
+    dunedaq::daqdataformats::SourceID::Subsystem::kDetectorReadout;
+  static const constexpr dunedaq::daqdataformats::FragmentType fragment_type =
+    dunedaq::daqdataformats::FragmentType::kUnknown;
+};
+
+using SuperChunk = BenchElement<12, 464>;
+
+// Latency buffer without a search index: requests are served by a linear scan
+template<class T>
+class LinearSearchQueueModel : public IterableQueueModel<T>
+{
+public:
+  typename IterableQueueModel<T>::Iterator lower_bound(T& element, bool /*with_errors=false*/)
+  {
+    auto it = IterableQueueModel<T>::begin();
+    while (it != IterableQueueModel<T>::end() && *it < element) {
+      ++it;
+    }
+    return it;
+  }
+};
+
+// Gives the benchmark access to the request lookup and the internal latency histograms
+template<class Handler>
+class BenchRequestHandler : public Handler
+{
+public:
+  using Handler::Handler;
+  using RequestResult = typename Handler::RequestResult;
+
+  void set_running(bool running) { this->m_run_marker.store(running); }
+
+  // Look up the request's data the way the request handling threads do, holding off cleanups meanwhile
+  RequestResult serve(const dunedaq::dfmessages::DataRequest& dr)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->m_cv_mutex);
+      this->m_cv.wait(lock, [&] { return !this->m_cleanup_requested; });
+      this->m_requests_running++;
+    }
+    this->m_cv.notify_all();
+    auto result = this->data_request(dr, false);
+    {
+      std::lock_guard<std::mutex> lock(this->m_cv_mutex);
+      this->m_requests_running--;
+    }
+    this->m_cv.notify_all();
+    return result;
+  }
+
+  static bool is_found(const RequestResult& result) { return result.result_code == Handler::ResultCode::kFound; }
+  static bool is_not_yet(const RequestResult& result) { return result.result_code == Handler::ResultCode::kNotYet; }
+
+  LatencyHistogram& lookup_latency() { return this->m_lookup_latency; }
+  LatencyHistogram& copy_latency() { return this->m_copy_latency; }
+};
+
+struct BenchConfig
+{
+  size_t capacity = 100000;
+  double ingest_rate = 100000;          // elements per second
+  double request_rate = 100;            // requests per second
+  uint64_t window_ticks = 20000;        // NOLINT(build/unsigned)
+  uint64_t request_delay_ticks = 20000; // NOLINT(build/unsigned) between the window end and the newest element
+  size_t num_threads = 4;
+  int seconds = 5;
+};
+
+void
+print_latencies(const std::string& name, LatencyHistogram& histogram)
+{
+  auto snapshot = histogram.snapshot_and_reset();
+  TLOG() << "  " << name << " [us]: count=" << snapshot.count() << " p50=" << snapshot.percentile(0.5)
+         << " p90=" << snapshot.percentile(0.9) << " p99=" << snapshot.percentile(0.99)
+         << " p99.9=" << snapshot.percentile(0.999) << " max=" << snapshot.max();
+}
+
+// Fill the latency buffer at the ingest rate, fire requests at the request rate and report on the request path
+template<class RDT, class LBT, class Handler>
+void
+run_bench(const std::string& name, const BenchConfig& cfg)
+{
+  readoutconfig::LatencyBufferConf lb_conf;
+  lb_conf.latency_buffer_size = cfg.capacity;
+  nlohmann::json lb_args;
+  lb_args["latencybufferconf"] = lb_conf;
+  auto latency_buffer = std::make_unique<LBT>();
+  latency_buffer->conf(lb_args);
+  auto error_registry = std::make_unique<FrameErrorRegistry>();
+
+  readoutconfig::RequestHandlerConf rh_conf;
+  rh_conf.latency_buffer_size = cfg.capacity;
+  rh_conf.enable_raw_recording = false;
+  rh_conf.warn_on_timeout = false;
+  rh_conf.warn_about_empty_buffer = false;
+  nlohmann::json rh_args;
+  rh_args["requesthandlerconf"] = rh_conf;
+  BenchRequestHandler<Handler> handler(latency_buffer, error_registry);
+  handler.conf(rh_args);
+  handler.set_running(true);
+
+  std::atomic<bool> running{ true };
+  std::atomic<uint64_t> newest_ts{ 0 }; // NOLINT(build/unsigned)
+  std::atomic<size_t> num_written{ 0 };
+  std::atomic<size_t> num_lost{ 0 };
+
+  // Producer: writes elements with consecutive timestamps, paced to the ingest rate
+  auto producer = std::thread([&]() {
+    RDT element = RDT();
+    const uint64_t ticks_per_element = element.get_num_frames() * RDT::expected_tick_difference; // NOLINT
+    uint64_t ts = ticks_per_element;                                                             // NOLINT
+    size_t produced = 0;
+    auto t_begin = std::chrono::steady_clock::now();
+    while (running) {
+      double elapsed =
+        std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t_begin).count();
+      auto target = static_cast<size_t>(elapsed * cfg.ingest_rate);
+      if (produced >= target) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      for (; produced < target; ++produced, ts += ticks_per_element) {
+        auto frame_ts = ts;
+        for (auto it = element.begin(); it != element.end(); ++it, frame_ts += RDT::expected_tick_difference) {
+          it->set_timestamp(frame_ts);
+        }
+        if (latency_buffer->write(std::move(element))) {
+          ++num_written;
+          newest_ts = ts;
+        } else {
+          ++num_lost;
+        }
+      }
+    }
+  });
+
+  // Cleanup, as done by the request handler's cleanup thread
+  auto cleaner = std::thread([&]() {
+    while (running) {
+      handler.cleanup_check();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  LatencyHistogram end_to_end_latency;
+  std::atomic<size_t> num_found{ 0 };
+  std::atomic<size_t> num_not_yet{ 0 };
+  std::atomic<size_t> num_not_found{ 0 };
+  std::atomic<uint64_t> bytes_served{ 0 };    // NOLINT(build/unsigned)
+  std::atomic<uint64_t> serve_time_ns{ 0 };   // NOLINT(build/unsigned)
+  uint64_t trigger_number = 0;                // NOLINT(build/unsigned)
+
+  // Requester: fires windows behind the newest data at the request rate, served by a thread pool
+  boost::asio::thread_pool pool(cfg.num_threads);
+  auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / cfg.request_rate));
+  auto t_end = std::chrono::steady_clock::now() + std::chrono::seconds(cfg.seconds);
+  for (auto t_next = std::chrono::steady_clock::now(); t_next < t_end; t_next += period) {
+    std::this_thread::sleep_until(t_next);
+    uint64_t newest = newest_ts.load(); // NOLINT(build/unsigned)
+    if (newest < cfg.window_ticks + cfg.request_delay_ticks) {
+      continue;
+    }
+    dunedaq::dfmessages::DataRequest dr;
+    dr.trigger_number = ++trigger_number;
+    dr.request_information.window_end = newest - cfg.request_delay_ticks;
+    dr.request_information.window_begin = dr.request_information.window_end - cfg.window_ticks;
+    dr.trigger_timestamp = dr.request_information.window_begin;
+    auto t_fired = std::chrono::steady_clock::now();
+    boost::asio::post(pool, [&, dr, t_fired]() {
+      auto t_start = std::chrono::steady_clock::now();
+      auto result = handler.serve(dr);
+      auto t_done = std::chrono::steady_clock::now();
+      if (handler.is_found(result)) {
+        ++num_found;
+        bytes_served += result.fragment->get_data_size();
+      } else if (handler.is_not_yet(result)) {
+        ++num_not_yet;
+      } else {
+        ++num_not_found;
+      }
+      serve_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t_done - t_start).count();
+      end_to_end_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(t_done - t_fired).count());
+    });
+  }
+  pool.join();
+  running = false;
+  producer.join();
+  cleaner.join();
+  handler.set_running(false);
+
+  double serve_seconds = serve_time_ns.load() / 1e9;
+  TLOG() << name << ": written=" << num_written << " lost=" << num_lost << " ("
+         << (num_written + num_lost > 0 ? 100.0 * num_lost / (num_written + num_lost) : 0.0) << "%)"
+         << " requests found=" << num_found << " not_yet=" << num_not_yet << " not_found=" << num_not_found;
+  TLOG() << "  copy bandwidth: " << (serve_seconds > 0 ? bytes_served / serve_seconds / (1 << 20) : 0.0)
+         << " MiB/s (" << bytes_served / (1 << 20) << " MiB served)";
+  print_latencies("lookup", handler.lookup_latency());
+  print_latencies("copy", handler.copy_latency());
+  print_latencies("end-to-end", end_to_end_latency);
+}
+
+template<class RDT>
+void
+run_suite(const std::string& buffer, const BenchConfig& cfg)
+{
+  if (buffer == "all" || buffer == "iterable") {
+    run_bench<RDT, LinearSearchQueueModel<RDT>, DefaultRequestHandlerModel<RDT, LinearSearchQueueModel<RDT>>>(
+      "IterableQueueModel", cfg);
+  }
+  if (buffer == "all" || buffer == "binarysearch") {
+    run_bench<RDT, BinarySearchQueueModel<RDT>, DefaultRequestHandlerModel<RDT, BinarySearchQueueModel<RDT>>>(
+      "BinarySearchQueueModel", cfg);
+  }
+  if (buffer == "all" || buffer == "fixedrate") {
+    run_bench<RDT, FixedRateQueueModel<RDT>, DefaultRequestHandlerModel<RDT, FixedRateQueueModel<RDT>>>(
+      "FixedRateQueueModel", cfg);
+  }
+  if (buffer == "all" || buffer == "skiplist") {
+    // The skip list is trimmed by time span, not by the configured capacity
+    run_bench<RDT, SkipListLatencyBufferModel<RDT>, DefaultSkipListRequestHandler<RDT>>("SkipListLatencyBufferModel",
+                                                                                         cfg);
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  BenchConfig cfg;
+  std::string frame = "dummy";
+  std::string buffer = "all";
+
+  CLI::App app{ "readoutlibs_bench_requests" };
+  app.add_option("--frame", frame, "Element type: dummy (DUMMY_FRAME_STRUCT) or superchunk (12 frames of 464 bytes).");
+  app.add_option("--buffer", buffer, "Latency buffer: all, iterable, binarysearch, fixedrate or skiplist.");
+  app.add_option("-c,--capacity", cfg.capacity, "Capacity of the latency buffers.");
+  app.add_option("--ingest_rate", cfg.ingest_rate, "Elements written per second.");
+  app.add_option("--request_rate", cfg.request_rate, "Requests per second.");
+  app.add_option("--window", cfg.window_ticks, "Request window size in ticks.");
+  app.add_option("--delay", cfg.request_delay_ticks, "Distance of the window end from the newest data in ticks.");
+  app.add_option("-n,--threads", cfg.num_threads, "Number of request handling threads.");
+  app.add_option("-s,--seconds", cfg.seconds, "Duration of each benchmark.");
+  CLI11_PARSE(app, argc, argv);
+
+  if (frame == "dummy") {
+    run_suite<types::DUMMY_FRAME_STRUCT>(buffer, cfg);
+  } else if (frame == "superchunk") {
+    run_suite<SuperChunk>(buffer, cfg);
+  } else {
+    TLOG() << "Unknown frame type: " << frame;
+    return 1;
+  }
+  return 0;
+}
@@ -15,22 +15,35 @@
 #include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
 using namespace dunedaq::readoutlibs;
 
 int
 main(int argc, char* argv[])
 {
-  if (argc != 2) {
-    TLOG() << "usage: readoutlibs_test_bufferedfilereader filename" << std::endl;
+  if (argc != 2 && argc != 3) {
+    TLOG() << "usage: readoutlibs_test_bufferedfilereader filename [read|read_n|mmap|prefetch]" << std::endl;
     exit(1);
   }
   std::string filename(argv[1]);
-  BufferedFileReader<types::DUMMY_FRAME_STRUCT> reader(filename, 8388608);
+  std::string mode = argc == 3 ? argv[2] : "read";
+  BufferedFileReader<types::DUMMY_FRAME_STRUCT> reader;
+  if (mode == "mmap") {
+    reader.open_mapped(filename);
+  } else if (mode == "prefetch") {
+    BufferedFileReaderOptions options;
+    options.io_backend = "prefetch";
+    reader.open(filename, options);
+  } else {
+    reader.open(filename, 8388608);
+  }
   types::DUMMY_FRAME_STRUCT chunk;
   for (uint i = 0; i < sizeof(chunk); ++i) {
     (reinterpret_cast<char*>(&chunk))[i] = static_cast<char>(i); // NOLINT
   }
+  std::vector<types::DUMMY_FRAME_STRUCT> chunks(1024);
+  int64_t checksum = 0;
 
   std::atomic<int64_t> bytes_read_total = 0;
   std::atomic<int64_t> bytes_read_since_last_statistics = 0;
@@ -51,11 +64,28 @@ main(int argc, char* argv[])
   });
 
   while (true) {
-    if (!reader.read(chunk)) {
-      TLOG() << "Finished reading from file" << std::endl;
+    size_t count = 0;
+    if (mode == "read_n" || mode == "prefetch") {
+      count = reader.read_n(chunks.data(), chunks.size());
+    } else if (mode == "mmap") {
+      const types::DUMMY_FRAME_STRUCT* elements = nullptr;
+      count = reader.read_mapped(elements, chunks.size());
+      auto data = reinterpret_cast<const char*>(elements); // NOLINT
+      for (size_t offset = 0; offset < count * sizeof(chunk); offset += 4096) {
+        checksum += data[offset]; // touch every page, to fault it in
+      }
+    } else {
+      count = reader.read(chunk) ? 1 : 0;
+    }
+    if (count == 0) {
+      if (reader.failed()) {
+        TLOG() << "Reading from file failed after " << bytes_read_total << " bytes" << std::endl;
+        exit(1);
+      }
+      TLOG() << "Finished reading from file, checksum " << checksum << std::endl;
       exit(0);
     }
-    bytes_read_total += sizeof(chunk);
-    bytes_read_since_last_statistics += sizeof(chunk);
+    bytes_read_total += count * sizeof(chunk);
+    bytes_read_since_last_statistics += count * sizeof(chunk);
   }
 }
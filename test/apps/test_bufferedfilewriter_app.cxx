@@ -16,24 +16,56 @@
 #include <chrono>
 #include <memory>
 #include <string>
+#include <vector>
 
 using namespace dunedaq::readoutlibs;
 
 int
 main(int argc, char* argv[])
 {
-  if (argc < 2 || argc > 4 || argc==3 || (argc == 4 && strcmp(argv[2], "-L") != 0)) {
-    TLOG() << "usage: readoutlibs_test_bufferedfilewriter filename <-L rate_limiter_frequency>" << std::endl;
-    TLOG() << "-L frequency parameter is optional. Limiter will be disable" << std::endl;    
+  // Options come in pairs after the file name
+  bool usage_ok = argc >= 2 && argc % 2 == 0;
+  double limiter_freq = 0;
+  BufferedFileWriterOptions options;
+  size_t write_size = 0;
+  for (int i = 2; usage_ok && i < argc; i += 2) {
+    if (strcmp(argv[i], "-L") == 0) {
+      limiter_freq = std::stod(argv[i + 1]);
+    } else if (strcmp(argv[i], "-B") == 0) {
+      options.io_backend = argv[i + 1];
+    } else if (strcmp(argv[i], "-S") == 0) {
+      write_size = std::stoul(argv[i + 1]);
+    } else {
+      usage_ok = false;
+    }
+  }
+  if (!usage_ok) {
+    TLOG() << "usage: readoutlibs_test_bufferedfilewriter filename <-L rate_limiter_frequency> <-B io_backend> "
+              "<-S write_size>"
+           << std::endl;
+    TLOG() << "-L frequency parameter is optional. Limiter will be disable" << std::endl;
+    TLOG() << "-B io backend: stream (default), threaded, io_uring or direct" << std::endl;
+    TLOG() << "-S writes that many bytes at a time from a 4096 aligned buffer, instead of single frames" << std::endl;
     exit(1);
   }
   remove(argv[1]); // NOLINT
   std::string filename(argv[1]);
   types::DUMMY_FRAME_STRUCT chunk;
-  BufferedFileWriter writer(filename, 8388608);
+  BufferedFileWriter writer;
+  writer.open(filename, options);
   for (uint i = 0; i < sizeof(chunk); ++i) {
     (reinterpret_cast<char*>(&chunk))[i] = static_cast<char>(i); // NOLINT
   }
+  const char* data = reinterpret_cast<char*>(&chunk); // NOLINT
+  size_t data_size = sizeof(chunk);
+  std::vector<char, boost::alignment::aligned_allocator<char, 4096>> aligned_data(write_size);
+  if (write_size > 0) {
+    for (size_t i = 0; i < write_size; ++i) {
+      aligned_data[i] = static_cast<char>(i);
+    }
+    data = aligned_data.data();
+    data_size = write_size;
+  }
 
   std::atomic<int64_t> bytes_written_total = 0;
   std::atomic<int64_t> bytes_written_since_last_statistics = 0;
@@ -54,23 +86,21 @@ main(int argc, char* argv[])
   });
 
   // Initializing limiter
-  double limiter_freq = 0;
-  if (argc == 4) limiter_freq = std::stod(argv[3]);
   auto limiter = RateLimiter(limiter_freq);
 
-  if (argc == 4) {
+  if (limiter_freq > 0) {
     TLOG() << "Starting with ratelimiter at " << limiter_freq << "kHz";
     limiter.init();
   }
   
 
   while (true) {
-    if (!writer.write(reinterpret_cast<char*>(&chunk), sizeof(chunk))) {
+    if (!writer.write(data, data_size)) {
       TLOG() << "Could not write to file" << std::endl;
       exit(1);
     }
-    bytes_written_total += sizeof(chunk);
-    bytes_written_since_last_statistics += sizeof(chunk);
-    if (argc == 4) limiter.limit();
+    bytes_written_total += data_size;
+    bytes_written_since_last_statistics += data_size;
+    if (limiter_freq > 0) limiter.limit();
   }
 }
@@ -0,0 +1,244 @@
+/**
+ * @file test_request_replay_app.cxx Replay a captured data request trace
+ * against a latency buffer preloaded from a raw recording
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "readoutlibs/ReadoutTypes.hpp"
+#include "readoutlibs/models/BinarySearchQueueModel.hpp"
+#include "readoutlibs/models/DefaultRequestHandlerModel.hpp"
+#include "readoutlibs/utils/BufferedFileReader.hpp"
+#include "readoutlibs/utils/LatencyHistogram.hpp"
+#include "readoutlibs/utils/RequestTrace.hpp"
+
+#include "logging/Logging.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Config.hpp"
+#include "CLI/Formatter.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+namespace {
+
+struct ReplayConfig
+{
+  std::string data_file;
+  std::string trace_file;
+  double speedup = 1.0;
+  size_t num_threads = 4;
+  size_t lb_capacity = 1000000;
+  float pop_limit_pct = 0.5;
+  float pop_size_pct = 0.8;
+  int request_timeout_ms = 1000;
+  bool restamp = false;
+};
+
+// Serves the replayed requests like a live handler, through its request handling threads, waiting queue and
+// cleanups. Fragments go through the asynchronous send stage to a sender that only counts them.
+template<class RDT, class LBT>
+class ReplayRequestHandler : public DefaultRequestHandlerModel<RDT, LBT>
+{
+public:
+  using DefaultRequestHandlerModel<RDT, LBT>::DefaultRequestHandlerModel;
+
+  void count_fragments()
+  {
+    this->m_fragment_send_stage.set_sender_factory([this](const std::string&) {
+      return [this](std::unique_ptr<dunedaq::daqdataformats::Fragment>&&, std::chrono::milliseconds) {
+        ++m_num_fragments;
+      };
+    });
+  }
+
+  size_t get_num_fragments() const { return m_num_fragments; }
+  int get_num_found() const { return this->m_num_requests_found; }
+  int get_num_timed_out() const { return this->m_num_requests_timed_out; }
+  int get_num_cleanups() const { return this->m_num_buffer_cleanups; }
+  LatencyHistogram& queue_wait_latency() { return this->m_queue_wait_latency; }
+  LatencyHistogram& response_latency() { return this->m_response_latency; }
+
+private:
+  std::atomic<size_t> m_num_fragments{ 0 };
+};
+
+void
+print_latencies(const std::string& name, LatencyHistogram& histogram)
+{
+  auto snapshot = histogram.snapshot_and_reset();
+  TLOG() << name << " [us]: count=" << snapshot.count() << " p50=" << snapshot.percentile(0.5)
+         << " p90=" << snapshot.percentile(0.9) << " p99=" << snapshot.percentile(0.99)
+         << " p99.9=" << snapshot.percentile(0.999) << " max=" << snapshot.max();
+}
+
+template<class RDT, class LBT>
+int
+replay(const ReplayConfig& rc)
+{
+  // A raw recording is a sequence of whole elements: anything else was recorded with another type
+  auto data_size = std::filesystem::file_size(rc.data_file);
+  if (data_size % sizeof(RDT) != 0) {
+    TLOG() << rc.data_file << " is " << data_size << " bytes, not a multiple of the " << sizeof(RDT)
+           << " byte elements of the chosen type";
+    return 1;
+  }
+
+  // Captured requests
+  std::vector<RequestTraceRecord> records;
+  {
+    BufferedFileReader<RequestTraceRecord> reader(rc.trace_file, 8388608);
+    RequestTraceRecord record;
+    while (reader.read(record)) {
+      records.push_back(record);
+    }
+    if (reader.failed()) {
+      TLOG() << "Reading " << rc.trace_file << " failed after " << records.size() << " requests";
+      return 1;
+    }
+  }
+  if (records.empty()) {
+    TLOG() << "No requests found in " << rc.trace_file;
+    return 1;
+  }
+
+  // Latency buffer contents
+  readoutconfig::LatencyBufferConf lb_conf;
+  lb_conf.latency_buffer_size = rc.lb_capacity;
+  nlohmann::json lb_args;
+  lb_args["latencybufferconf"] = lb_conf;
+  auto latency_buffer = std::make_unique<LBT>();
+  latency_buffer->conf(lb_args);
+  std::unique_ptr<FrameErrorRegistry> error_registry = std::make_unique<FrameErrorRegistry>();
+  {
+    BufferedFileReader<RDT> reader(rc.data_file, 8388608);
+    RDT element;
+    uint64_t previous_ts = 0; // NOLINT(build/unsigned)
+    while (reader.read(element)) {
+      if (element.get_first_timestamp() < previous_ts) {
+        TLOG() << "Timestamps of " << rc.data_file << " go backwards after " << previous_ts
+               << ": not a recording of the chosen type?";
+        return 1;
+      }
+      previous_ts = element.get_first_timestamp();
+      if (!latency_buffer->write(std::move(element))) {
+        TLOG() << "Latency buffer full after " << latency_buffer->occupancy() << " elements, ignoring the rest";
+        break;
+      }
+    }
+    if (reader.failed()) {
+      TLOG() << "Reading " << rc.data_file << " failed after " << latency_buffer->occupancy() << " elements";
+      return 1;
+    }
+  }
+  if (latency_buffer->occupancy() == 0) {
+    TLOG() << "No data found in " << rc.data_file;
+    return 1;
+  }
+  TLOG() << "Preloaded " << latency_buffer->occupancy() << " elements, timestamps "
+         << latency_buffer->front()->get_first_timestamp() << " to " << latency_buffer->back()->get_first_timestamp()
+         << ", replaying " << records.size() << " requests";
+
+  readoutconfig::RequestHandlerConf conf;
+  conf.latency_buffer_size = rc.lb_capacity;
+  conf.pop_limit_pct = rc.pop_limit_pct;
+  conf.pop_size_pct = rc.pop_size_pct;
+  conf.num_request_handling_threads = rc.num_threads;
+  conf.request_timeout_ms = rc.request_timeout_ms;
+  conf.async_fragment_send = true;
+  conf.enable_raw_recording = false;
+  conf.warn_on_timeout = false;
+  conf.warn_about_empty_buffer = false;
+  nlohmann::json args;
+  args["requesthandlerconf"] = conf;
+  ReplayRequestHandler<RDT, LBT> handler(latency_buffer, error_registry);
+  handler.conf(args);
+  handler.count_fragments();
+
+  int64_t ts_offset = 0;
+  if (rc.restamp) {
+    ts_offset = static_cast<int64_t>(latency_buffer->front()->get_first_timestamp()) -
+                static_cast<int64_t>(records.front().window_begin);
+  }
+
+  nlohmann::json start_args;
+  start_args["run"] = records.front().run_number;
+  handler.start(start_args);
+
+  // Issue the requests at their original pace, the handler serves them asynchronously
+  LatencyHistogram dispatch_lag;
+  auto t0 = std::chrono::steady_clock::now();
+  auto arrival0 = records.front().arrival_ns;
+  for (const auto& record : records) {
+    dunedaq::dfmessages::DataRequest dr;
+    dr.trigger_number = record.trigger_number;
+    dr.trigger_timestamp = record.trigger_timestamp + ts_offset;
+    dr.run_number = record.run_number;
+    dr.sequence_number = record.sequence_number;
+    dr.request_information.window_begin = record.window_begin + ts_offset;
+    dr.request_information.window_end = record.window_end + ts_offset;
+    dr.data_destination = std::string(record.data_destination,
+                                      strnlen(record.data_destination, sizeof(record.data_destination)));
+
+    if (rc.speedup > 0) {
+      auto t_due = t0 + std::chrono::nanoseconds(static_cast<int64_t>((record.arrival_ns - arrival0) / rc.speedup));
+      std::this_thread::sleep_until(t_due);
+      dispatch_lag.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t_due).count());
+    }
+    handler.issue_request(dr, record.send_partial != 0);
+  }
+
+  // Stopping waits for the waiting requests to be served or to time out, and drains the send queues
+  handler.stop(nlohmann::json());
+
+  double seconds =
+    std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - t0).count();
+  TLOG() << "Replayed " << records.size() << " requests in " << seconds << " s: " << handler.get_num_found()
+         << " with data found, " << handler.get_num_timed_out() << " timed out, " << handler.get_num_fragments()
+         << " fragments sent, " << handler.get_num_cleanups() << " buffer cleanups";
+  if (rc.speedup > 0) {
+    print_latencies("Dispatch lag", dispatch_lag);
+  }
+  print_latencies("Queue wait", handler.queue_wait_latency());
+  print_latencies("Response time", handler.response_latency());
+  return 0;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  ReplayConfig rc;
+  std::string type = "dummy";
+
+  CLI::App app{ "readoutlibs_test_request_replay" };
+  app.add_option("-d,--data", rc.data_file, "Raw recording to preload, of elements of the given type.")->required();
+  app.add_option("-t,--trace", rc.trace_file, "Request trace captured with request_trace_file.")->required();
+  app.add_option("--type", type, "Element type of the recording. Supported: dummy (DUMMY_FRAME_STRUCT).");
+  app.add_option("-s,--speedup", rc.speedup, "Replay pacing relative to the original arrival times. 0: no pacing.");
+  app.add_option("-n,--threads", rc.num_threads, "Number of request handling threads.");
+  app.add_option("-c,--capacity", rc.lb_capacity, "Capacity of the latency buffer.");
+  app.add_option("--pop_limit_pct", rc.pop_limit_pct, "Occupancy of the latency buffer above which it is cleaned up.");
+  app.add_option("--pop_size_pct", rc.pop_size_pct, "Fraction of the occupancy removed by a cleanup.");
+  app.add_option("--request_timeout_ms", rc.request_timeout_ms, "Time a request waits for its data.");
+  app.add_flag("--restamp", rc.restamp, "Shift all request windows so that the first one starts at the oldest element.");
+  CLI11_PARSE(app, argc, argv);
+
+  if (type == "dummy") {
+    return replay<types::DUMMY_FRAME_STRUCT, BinarySearchQueueModel<types::DUMMY_FRAME_STRUCT>>(rc);
+  }
+  TLOG() << "Unsupported element type " << type;
+  return 1;
+}
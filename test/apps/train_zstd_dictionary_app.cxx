@@ -0,0 +1,55 @@
+/**
+ * @file train_zstd_dictionary_app.cxx Trains a zstd dictionary on a sample
+ * recording, for the compression_dictionary option of the file writer
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+#include "readoutlibs/utils/ZstdDictionary.hpp"
+
+#include "logging/Logging.hpp"
+
+#include "CLI/App.hpp"
+#include "CLI/Config.hpp"
+#include "CLI/Formatter.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+int
+main(int argc, char** argv)
+{
+  std::string input_file;
+  std::string output_file;
+  size_t sample_size = 5568;
+  size_t max_samples = 100000;
+  size_t capacity = 112640;
+
+  CLI::App app{ "readoutlibs_train_zstd_dictionary" };
+  app.add_option("-i,--input", input_file, "Uncompressed sample recording of the detector type.")->required();
+  app.add_option("-o,--output", output_file, "Dictionary file to write.")->required();
+  app.add_option("-s,--sample_size", sample_size, "Size of the samples, usually the size of one element.");
+  app.add_option("-n,--max_samples", max_samples, "Maximum number of samples to train on.");
+  app.add_option("-c,--capacity", capacity, "Maximum size of the dictionary.");
+  CLI11_PARSE(app, argc, argv);
+
+  std::ifstream in(input_file, std::ios::binary);
+  if (!in) {
+    TLOG() << "Could not open " << input_file;
+    return 1;
+  }
+  std::vector<char> samples(sample_size * max_samples);
+  in.read(samples.data(), samples.size());
+  size_t num_samples = in.gcount() / sample_size;
+  TLOG() << "Training on " << num_samples << " samples of " << sample_size << " bytes";
+
+  auto dictionary = ZstdDictionary::train(samples.data(), sample_size, num_samples, capacity);
+  dictionary.write(output_file);
+  TLOG() << "Wrote a dictionary of " << dictionary.get_content().size() << " bytes with ID " << dictionary.get_id()
+         << " to " << output_file;
+  return 0;
+}
@@ -16,9 +16,13 @@
 #include "logging/Logging.hpp"
 #include "readoutlibs/utils/BufferedFileReader.hpp"
 #include "readoutlibs/utils/BufferedFileWriter.hpp"
+#include "readoutlibs/utils/RecordingFileWriter.hpp"
+#include "readoutlibs/utils/StripedFileWriter.hpp"
 
 #include <cstdio>
+#include <fstream>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
 using namespace dunedaq::readoutlibs;
@@ -51,12 +55,72 @@ test_read_write(BufferedFileWriter<>& writer, BufferedFileReader<int>& reader, u
 
   read_successful = reader.read(read_value);
   BOOST_REQUIRE(!read_successful);
+  BOOST_REQUIRE(!reader.failed());
 
   reader.close();
 
   remove("test.out");
 }
 
+struct TimestampedElement
+{
+  uint64_t timestamp; // NOLINT(build/unsigned)
+  uint64_t payload[7]; // NOLINT(build/unsigned)
+
+  uint64_t get_first_timestamp() const { return timestamp; } // NOLINT(build/unsigned)
+};
+
+void
+test_indexed_read_write(const std::string& compression_algorithm, size_t compression_threads)
+{
+  remove("test.out");
+  BufferedFileWriterOptions writer_options;
+  writer_options.buffer_size = 65536;
+  writer_options.compression_algorithm = compression_algorithm;
+  writer_options.compression_threads = compression_threads;
+  RecordingFileOptions recording_options;
+  recording_options.format = "indexed";
+  recording_options.source_id = 7;
+  recording_options.element_size = sizeof(TimestampedElement);
+  recording_options.index_interval = 4;
+  RecordingFileWriter writer;
+  writer.open("test.out", writer_options, recording_options);
+
+  // Elements are 10 ticks apart. The flush in the middle completes the index of the first half.
+  uint elements_to_write = 20000;
+  for (uint i = 0; i < elements_to_write; ++i) {
+    TimestampedElement element{ 10 * i, { i } };
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&element), sizeof(element), element.timestamp, element.timestamp));
+    if (i == elements_to_write / 2) {
+      writer.flush();
+    }
+  }
+  writer.close();
+
+  BufferedFileReader<TimestampedElement> reader("test.out", 65536);
+  TimestampedElement element;
+  for (uint i = 0; i < elements_to_write; ++i) {
+    BOOST_REQUIRE(reader.read(element));
+    BOOST_REQUIRE_EQUAL(element.timestamp, 10 * i);
+    BOOST_REQUIRE_EQUAL(element.payload[0], i);
+  }
+  BOOST_REQUIRE(!reader.read(element));
+
+  for (uint64_t timestamp : { 0, 12345, 100000, 199990 }) { // NOLINT(build/unsigned)
+    BOOST_REQUIRE(reader.seek_to_timestamp(timestamp));
+    uint64_t expected = (timestamp + 9) / 10 * 10; // NOLINT(build/unsigned)
+    for (; expected < 10 * elements_to_write; expected += 10) {
+      BOOST_REQUIRE(reader.read(element));
+      BOOST_REQUIRE_EQUAL(element.timestamp, expected);
+    }
+    BOOST_REQUIRE(!reader.read(element));
+  }
+  BOOST_REQUIRE(!reader.seek_to_timestamp(10 * elements_to_write));
+
+  reader.close();
+  remove("test.out");
+}
+
 BOOST_AUTO_TEST_CASE(BufferedReadWrite_one_int)
 {
   TLOG() << "Trying to write and read one int" << std::endl;
@@ -96,6 +160,44 @@ BOOST_AUTO_TEST_CASE(BufferedReadWrite_zstd)
   test_read_write(writer, reader, numbers_to_write);
 }
 
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_zstd_parallel)
+{
+  TLOG() << "Testing parallel zstd compression and decompression" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.compression_algorithm = "zstd";
+  options.compression_threads = 4;
+  options.compression_level = 3;
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096, "zstd", 4);
+  uint numbers_to_write = 4096 * 4096;
+
+  test_read_write(writer, reader, numbers_to_write);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_zstd_parallel_compatibility)
+{
+  TLOG() << "Testing that the parallel and single-threaded zstd formats are interchangeable" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.compression_algorithm = "zstd";
+  options.compression_threads = 2;
+  options.io_backend = "threaded";
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096, "zstd");
+  test_read_write(writer, reader, 4096 * 64);
+
+  writer.open("test.out", 4096, "zstd");
+  reader.open("test.out", 4096, "zstd", 2);
+  test_read_write(writer, reader, 4096 * 64);
+}
+
 BOOST_AUTO_TEST_CASE(BufferedReadWrite_lzma)
 {
   TLOG() << "Testing lzma compression" << std::endl;
@@ -122,6 +224,441 @@ BOOST_AUTO_TEST_CASE(BufferedReadWrite_zlib)
   test_read_write(writer, reader, numbers_to_write);
 }
 
+#ifdef WITH_LZ4_SUPPORT
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_lz4)
+{
+  TLOG() << "Testing lz4 compression" << std::endl;
+  remove("test.out");
+  BufferedFileWriter writer;
+  writer.open("test.out", 4096, "lz4");
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096, "lz4");
+  uint numbers_to_write = 4096 * 4096;
+
+  test_read_write(writer, reader, numbers_to_write);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_zstd_dictionary)
+{
+  TLOG() << "Testing zstd compression with a trained dictionary" << std::endl;
+  remove("test.out");
+  std::vector<int> samples(1000 * 64);
+  for (uint i = 0; i < samples.size(); ++i) {
+    samples[i] = 7 * (i / 64) + i % 64;
+  }
+  auto dictionary = ZstdDictionary::train(
+    reinterpret_cast<char*>(samples.data()), 64 * sizeof(int), samples.size() / 64, 16384);
+  dictionary.write("test.dict");
+  BOOST_REQUIRE_NE(dictionary.get_id(), 0);
+
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.compression_algorithm = "zstd";
+  options.compression_dictionary = "test.dict";
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096, "zstd", 0, "test.dict");
+  test_read_write(writer, reader, 4096 * 64);
+
+  options.compression_algorithm = "zlib";
+  BOOST_REQUIRE_THROW(writer.open("test.out", options), BufferedReaderWriterConfigurationError);
+  remove("test.out");
+  remove("test.dict");
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_read_n)
+{
+  TLOG() << "Testing bulk reads" << std::endl;
+  remove("test.out");
+  BufferedFileWriter writer;
+  writer.open("test.out", 4096, "zstd");
+  uint numbers_to_write = 100003;
+  for (uint i = 0; i < numbers_to_write; ++i) {
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i)));
+  }
+  writer.close();
+
+  BufferedFileReader<int> reader("test.out", 4096, "zstd");
+  std::vector<int> numbers(1000);
+  uint expected = 0;
+  while (size_t count = reader.read_n(numbers.data(), numbers.size())) {
+    for (size_t i = 0; i < count; ++i) {
+      BOOST_REQUIRE_EQUAL(numbers[i], expected++);
+    }
+  }
+  BOOST_REQUIRE_EQUAL(expected, numbers_to_write);
+  reader.close();
+  remove("test.out");
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_mapped)
+{
+  TLOG() << "Testing reads from a mapped file" << std::endl;
+  remove("test.out");
+  BufferedFileWriter writer;
+  writer.open("test.out", 4096);
+  uint numbers_to_write = 100003;
+  for (uint i = 0; i < numbers_to_write; ++i) {
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i)));
+  }
+  writer.close();
+
+  // A small readahead window, to move it many times
+  BufferedFileReader<int> reader;
+  reader.open_mapped("test.out", 8192);
+  int number;
+  BOOST_REQUIRE(reader.read(number));
+  BOOST_REQUIRE_EQUAL(number, 0);
+  uint expected = 1;
+  const int* numbers = nullptr;
+  while (size_t count = reader.read_mapped(numbers, 1000)) {
+    for (size_t i = 0; i < count; ++i) {
+      BOOST_REQUIRE_EQUAL(numbers[i], expected++);
+    }
+  }
+  BOOST_REQUIRE_EQUAL(expected, numbers_to_write);
+  BOOST_REQUIRE(!reader.read(number));
+  reader.close();
+  BOOST_REQUIRE_EQUAL(reader.read_mapped(numbers, 1000), 0);
+
+  // Indexed recordings can not be mapped
+  BufferedFileWriterOptions writer_options;
+  RecordingFileOptions recording_options;
+  recording_options.format = "indexed";
+  recording_options.element_size = sizeof(int);
+  RecordingFileWriter indexed_writer;
+  indexed_writer.open("test.out", writer_options, recording_options);
+  indexed_writer.close();
+  BOOST_REQUIRE_THROW(reader.open_mapped("test.out"), BufferedReaderWriterConfigurationError);
+  remove("test.out");
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_prefetch)
+{
+  TLOG() << "Testing prefetching reads" << std::endl;
+  // The prefetching starts on open, so the reader is only opened once the file is written
+  auto test_prefetch = [](const BufferedFileReaderOptions& options, uint numbers_to_write) {
+    remove("test.out");
+    BufferedFileWriter writer("test.out", 4096, options.compression_algorithm);
+    for (uint i = 0; i < numbers_to_write; ++i) {
+      BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i)));
+    }
+    writer.close();
+    BufferedFileReader<int> reader("test.out", options);
+    int number;
+    for (uint i = 0; i < numbers_to_write; ++i) {
+      BOOST_REQUIRE(reader.read(number));
+      BOOST_REQUIRE_EQUAL(number, i);
+    }
+    BOOST_REQUIRE(!reader.read(number));
+    BOOST_REQUIRE(!reader.failed());
+    reader.close();
+    remove("test.out");
+  };
+
+  BufferedFileReaderOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "prefetch";
+  test_prefetch(options, 1024 * 1024 + 1);
+
+  // Decompression on the prefetching thread, with and without parallel zstd
+  options.compression_algorithm = "zstd";
+  test_prefetch(options, 1024 * 1024);
+  options.decompression_threads = 2;
+  test_prefetch(options, 1024 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_truncated)
+{
+  TLOG() << "Testing that a truncated file is reported as failed rather than ended" << std::endl;
+  uint numbers_to_write = 1024 * 1024;
+  auto test_truncated = [&](const BufferedFileWriterOptions& writer_options,
+                            const BufferedFileReaderOptions& reader_options,
+                            const RecordingFileOptions& recording_options) {
+    remove("test.out");
+    RecordingFileWriter writer;
+    writer.open("test.out", writer_options, recording_options);
+    for (uint i = 0; i < numbers_to_write; ++i) {
+      BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i), i, i));
+    }
+    writer.close();
+    std::ifstream file("test.out", std::ios::binary | std::ios::ate);
+    BOOST_REQUIRE_EQUAL(::truncate("test.out", static_cast<off_t>(file.tellg()) / 2), 0);
+
+    BufferedFileReader<int> reader("test.out", reader_options);
+    int number;
+    uint numbers_read = 0;
+    while (reader.read(number)) {
+      BOOST_REQUIRE_EQUAL(number, numbers_read);
+      ++numbers_read;
+    }
+    BOOST_REQUIRE_LT(numbers_read, numbers_to_write);
+    BOOST_REQUIRE(reader.failed());
+    reader.close();
+    remove("test.out");
+  };
+
+  BufferedFileWriterOptions writer_options;
+  writer_options.buffer_size = 4096;
+  writer_options.compression_algorithm = "zstd";
+  writer_options.compression_threads = 2;
+  BufferedFileReaderOptions reader_options;
+  reader_options.buffer_size = 4096;
+  reader_options.compression_algorithm = "zstd";
+  reader_options.decompression_threads = 2;
+  RecordingFileOptions recording_options;
+  test_truncated(writer_options, reader_options, recording_options);
+  reader_options.io_backend = "prefetch";
+  test_truncated(writer_options, reader_options, recording_options);
+
+  // A data record of an indexed recording cut short
+  recording_options.format = "indexed";
+  recording_options.element_size = sizeof(int);
+  test_truncated(writer_options, reader_options, recording_options);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_threaded)
+{
+  TLOG() << "Testing the threaded backend" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "threaded";
+  options.io_queue_depth = 2;
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096);
+  uint numbers_to_write = 4096 * 4096 + 4;
+
+  test_read_write(writer, reader, numbers_to_write);
+  BOOST_REQUIRE_EQUAL(writer.get_block_stats().write_latency.snapshot_and_reset().count(), 4097);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_threaded_flush)
+{
+  TLOG() << "Testing flushes of partial blocks with the threaded backend" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "threaded";
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096);
+
+  // Everything written is readable after each flush, and the padded tail is overwritten by the following writes
+  int value;
+  int next_to_read = 0;
+  for (int i = 0; i < 3000; ++i) {
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i)));
+    if (i % 1000 == 999) {
+      writer.flush();
+      for (; next_to_read <= i; ++next_to_read) {
+        BOOST_REQUIRE(reader.read(value));
+        BOOST_REQUIRE_EQUAL(value, next_to_read);
+      }
+      BOOST_REQUIRE(!reader.read(value));
+      reader.close();
+      reader.open("test.out", 4096);
+      for (int j = 0; j < next_to_read; ++j) {
+        BOOST_REQUIRE(reader.read(value));
+      }
+    }
+  }
+  writer.close();
+  reader.close();
+
+  remove("test.out");
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_direct)
+{
+  TLOG() << "Testing the direct backend with staged, direct and flushed writes" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "direct";
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+
+  std::vector<int, boost::alignment::aligned_allocator<int, 4096>> aligned(3 * 4096 / sizeof(int));
+  int next = 0;
+  auto write_ints = [&](int count) {
+    for (int i = 0; i < count; ++i, ++next) {
+      BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&next), sizeof(next)));
+    }
+  };
+  auto write_aligned = [&]() {
+    for (auto& value : aligned) {
+      value = next++;
+    }
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(aligned.data()), aligned.size() * sizeof(int)));
+  };
+  write_ints(1000);
+  writer.flush();
+  write_aligned(); // staged, as the tail of the flush is pending
+  write_ints(4096 / sizeof(int) - next % (4096 / sizeof(int)));
+  write_aligned(); // straight from the aligned buffer
+  write_ints(7);
+  writer.close();
+
+  BufferedFileReader<int> reader("test.out", 4096);
+  int value;
+  for (int i = 0; i < next; ++i) {
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(value, i);
+  }
+  BOOST_REQUIRE(!reader.read(value));
+  reader.close();
+  remove("test.out");
+}
+
+#ifdef WITH_LIBURING_SUPPORT
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_io_uring)
+{
+  TLOG() << "Testing the io_uring backend" << std::endl;
+  remove("test.out");
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "io_uring";
+  BufferedFileWriter writer;
+  writer.open("test.out", options);
+  BufferedFileReader<int> reader;
+  reader.open("test.out", 4096);
+  uint numbers_to_write = 4096 * 4096 + 4;
+
+  test_read_write(writer, reader, numbers_to_write);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_io_uring_compression)
+{
+  TLOG() << "Compression can not be combined with the io_uring backend" << std::endl;
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.compression_algorithm = "zstd";
+  options.io_backend = "io_uring";
+  BufferedFileWriter writer;
+  BOOST_REQUIRE_THROW(writer.open("test.out", options), BufferedReaderWriterConfigurationError);
+  BOOST_REQUIRE(!writer.is_open());
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_indexed)
+{
+  TLOG() << "Testing the indexed recording format and seeking by timestamp" << std::endl;
+  test_indexed_read_write("None", 0);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_indexed_zstd)
+{
+  TLOG() << "Testing the indexed recording format with zstd compressed blocks" << std::endl;
+  test_indexed_read_write("zstd", 2);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_indexed_seek_raw)
+{
+  TLOG() << "Seeking by timestamp is not possible in raw files" << std::endl;
+  remove("test.out");
+  {
+    BufferedFileWriter writer("test.out", 4096);
+    TimestampedElement element{ 42, { 0 } };
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&element), sizeof(element)));
+  }
+  BufferedFileReader<TimestampedElement> reader("test.out", 4096);
+  BOOST_REQUIRE(!reader.seek_to_timestamp(0));
+  reader.close();
+  remove("test.out");
+}
+
+void
+test_striped_read_write(const BufferedFileWriterOptions& options)
+{
+  remove("test.out");
+  StripedFileWriter writer;
+  writer.open("test.out", { ".", ".", "." }, 3 * 4096, options);
+  BOOST_REQUIRE(writer.is_open());
+  uint numbers_to_write = 1000000;
+  for (uint i = 0; i < numbers_to_write; ++i) {
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&i), sizeof(i)));
+  }
+  writer.close();
+
+  BufferedFileReader<int> reader("test.out", 4096);
+  int value;
+  for (uint i = 0; i < numbers_to_write; ++i) {
+    BOOST_REQUIRE(reader.read(value));
+    BOOST_REQUIRE_EQUAL(value, static_cast<int>(i));
+  }
+  BOOST_REQUIRE(!reader.read(value));
+  reader.close();
+
+  remove("test.out");
+  for (size_t i = 0; i < 3; ++i) {
+    remove(StripeManifest::stripe_file_name(".", "test.out", i).c_str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_striped)
+{
+  TLOG() << "Testing a recording striped over three files" << std::endl;
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.io_backend = "threaded";
+  test_striped_read_write(options);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_striped_zstd)
+{
+  TLOG() << "Testing a recording striped over three files, each compressed with zstd" << std::endl;
+  BufferedFileWriterOptions options;
+  options.buffer_size = 4096;
+  options.compression_algorithm = "zstd";
+  test_striped_read_write(options);
+}
+
+BOOST_AUTO_TEST_CASE(BufferedReadWrite_segmented)
+{
+  TLOG() << "Testing an indexed recording split into segments of 1000 elements" << std::endl;
+  BufferedFileWriterOptions writer_options;
+  writer_options.buffer_size = 4096;
+  RecordingFileOptions recording_options;
+  recording_options.format = "indexed";
+  recording_options.element_size = sizeof(TimestampedElement);
+  recording_options.segment_size = 1000 * sizeof(TimestampedElement);
+  RecordingFileWriter writer;
+  writer.open("test.out", writer_options, recording_options);
+  writer.set_run_number(42);
+  BOOST_REQUIRE(writer.is_open());
+  uint elements_to_write = 2500;
+  for (uint i = 0; i < elements_to_write; ++i) {
+    TimestampedElement element{ 10 * i, { i } };
+    BOOST_REQUIRE(writer.write(reinterpret_cast<char*>(&element), sizeof(element), element.timestamp, element.timestamp));
+  }
+  writer.close();
+  BOOST_REQUIRE(!writer.is_open());
+
+  std::vector<std::string> segments = { "test.out.run42.seg0.0-9990",
+                                        "test.out.run42.seg1.10000-19990",
+                                        "test.out.run42.seg2.20000-24990" };
+  uint i = 0;
+  for (auto& segment : segments) {
+    BufferedFileReader<TimestampedElement> reader(segment, 4096);
+    TimestampedElement element;
+    while (reader.read(element)) {
+      BOOST_REQUIRE_EQUAL(element.timestamp, 10 * i);
+      ++i;
+    }
+    BOOST_REQUIRE_EQUAL(i % 1000, segment == segments.back() ? 500u : 0u);
+    reader.close();
+    remove(segment.c_str());
+  }
+  BOOST_REQUIRE_EQUAL(i, elements_to_write);
+  BOOST_REQUIRE(std::fopen("test.out.seg3.inprogress", "r") == nullptr);
+}
+
 BOOST_AUTO_TEST_CASE(BufferedReadWrite_not_opened)
 {
   TLOG() << "Try to read and write on uninitialized instances" << std::endl;
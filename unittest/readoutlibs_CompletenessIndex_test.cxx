@@ -0,0 +1,122 @@
+/**
+ * @file readoutlibs_CompletenessIndex_test.cxx Unit Tests for CompletenessIndex
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_CompletenessIndex_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/CompletenessIndex.hpp"
+
+using namespace dunedaq::readoutlibs;
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_CompletenessIndex_test)
+
+BOOST_AUTO_TEST_CASE(CompletenessIndex_Contiguous)
+{
+  CompletenessIndex index;
+  for (uint64_t ts = 1000; ts < 2000; ts += 100) { // NOLINT(build/unsigned)
+    index.add_element(ts, ts + 100);
+  }
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 0);
+  BOOST_REQUIRE(!index.has_gap(1000, 2000));
+  BOOST_REQUIRE(!index.has_gap(0, 5000));
+}
+
+BOOST_AUTO_TEST_CASE(CompletenessIndex_HasGap)
+{
+  CompletenessIndex index;
+  index.add_element(1000, 1100);
+  index.add_element(1100, 1200);
+  // 1200-1400 missing
+  index.add_element(1400, 1500);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 1);
+
+  // Windows ending at or before the gap, or starting at or after its end, are complete
+  BOOST_REQUIRE(!index.has_gap(1000, 1200));
+  BOOST_REQUIRE(!index.has_gap(1400, 1500));
+  // Any overlap is a gap
+  BOOST_REQUIRE(index.has_gap(1000, 1201));
+  BOOST_REQUIRE(index.has_gap(1399, 1500));
+  BOOST_REQUIRE(index.has_gap(1250, 1300));
+  BOOST_REQUIRE(index.has_gap(1000, 1500));
+}
+
+BOOST_AUTO_TEST_CASE(CompletenessIndex_LateElementsFill)
+{
+  CompletenessIndex index;
+  index.add_element(1000, 1100);
+  // 1100-1500 missing
+  index.add_element(1500, 1600);
+
+  // A late element in the middle splits the range
+  index.add_element(1200, 1300);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 2);
+  BOOST_REQUIRE(!index.has_gap(1200, 1300));
+  BOOST_REQUIRE(index.has_gap(1100, 1200));
+  BOOST_REQUIRE(index.has_gap(1300, 1500));
+
+  // Late elements at the edges shrink the ranges
+  index.add_element(1100, 1200);
+  index.add_element(1300, 1400);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 1);
+  BOOST_REQUIRE(!index.has_gap(1000, 1400));
+  BOOST_REQUIRE(index.has_gap(1400, 1500));
+
+  index.add_element(1400, 1500);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 0);
+  BOOST_REQUIRE(!index.has_gap(1000, 1600));
+}
+
+BOOST_AUTO_TEST_CASE(CompletenessIndex_RemoveUntil)
+{
+  CompletenessIndex index;
+  index.add_element(1000, 1100);
+  // 1100-1200 missing
+  index.add_element(1200, 1300);
+  // 1300-1400 missing
+  index.add_element(1400, 1500);
+  // 1500-1600 missing
+  index.add_element(1600, 1700);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 3);
+
+  // Ranges that end before the timestamp are forgotten, others are kept whole
+  index.remove_until(1350);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 2);
+  BOOST_REQUIRE(!index.has_gap(1100, 1200));
+  BOOST_REQUIRE(index.has_gap(1300, 1400));
+
+  // A range ending exactly at the timestamp goes too
+  index.remove_until(1400);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 1);
+  BOOST_REQUIRE(!index.has_gap(1000, 1500));
+  BOOST_REQUIRE(index.has_gap(1000, 1700));
+
+  index.remove_until(2000);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(CompletenessIndex_Reset)
+{
+  CompletenessIndex index;
+  index.add_element(1000, 1100);
+  index.add_element(1200, 1300);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 1);
+
+  // After a reset, the first element only sets where the data starts
+  index.reset();
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 0);
+  index.add_element(5000, 5100);
+  BOOST_REQUIRE_EQUAL(index.num_missing_ranges(), 0);
+  index.add_element(5100, 5200);
+  BOOST_REQUIRE(!index.has_gap(5000, 5200));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,139 @@
+/**
+ * @file readoutlibs_DeadlineScheduler_test.cxx Unit Tests for DeadlineScheduler
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_DeadlineScheduler_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/utils/DeadlineScheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_DeadlineScheduler_test)
+
+BOOST_AUTO_TEST_CASE(DeadlineScheduler_DeadlineOrder)
+{
+  std::mutex mutex;
+  std::vector<int> order;
+  DeadlineScheduler scheduler;
+  scheduler.conf({ { "only", 1 } });
+
+  // Queued before the worker starts, so that it sees all of them
+  auto now = DeadlineScheduler::clock_t::now();
+  std::vector<int> deadlines_ms{ 50, 10, 30, 10, 20 };
+  for (size_t i = 0; i < deadlines_ms.size(); ++i) {
+    scheduler.post(0, now + std::chrono::milliseconds(deadlines_ms[i]), [&, i] {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(i);
+    });
+  }
+  scheduler.start();
+  scheduler.stop();
+
+  // Earliest deadline first, ties in submission order
+  BOOST_REQUIRE_EQUAL(order.size(), deadlines_ms.size());
+  std::vector<int> expected{ 1, 3, 4, 2, 0 };
+  BOOST_REQUIRE_EQUAL_COLLECTIONS(order.begin(), order.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(DeadlineScheduler_LowPriorityHelpsHighPriority)
+{
+  std::promise<void> high_blocked;
+  std::promise<void> release_high;
+  auto high_released = release_high.get_future().share();
+  std::promise<void> second_done;
+  DeadlineScheduler scheduler;
+  scheduler.conf({ { "high", 1 }, { "low", 1 } });
+  scheduler.start();
+
+  auto deadline = DeadlineScheduler::clock_t::now() + std::chrono::seconds(1);
+  scheduler.post(0, deadline, [&] {
+    high_blocked.set_value();
+    high_released.wait_for(std::chrono::seconds(10));
+  });
+  high_blocked.get_future().wait();
+  // The only high priority worker is busy: the idle low priority worker takes this one
+  scheduler.post(0, deadline, [&] { second_done.set_value(); });
+  auto status = second_done.get_future().wait_for(std::chrono::seconds(5));
+  release_high.set_value();
+  scheduler.stop();
+  BOOST_REQUIRE(status == std::future_status::ready);
+
+  auto stats = scheduler.get_stats();
+  BOOST_REQUIRE_EQUAL(stats[0].num_tasks, 2);
+  BOOST_REQUIRE_EQUAL(stats[1].num_tasks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(DeadlineScheduler_LowPriorityDoesNotStarve)
+{
+  const int num_high = 20;
+  std::mutex mutex;
+  std::vector<std::string> order;
+  DeadlineScheduler scheduler;
+  scheduler.conf({ { "high", 1 }, { "low", 1 } });
+
+  // A backlog of high priority work, queued before the workers start
+  auto deadline = DeadlineScheduler::clock_t::now() + std::chrono::seconds(1);
+  for (int i = 0; i < num_high; ++i) {
+    scheduler.post(0, deadline, [&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back("high");
+    });
+  }
+  scheduler.post(1, deadline, [&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back("low");
+  });
+  scheduler.start();
+  scheduler.stop();
+
+  // The low priority worker serves its own class before helping out, rather than after the whole backlog
+  BOOST_REQUIRE_EQUAL(order.size(), num_high + 1);
+  auto low = std::find(order.begin(), order.end(), "low");
+  BOOST_REQUIRE(low != order.end());
+  BOOST_REQUIRE_LT(low - order.begin(), num_high / 2);
+}
+
+BOOST_AUTO_TEST_CASE(DeadlineScheduler_HighPriorityIgnoresLowPriority)
+{
+  std::promise<void> low_blocked;
+  std::promise<void> release_low;
+  auto low_released = release_low.get_future().share();
+  DeadlineScheduler scheduler;
+  scheduler.conf({ { "high", 1 }, { "low", 1 } });
+  scheduler.start();
+
+  auto deadline = DeadlineScheduler::clock_t::now() + std::chrono::seconds(1);
+  scheduler.post(1, deadline, [&] {
+    low_blocked.set_value();
+    low_released.wait_for(std::chrono::seconds(10));
+  });
+  low_blocked.get_future().wait();
+  // The low priority worker is busy, and the high priority worker does not take low priority work
+  scheduler.post(1, deadline, [] {});
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto stats = scheduler.get_stats();
+  BOOST_REQUIRE_EQUAL(stats[1].num_queued, 1);
+
+  release_low.set_value();
+  scheduler.stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
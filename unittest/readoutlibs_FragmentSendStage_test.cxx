@@ -0,0 +1,206 @@
+/**
+ * @file readoutlibs_FragmentSendStage_test.cxx Unit Tests for FragmentSendStage
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_FragmentSendStage_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/FragmentSendStage.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+using dunedaq::daqdataformats::Fragment;
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_FragmentSendStage_test)
+
+namespace {
+
+std::unique_ptr<Fragment>
+make_fragment(uint64_t sequence_number) // NOLINT(build/unsigned)
+{
+  int payload = 0;
+  auto fragment = std::make_unique<Fragment>(&payload, sizeof(payload));
+  fragment->set_sequence_number(sequence_number);
+  return fragment;
+}
+
+dunedaq::daqdataformats::SourceID
+test_sourceid()
+{
+  dunedaq::daqdataformats::SourceID sourceid;
+  sourceid.id = 1;
+  return sourceid;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(FragmentSendStage_SendsInOrder)
+{
+  std::mutex mutex;
+  std::vector<uint64_t> sent; // NOLINT(build/unsigned)
+  FragmentSendStage stage;
+  stage.conf(test_sourceid(), 16, 4, 1000, 10);
+  stage.set_sender_factory([&](const std::string&) {
+    return [&](std::unique_ptr<Fragment>&& fragment, std::chrono::milliseconds) {
+      std::lock_guard<std::mutex> lock(mutex);
+      sent.push_back(fragment->get_sequence_number());
+    };
+  });
+  stage.start();
+  for (uint64_t i = 0; i < 100; ++i) { // NOLINT(build/unsigned)
+    BOOST_REQUIRE(stage.enqueue("dest", make_fragment(i)));
+  }
+  stage.stop();
+
+  BOOST_REQUIRE_EQUAL(sent.size(), 100);
+  for (uint64_t i = 0; i < sent.size(); ++i) { // NOLINT(build/unsigned)
+    BOOST_REQUIRE_EQUAL(sent[i], i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FragmentSendStage_FailedLookupIsRetriedAfterBackoff)
+{
+  std::atomic<int> lookups{ 0 };
+  std::atomic<bool> available{ false };
+  std::atomic<int> sent{ 0 };
+  FragmentSendStage stage;
+  stage.conf(test_sourceid(), 16, 4, 10, 10);
+  stage.set_lookup_retry_interval(std::chrono::milliseconds(200));
+  stage.set_sender_factory([&](const std::string& destination) -> FragmentSendStage::sender_t {
+    ++lookups;
+    if (!available.load()) {
+      throw CannotWriteToQueue(ERS_HERE, test_sourceid(), destination);
+    }
+    return [&](std::unique_ptr<Fragment>&&, std::chrono::milliseconds) { ++sent; };
+  });
+  stage.start();
+  BOOST_REQUIRE(!stage.enqueue("late", make_fragment(0)));
+  BOOST_REQUIRE(!stage.enqueue("late", make_fragment(1)));
+  BOOST_REQUIRE_EQUAL(lookups.load(), 1);
+
+  // The destination shows up, but is only looked up again once the back-off has passed
+  available = true;
+  BOOST_REQUIRE(!stage.enqueue("late", make_fragment(2)));
+  BOOST_REQUIRE_EQUAL(lookups.load(), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  BOOST_REQUIRE(stage.enqueue("late", make_fragment(3)));
+  BOOST_REQUIRE(stage.enqueue("late", make_fragment(4)));
+  BOOST_REQUIRE_EQUAL(lookups.load(), 2);
+  stage.stop();
+  BOOST_REQUIRE_EQUAL(sent.load(), 2);
+
+  // A new run forgets the failed lookups
+  available = false;
+  stage.start();
+  BOOST_REQUIRE(!stage.enqueue("missing", make_fragment(5)));
+  BOOST_REQUIRE_EQUAL(lookups.load(), 3);
+  stage.stop();
+  stage.start();
+  BOOST_REQUIRE(!stage.enqueue("missing", make_fragment(6)));
+  BOOST_REQUIRE_EQUAL(lookups.load(), 4);
+  stage.stop();
+}
+
+BOOST_AUTO_TEST_CASE(FragmentSendStage_StopDoesNotBlockEnqueue)
+{
+  std::promise<void> release_sender;
+  auto sender_released = release_sender.get_future().share();
+  FragmentSendStage stage;
+  stage.conf(test_sourceid(), 16, 1, 10, 10);
+  stage.set_sender_factory([&](const std::string& destination) -> FragmentSendStage::sender_t {
+    if (destination == "slow") {
+      return [=](std::unique_ptr<Fragment>&&, std::chrono::milliseconds) {
+        sender_released.wait_for(std::chrono::seconds(10));
+      };
+    }
+    return [](std::unique_ptr<Fragment>&&, std::chrono::milliseconds) {};
+  });
+  stage.start();
+  BOOST_REQUIRE(stage.enqueue("slow", make_fragment(0)));
+  BOOST_REQUIRE(stage.enqueue("slow", make_fragment(1)));
+
+  // stop() drains the slow destination; an enqueue meanwhile returns without waiting for the drain
+  std::thread stopper([&] { stage.stop(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto begin = std::chrono::steady_clock::now();
+  BOOST_REQUIRE(!stage.enqueue("slow", make_fragment(2)));
+  BOOST_REQUIRE(!stage.enqueue("fast", make_fragment(3)));
+  BOOST_REQUIRE(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(500));
+  release_sender.set_value();
+  stopper.join();
+}
+
+BOOST_AUTO_TEST_CASE(FragmentSendStage_SlowLookupDoesNotBlockOthers)
+{
+  std::promise<void> release_slow;
+  auto slow_released = release_slow.get_future().share();
+  std::promise<void> slow_started;
+  std::atomic<bool> slow_finished{ false };
+  FragmentSendStage stage;
+  stage.conf(test_sourceid(), 16, 4, 1000, 10);
+  stage.set_sender_factory([&](const std::string& destination) {
+    if (destination == "slow") {
+      slow_started.set_value();
+      slow_released.wait_for(std::chrono::seconds(10));
+      slow_finished = true;
+    }
+    return [](std::unique_ptr<Fragment>&&, std::chrono::milliseconds) {};
+  });
+  stage.start();
+
+  std::thread slow_extractor([&] { stage.enqueue("slow", make_fragment(0)); });
+  slow_started.get_future().wait();
+  BOOST_REQUIRE(stage.enqueue("fast", make_fragment(1)));
+  BOOST_REQUIRE(!slow_finished.load());
+  release_slow.set_value();
+  slow_extractor.join();
+  stage.stop();
+}
+
+BOOST_AUTO_TEST_CASE(FragmentSendStage_DropsWhenFull)
+{
+  std::promise<void> send_started;
+  std::promise<void> release_send;
+  auto send_released = release_send.get_future().share();
+  std::atomic<int> num_sends{ 0 };
+  FragmentSendStage stage;
+  stage.conf(test_sourceid(), 1, 1, 10, 10);
+  stage.set_sender_factory([&](const std::string&) {
+    return [&](std::unique_ptr<Fragment>&&, std::chrono::milliseconds) {
+      if (num_sends++ == 0) {
+        send_started.set_value();
+        send_released.wait_for(std::chrono::seconds(10));
+      }
+    };
+  });
+  stage.start();
+
+  // The first fragment blocks the sender, the second fills the queue, the third does not fit
+  BOOST_REQUIRE(stage.enqueue("dest", make_fragment(0)));
+  send_started.get_future().wait();
+  BOOST_REQUIRE(stage.enqueue("dest", make_fragment(1)));
+  BOOST_REQUIRE(!stage.enqueue("dest", make_fragment(2)));
+  BOOST_REQUIRE_EQUAL(stage.get_queue_depth(), 1);
+
+  release_send.set_value();
+  stage.stop();
+  BOOST_REQUIRE_EQUAL(num_sends.load(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+/**
+ * @file readoutlibs_LatencyHistogram_test.cxx Unit Tests for LatencyHistogram
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_LatencyHistogram_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/utils/LatencyHistogram.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_LatencyHistogram_test)
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_SmallValuesAreExact)
+{
+  for (uint64_t value = 0; value < 2 * LatencyHistogram::s_sub_buckets; ++value) { // NOLINT(build/unsigned)
+    BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index(value), value);
+    BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_upper(value), value);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_BucketBoundaries)
+{
+  // Every bucket ends right before the next one begins
+  for (size_t index = 0; index + 1 < LatencyHistogram::s_num_buckets; ++index) {
+    auto upper = LatencyHistogram::bucket_upper(index);
+    BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index(upper), index);
+    BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index(upper + 1), index + 1);
+  }
+
+  // The bucket of a value reports it with a relative error below 1/16
+  for (uint64_t value = 1; value < (1ULL << 40); value = value * 3 + 1) { // NOLINT(build/unsigned)
+    auto upper = LatencyHistogram::bucket_upper(LatencyHistogram::bucket_index(value));
+    BOOST_REQUIRE_GE(upper, value);
+    BOOST_REQUIRE_LT(upper - value, value / LatencyHistogram::s_sub_buckets + 1);
+  }
+
+  // Values beyond the highest magnitude are clamped into the last bucket
+  auto last = LatencyHistogram::s_num_buckets - 1;
+  BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index((1ULL << 41) - 1), last);
+  BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index(1ULL << 41), last);
+  BOOST_REQUIRE_EQUAL(LatencyHistogram::bucket_index(std::numeric_limits<uint64_t>::max()), last); // NOLINT
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_Percentiles)
+{
+  LatencyHistogram hist;
+  BOOST_REQUIRE_EQUAL(hist.snapshot_and_reset().percentile(0.5), 0);
+
+  for (uint64_t value = 1; value <= 1000; ++value) { // NOLINT(build/unsigned)
+    hist.record(value);
+  }
+  auto snap = hist.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(snap.count(), 1000);
+  BOOST_REQUIRE_EQUAL(snap.max(), 1000);
+  BOOST_REQUIRE_EQUAL(snap.percentile(0.0), 1);
+  BOOST_REQUIRE_EQUAL(snap.percentile(1.0), 1000);
+
+  // Reported values are the top of the bucket of the exact percentile, and never above the max
+  for (double quantile : { 0.5, 0.9, 0.99, 0.999 }) {
+    auto exact = static_cast<uint64_t>(quantile * 1000); // NOLINT(build/unsigned)
+    auto reported = snap.percentile(quantile);
+    BOOST_REQUIRE_GE(reported, exact);
+    BOOST_REQUIRE_LE(reported, exact + exact / LatencyHistogram::s_sub_buckets);
+    BOOST_REQUIRE_LE(reported, snap.max());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogram_SnapshotAndReset)
+{
+  const int num_threads = 4;
+  const int num_records = 10000;
+  LatencyHistogram hist;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < num_records; ++i) {
+        hist.record(t * num_records + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Records of all threads (and shards) are merged
+  auto snap = hist.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(snap.count(), num_threads * num_records);
+  BOOST_REQUIRE_EQUAL(snap.max(), num_threads * num_records - 1);
+
+  // and cleared
+  auto empty = hist.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(empty.count(), 0);
+  BOOST_REQUIRE_EQUAL(empty.max(), 0);
+  BOOST_REQUIRE_EQUAL(empty.percentile(0.99), 0);
+
+  hist.record(42);
+  auto next = hist.snapshot_and_reset();
+  BOOST_REQUIRE_EQUAL(next.count(), 1);
+  BOOST_REQUIRE_EQUAL(next.max(), 42);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,243 @@
+/**
+ * @file readoutlibs_MultiLinkRequestHandler_test.cxx Unit Tests for MultiLinkRequestHandlerModel
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_MultiLinkRequestHandler_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/ReadoutTypes.hpp"
+#include "readoutlibs/models/BinarySearchQueueModel.hpp"
+#include "readoutlibs/models/MultiLinkRequestHandlerModel.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+using dunedaq::daqdataformats::Fragment;
+using dunedaq::daqdataformats::FragmentHeader;
+
+namespace {
+
+using element_t = types::DUMMY_FRAME_STRUCT;
+using buffer_t = BinarySearchQueueModel<element_t>;
+using handler_t = MultiLinkRequestHandlerModel<element_t, buffer_t>;
+
+// A link of a group: its latency buffer and request handler
+struct TestLink
+{
+  TestLink(uint32_t source_id, const std::string& group) // NOLINT(build/unsigned)
+  {
+    readoutconfig::LatencyBufferConf lb_conf;
+    lb_conf.latency_buffer_size = 4096;
+    lb_conf.latency_buffer_intrinsic_allocator = true;
+    lb_conf.latency_buffer_alignment_size = 4096;
+    nlohmann::json lb_args;
+    lb_args["latencybufferconf"] = lb_conf;
+    latency_buffer = std::make_unique<buffer_t>();
+    latency_buffer->conf(lb_args);
+    error_registry = std::make_unique<FrameErrorRegistry>();
+    handler = std::make_unique<handler_t>(latency_buffer, error_registry);
+
+    readoutconfig::RequestHandlerConf conf;
+    conf.latency_buffer_size = 4096;
+    conf.pop_limit_pct = 0.5;
+    conf.pop_size_pct = 0.8;
+    conf.num_request_handling_threads = 2;
+    conf.request_timeout_ms = 5000;
+    conf.fragment_send_timeout_ms = 10;
+    conf.fragment_send_queue_size = 100;
+    conf.fragment_send_batch_size = 1;
+    conf.fragment_queue_timeout_ms = 100;
+    conf.source_id = source_id;
+    conf.enable_raw_recording = false;
+    conf.link_group = group;
+    conf.warn_on_timeout = false;
+    conf.warn_about_empty_buffer = false;
+    nlohmann::json args;
+    args["requesthandlerconf"] = conf;
+    handler->conf(args);
+  }
+
+  // Elements [first, last) in units of the tick difference
+  void produce(uint64_t first, uint64_t last) // NOLINT(build/unsigned)
+  {
+    for (auto number = first; number < last; ++number) {
+      element_t element;
+      element.timestamp = number * element_t::expected_tick_difference;
+      element.another_key = number;
+      latency_buffer->write(std::move(element));
+    }
+  }
+
+  std::unique_ptr<buffer_t> latency_buffer;
+  std::unique_ptr<FrameErrorRegistry> error_registry;
+  std::unique_ptr<handler_t> handler;
+};
+
+dunedaq::dfmessages::DataRequest
+make_request(uint32_t source_id, uint64_t begin, uint64_t end) // NOLINT(build/unsigned)
+{
+  dunedaq::dfmessages::DataRequest dr;
+  dr.trigger_number = 7;
+  dr.sequence_number = 0;
+  dr.run_number = 1;
+  dr.trigger_timestamp = begin * element_t::expected_tick_difference;
+  dr.request_information.component = { element_t::subsystem, source_id };
+  dr.request_information.window_begin = begin * element_t::expected_tick_difference;
+  dr.request_information.window_end = end * element_t::expected_tick_difference;
+  dr.data_destination = "fragments";
+  return dr;
+}
+
+// Collects what the group sends
+struct TestSender
+{
+  FragmentSendStage::sender_factory_t factory()
+  {
+    return [this](const std::string&) {
+      return [this](std::unique_ptr<Fragment>&& fragment, std::chrono::milliseconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fragments.push_back(std::move(fragment));
+      };
+    };
+  }
+
+  size_t num_sent()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fragments.size();
+  }
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Fragment>> fragments;
+};
+
+// The sections of a combined fragment
+std::vector<FragmentHeader>
+get_sections(const Fragment& fragment)
+{
+  std::vector<FragmentHeader> sections;
+  const char* data = static_cast<const char*>(fragment.get_data());
+  size_t pos = 0;
+  while (pos < fragment.get_data_size()) {
+    FragmentHeader header;
+    std::memcpy(&header, data + pos, sizeof(header));
+    BOOST_REQUIRE_GE(header.size, sizeof(header));
+    sections.push_back(header);
+    pos += header.size;
+  }
+  BOOST_REQUIRE_EQUAL(pos, fragment.get_data_size());
+  return sections;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_MultiLinkRequestHandler_test)
+
+BOOST_AUTO_TEST_CASE(MultiLinkRequestHandler_CombinedFragment)
+{
+  // Joining in any order, sections come in the order of the source ids
+  TestLink link2(2, "combined");
+  TestLink link1(1, "combined");
+  TestSender sender;
+  link1.handler->set_sender_factory(sender.factory());
+  link1.produce(0, 100);
+  link2.produce(0, 100);
+  nlohmann::json start_args;
+  start_args["run"] = 1;
+  link1.handler->start(start_args);
+  link2.handler->start(start_args);
+
+  link1.handler->issue_request(make_request(1, 10, 20), false);
+  link1.handler->stop(nlohmann::json());
+  link2.handler->stop(nlohmann::json());
+
+  BOOST_REQUIRE_EQUAL(sender.fragments.size(), 1);
+  const auto& fragment = *sender.fragments.front();
+  BOOST_REQUIRE_EQUAL(fragment.get_element_id().id, 1);
+  BOOST_REQUIRE_EQUAL(fragment.get_trigger_number(), 7);
+  BOOST_REQUIRE_EQUAL(fragment.get_error_bits(), 0);
+  auto sections = get_sections(fragment);
+  BOOST_REQUIRE_EQUAL(sections.size(), 2);
+  BOOST_REQUIRE_EQUAL(sections[0].element_id.id, 1);
+  BOOST_REQUIRE_EQUAL(sections[1].element_id.id, 2);
+  BOOST_REQUIRE_GT(sections[0].size, sizeof(FragmentHeader));
+  BOOST_REQUIRE_EQUAL(sections[0].size, sections[1].size);
+}
+
+BOOST_AUTO_TEST_CASE(MultiLinkRequestHandler_WaitsForSlowLink)
+{
+  TestLink link1(1, "slow");
+  TestLink link2(2, "slow");
+  TestSender sender;
+  link2.handler->set_sender_factory(sender.factory());
+  link1.produce(0, 100);
+  link2.produce(0, 15);
+  nlohmann::json start_args;
+  start_args["run"] = 1;
+  link1.handler->start(start_args);
+  link2.handler->start(start_args);
+
+  // Link 2 does not have the end of the window yet: the request waits for it
+  link2.handler->issue_request(make_request(2, 10, 20), false);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  BOOST_REQUIRE_EQUAL(sender.num_sent(), 0);
+
+  // It is answered once the data is there, well before the request timeout
+  link2.produce(15, 100);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (sender.num_sent() == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_REQUIRE_EQUAL(sender.num_sent(), 1);
+  link1.handler->stop(nlohmann::json());
+  link2.handler->stop(nlohmann::json());
+
+  const auto& fragment = *sender.fragments.front();
+  BOOST_REQUIRE_EQUAL(fragment.get_element_id().id, 2);
+  BOOST_REQUIRE_EQUAL(fragment.get_error_bits(), 0);
+  auto sections = get_sections(fragment);
+  BOOST_REQUIRE_EQUAL(sections.size(), 2);
+  BOOST_REQUIRE_EQUAL(sections[0].size, sections[1].size);
+}
+
+BOOST_AUTO_TEST_CASE(MultiLinkRequestHandler_PendingRequestsAnsweredAtStop)
+{
+  TestLink link1(1, "stop");
+  TestLink link2(2, "stop");
+  TestSender sender;
+  link1.handler->set_sender_factory(sender.factory());
+  link1.produce(0, 100);
+  link2.produce(0, 15);
+  nlohmann::json start_args;
+  start_args["run"] = 1;
+  link1.handler->start(start_args);
+  link2.handler->start(start_args);
+
+  // The data never arrives: the stop does not wait for the request timeout, the request is answered incomplete
+  link1.handler->issue_request(make_request(1, 10, 20), false);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto begin = std::chrono::steady_clock::now();
+  link1.handler->stop(nlohmann::json());
+  link2.handler->stop(nlohmann::json());
+  BOOST_REQUIRE(std::chrono::steady_clock::now() - begin < std::chrono::seconds(2));
+
+  BOOST_REQUIRE_EQUAL(sender.fragments.size(), 1);
+  BOOST_REQUIRE_NE(sender.fragments.front()->get_error_bits(), 0);
+  BOOST_REQUIRE_EQUAL(get_sections(*sender.fragments.front()).size(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
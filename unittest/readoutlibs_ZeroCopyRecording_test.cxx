@@ -0,0 +1,131 @@
+/**
+ * @file readoutlibs_ZeroCopyRecording_test.cxx Unit Tests for ZeroCopyRecordingRequestHandlerModel
+ *
+ * This is part of the DUNE DAQ Application Framework, copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+/**
+ * @brief Name of this test module
+ */
+#define BOOST_TEST_MODULE readoutlibs_ZeroCopyRecording_test // NOLINT
+
+#include "boost/test/unit_test.hpp"
+
+#include "readoutlibs/ReadoutTypes.hpp"
+#include "readoutlibs/models/BinarySearchQueueModel.hpp"
+#include "readoutlibs/models/ZeroCopyRecordingRequestHandlerModel.hpp"
+#include "readoutlibs/utils/BufferedFileReader.hpp"
+#include "readoutlibs/utils/StripeManifest.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::readoutlibs;
+
+BOOST_AUTO_TEST_SUITE(readoutlibs_ZeroCopyRecording_test)
+
+BOOST_AUTO_TEST_CASE(ZeroCopyRecording_StripedRingFull)
+{
+  using element_t = types::DUMMY_FRAME_STRUCT;
+  using buffer_t = BinarySearchQueueModel<element_t>;
+  // Whole aligned blocks, as zero-copy recording requires
+  const size_t buffer_size = 4096;
+  const std::vector<std::string> stripe_directories{ ".", "." };
+
+  readoutconfig::LatencyBufferConf lb_conf;
+  lb_conf.latency_buffer_size = buffer_size;
+  lb_conf.latency_buffer_intrinsic_allocator = true;
+  lb_conf.latency_buffer_alignment_size = 4096;
+  nlohmann::json lb_args;
+  lb_args["latencybufferconf"] = lb_conf;
+  std::unique_ptr<buffer_t> latency_buffer = std::make_unique<buffer_t>();
+  latency_buffer->conf(lb_args);
+  std::unique_ptr<FrameErrorRegistry> error_registry = std::make_unique<FrameErrorRegistry>();
+  ZeroCopyRecordingRequestHandlerModel<element_t, buffer_t> handler(latency_buffer, error_registry);
+
+  readoutconfig::RequestHandlerConf conf;
+  conf.latency_buffer_size = buffer_size;
+  conf.pop_limit_pct = 0.5;
+  conf.pop_size_pct = 0.8;
+  conf.num_request_handling_threads = 1;
+  conf.request_timeout_ms = 1000;
+  conf.fragment_send_queue_size = 1000;
+  conf.fragment_send_batch_size = 16;
+  conf.fragment_queue_timeout_ms = 100;
+  conf.output_file = "test.out";
+  conf.stream_buffer_size = 8 * 4096;
+  conf.compression_algorithm = "None";
+  conf.use_o_direct = false;
+  conf.io_backend = "stream";
+  conf.recording_format = "raw";
+  conf.recording_index_interval = 64;
+  conf.recording_clock_frequency = 62500000;
+  conf.stripe_directories = stripe_directories;
+  conf.stripe_size = 4 * 4096;
+  conf.recording_burst_size = 16777216;
+  conf.enable_raw_recording = true;
+  conf.warn_on_timeout = false;
+  conf.warn_about_empty_buffer = false;
+  nlohmann::json args;
+  args["requesthandlerconf"] = conf;
+  handler.conf(args);
+  nlohmann::json start_args;
+  start_args["run"] = 1;
+  handler.start(start_args);
+
+  // Elements carry their number, so that any element overwritten before it was written to the stripes shows
+  auto produce = [&](uint64_t& number) { // NOLINT(build/unsigned)
+    element_t element;
+    element.timestamp = number * element_t::expected_tick_difference;
+    element.another_key = number;
+    std::memset(element.data, static_cast<char>(number), sizeof(element.data));
+    ++number;
+    latency_buffer->write(std::move(element));
+    handler.cleanup_check();
+  };
+  uint64_t number = 0; // NOLINT(build/unsigned)
+  while (latency_buffer->occupancy() < buffer_size / 4) {
+    produce(number);
+  }
+
+  // The producer outpaces the recording, so the ring fills up while stripe writes are queued
+  readoutconfig::RecordingParams params;
+  params.duration = 1;
+  handler.record(nlohmann::json(params));
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500);
+  while (std::chrono::steady_clock::now() < end) {
+    produce(number);
+  }
+  handler.stop(nlohmann::json());
+
+  BufferedFileReader<element_t> reader("test.out", 65536);
+  element_t element;
+  size_t num_read = 0;
+  uint64_t previous = 0; // NOLINT(build/unsigned)
+  while (reader.read(element)) {
+    BOOST_REQUIRE_EQUAL(element.timestamp, element.another_key * element_t::expected_tick_difference);
+    BOOST_REQUIRE_EQUAL(element.data[0], static_cast<char>(element.another_key));
+    BOOST_REQUIRE_EQUAL(element.data[sizeof(element.data) - 1], static_cast<char>(element.another_key));
+    if (num_read > 0) {
+      BOOST_REQUIRE_GT(element.another_key, previous);
+    }
+    previous = element.another_key;
+    ++num_read;
+  }
+  BOOST_REQUIRE(!reader.failed());
+  BOOST_REQUIRE_GT(num_read, buffer_size);
+  reader.close();
+
+  remove("test.out");
+  for (size_t i = 0; i < stripe_directories.size(); ++i) {
+    remove(StripeManifest::stripe_file_name(stripe_directories[i], "test.out", i).c_str());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()